@@ -370,6 +370,46 @@ static inline void new_floating_point(BYTE cond, BYTE opc1, BYTE opc2, BYTE b12,
 #define LDR_IO(Rd, Rn, off) \
     new_ldst_imm_off(ARM_COND_AL, 1, 1, 0, 0, 1, Rn, Rd, off)
 
+// ldrb Rd, [Rn, #off]
+// Load byte with immediate offset
+#define LDRB_IO(Rd, Rn, off) \
+    new_ldst_imm_off(ARM_COND_AL, 1, 1, 1, 0, 1, Rn, Rd, off)
+
+// strb Rd, [Rn, #off]
+// Store byte with immediate offset
+#define STRB_IO(Rd, Rn, off) \
+    new_ldst_imm_off(ARM_COND_AL, 1, 1, 1, 0, 0, Rn, Rd, off)
+
+// ldr Rd, [Rn, Rm]
+// Load with register offset
+#define LDR_RO(Rd, Rn, Rm) \
+    new_ldst_reg_off(ARM_COND_AL, 1, 1, 0, 0, 1, Rn, Rd, 0, 0, Rm)
+
+// str Rd, [Rn, Rm]
+// Store with register offset
+#define STR_RO(Rd, Rn, Rm) \
+    new_ldst_reg_off(ARM_COND_AL, 1, 1, 0, 0, 0, Rn, Rd, 0, 0, Rm)
+
+// ldrb Rd, [Rn, Rm]
+// Load byte with register offset
+#define LDRB_RO(Rd, Rn, Rm) \
+    new_ldst_reg_off(ARM_COND_AL, 1, 1, 1, 0, 1, Rn, Rd, 0, 0, Rm)
+
+// strb Rd, [Rn, Rm]
+// Store byte with register offset
+#define STRB_RO(Rd, Rn, Rm) \
+    new_ldst_reg_off(ARM_COND_AL, 1, 1, 1, 0, 0, Rn, Rd, 0, 0, Rm)
+
+// ldrh Rd, [Rn, Rm]
+// Load halfword with register offset
+#define LDRH_RO(Rd, Rn, Rm) \
+    new_ldst_hb2(ARM_COND_AL, 1, 1, 0, 1, Rn, Rd, 0, 0, 1, Rm)
+
+// strh Rd, [Rn, Rm]
+// Store halfword with register offset
+#define STRH_RO(Rd, Rn, Rm) \
+    new_ldst_hb2(ARM_COND_AL, 1, 1, 0, 0, Rn, Rd, 0, 0, 1, Rm)
+
 // cmp Rn, imm8, ror #rot
 // Compare immediate
 // imm8 can be rotated an even number of times
@@ -493,6 +533,16 @@ static inline void new_floating_point(BYTE cond, BYTE opc1, BYTE opc2, BYTE b12,
 #define EORS_IS(Rd, Rn, Rm, shift, shift_imm) \
     new_data_proc_imm_shift(ARM_COND_AL, ARM_OP_EOR, 1, Rn, Rd, shift_imm, shift, Rm)
 
+// bic Rd, Rn, imm, ror #rot
+// Bit clear immediate into a different register
+// imm8 can be rotated an even number of times
+#define BIC_RI(Rd, Rn, imm8, rot) \
+    new_data_proc_imm(ARM_COND_AL, ARM_OP_BIC, 0, Rn, Rd, rot>>1, imm8)
+
+// and Rd, Rn, Rm
+#define AND(Rd, Rn, Rm) \
+    new_data_proc_imm_shift(ARM_COND_AL, ARM_OP_AND, 0, Rn, Rd, 0, 0, Rm)
+
 // add Rd, Rn, Rm
 #define ADD(Rd, Rn, Rm) \
     ADD_IS(Rd, Rn, Rm, 0, 0)
@@ -513,6 +563,14 @@ static inline void new_floating_point(BYTE cond, BYTE opc1, BYTE opc2, BYTE b12,
 #define EOR(Rd, Rn, Rm) \
     EOR_IS(Rd, Rn, Rm, 0, 0)
 
+// sub Rd, Rn, Rm
+#define SUB(Rd, Rn, Rm) \
+    new_data_proc_imm_shift(ARM_COND_AL, ARM_OP_SUB, 0, Rn, Rd, 0, 0, Rm)
+
+// mvn Rd, Rm
+#define MVN(Rd, Rm) \
+    new_data_proc_imm_shift(ARM_COND_AL, ARM_OP_MVN, 0, 0, Rd, 0, 0, Rm)
+
 // lsl Rd, Rn, Rm
 #define LSL(Rd, Rm, Rs) \
     new_data_proc_reg_shift(ARM_COND_AL, ARM_OP_MOV, 0, 0, Rd, Rs, ARM_SHIFT_LSL, Rm)
@@ -521,6 +579,10 @@ static inline void new_floating_point(BYTE cond, BYTE opc1, BYTE opc2, BYTE b12,
 #define LSR(Rd, Rm, Rs) \
     new_data_proc_reg_shift(ARM_COND_AL, ARM_OP_MOV, 0, 0, Rd, Rs, ARM_SHIFT_LSR, Rm)
 
+// asr Rd, Rn, Rm
+#define ASR(Rd, Rm, Rs) \
+    new_data_proc_reg_shift(ARM_COND_AL, ARM_OP_MOV, 0, 0, Rd, Rs, ARM_SHIFT_ASR, Rm)
+
 // adds Rd, Rn, Rm
 #define ADDS(Rd, Rn, Rm) \
     ADDS_IS(Rd, Rn, Rm, 0, 0)
@@ -571,6 +633,16 @@ static inline void new_floating_point(BYTE cond, BYTE opc1, BYTE opc2, BYTE b12,
 #define UMULLS(RdLo, RdHi, Rn, Rm) \
     new_multiply_long(ARM_COND_AL, 0, 0, 1, RdHi, RdLo, Rn, Rm)
 
+// smull RdLo, RdHi, Rn, Rm
+// Signed multiply long without setting the flags
+#define SMULL(RdLo, RdHi, Rn, Rm) \
+    new_multiply_long(ARM_COND_AL, 1, 0, 0, RdHi, RdLo, Rn, Rm)
+
+// umull RdLo, RdHi, Rn, Rm
+// Unsigned multiply long without setting the flags
+#define UMULL(RdLo, RdHi, Rn, Rm) \
+    new_multiply_long(ARM_COND_AL, 0, 0, 0, RdHi, RdLo, Rn, Rm)
+
 // vmov Sn, Rt
 #define VMOV_SR(Sn, Rt) \
     new_floating_point(ARM_COND_AL, 0, Sn>>1, Rt, 0b1010, (Sn&1)<<1, 1, 0)
@@ -660,6 +732,13 @@ static inline void new_floating_point(BYTE cond, BYTE opc1, BYTE opc2, BYTE b12,
     MSR(0); \
 }
 
+// Clear the overflow flag
+#define CLEAR_OVERFLOW() { \
+    MRS(0); \
+    BIC_I(0, 0b01, 4); \
+    MSR(0); \
+}
+
 // Load word into register using a literal pool
 #ifdef LITERAL_POOL
 #define LDW_I(reg, word) { \
@@ -681,19 +760,42 @@ static inline void new_floating_point(BYTE cond, BYTE opc1, BYTE opc2, BYTE b12,
 }
 #endif
 
+// Load word into register using always four instructions, so the value can be
+// patched later on
+#define LDW_I_FIXED(reg, word) { \
+    MOV_I(reg, (WORD)(word) & 0x000000FF, 0); \
+    ORR_I(reg, ((WORD)(word) & 0x0000FF00)>>8, 24); \
+    ORR_I(reg, ((WORD)(word) & 0x00FF0000)>>16, 16); \
+    ORR_I(reg, ((WORD)(word) & 0xFF000000)>>24, 8); \
+}
+
 #define ADDCYCLES() { \
     ADD_I(10, 10, cycles & 0xFF, 0); \
     cycles = 0; \
 }
 
+// Calls the interrupt handler once r10 reaches v810_state->next_event
 #define HANDLEINT(ret_PC) { \
     MRS(0); \
     LDW_I(1, ret_PC); \
-    ADDS_I(10, 10, cycles & 0xFF, 0); \
+    ADD_I(10, 10, cycles & 0xFF, 0); \
+    LDR_IO(2, 11, 73*4); \
+    CMP(10, 2); \
     LDR_IO(2, 11, 68*4); \
-    BLX(ARM_COND_PL, 2); \
+    BLX(ARM_COND_GE, 2); \
     MSR(0); \
     cycles = 0; \
 }
 
+// Same as HANDLEINT, for when no V810 flag is live at this point
+#define HANDLEINT_NOFLAGS(ret_PC) { \
+    LDW_I(1, ret_PC); \
+    ADD_I(10, 10, cycles & 0xFF, 0); \
+    LDR_IO(2, 11, 73*4); \
+    CMP(10, 2); \
+    LDR_IO(2, 11, 68*4); \
+    BLX(ARM_COND_GE, 2); \
+    cycles = 0; \
+}
+
 #endif
@@ -5,10 +5,26 @@
 #include "arm_emit.h"
 
 #define CACHE_SIZE  0x100000
+// The cache is split in regions that get evicted one at a time, oldest first
+#define DRC_NUM_REGIONS 8
+#define DRC_REGION_SIZE (CACHE_SIZE/DRC_NUM_REGIONS)
+// Code translated from RAM goes in the last region, away from the ROM code
+#define DRC_RAM_REGION  (DRC_NUM_REGIONS - 1)
 #define MAX_INST    2048
+// Upper bound of ARM instructions emitted for a single V810 instruction
+#define MAX_ARM_INST_PER_V810 48
+// Longest loop body drc_findIdleLoops looks at
+#define MAX_IDLE_LOOP_INST 8
+// PCs waiting for the background translation thread
+#define DRC_SPEC_QUEUE_SIZE 256
 #define ARM_CACHE_REG_START 4
 #define ARM_NUM_CACHE_REGS 6
 #define MAX_NUM_BLOCKS 4096
+#define MAX_NUM_LINKS 4096
+// Maximum number of linkable exits in a single block
+#define MAX_BLOCK_LINKS 32
+// Enough for 6 stores, 6 loads, the block pointer update and the branch
+#define LINK_STUB_SIZE 20
 
 enum {
     DRC_ERR_BAD_ENTRY   = 1,
@@ -16,6 +32,8 @@ enum {
     DRC_ERR_NO_DYNAREC  = 3,
     DRC_ERR_NO_BLOCKS   = 4,
     DRC_ERR_CACHE_FULL  = 5,
+    DRC_ERR_BAD_CACHE   = 6,
+    DRC_ERR_LOCKSTEP    = 7,
 };
 
 enum {
@@ -31,15 +49,31 @@ enum {
     DRC_RELOC_WWORD     = 9,
     DRC_RELOC_FPP       = 10,
     DRC_RELOC_BSTR      = 26,
+    DRC_RELOC_IDLE      = 27,
 };
 
 #define END_BLOCK 0xFF
+// Pseudo-opcode used while translating an instruction folded to a constant
+#define DRC_OP_CONST 0xFE
+
+// ARM flags as seen by the flag liveness pass
+#define DRC_FLAG_N      (1<<0)
+#define DRC_FLAG_Z      (1<<1)
+#define DRC_FLAG_C      (1<<2)
+#define DRC_FLAG_V      (1<<3)
+#define DRC_FLAGS_ALL   0xF
+
+// Results of the constant propagation pass
+#define DRC_CONST_RESULT    (1<<0) // reg2 is set to const_result
+#define DRC_CONST_ADDR      (1<<1) // The load/store address is const_addr
+#define DRC_CONST_DEAD      (1<<2) // The result is overwritten right away
+#define DRC_CONST_NO_ENTRY  (1<<3) // Relies on values set by earlier instructions
 
 #pragma pack(1)
 typedef struct {
     WORD phys_offset;
     WORD virt_loc;
-    WORD size;
+    WORD size; // 0 if the block is free
     WORD cycles;
     // Unused. TODO: Remove me!
     BYTE jmp_reg;
@@ -47,7 +81,7 @@ typedef struct {
     // have the address of v810_state
     // reg_map[0] would have the VB register that is mapped to r4
     BYTE reg_map[7];
-    WORD end_pc; // The address of the last instruction in the block
+    WORD end_pc; // The address right after the last instruction in the block
 } exec_block;
 
 typedef struct {
@@ -55,21 +89,101 @@ typedef struct {
     BYTE opcode;
     BYTE reg1, reg2;
     WORD imm;
-    HWORD start_pos;
+    WORD start_pos;
     BYTE trans_size;
     int branch_offset;
+    // The flags that are read later on before being overwritten
+    BYTE live_flags;
     bool save_flags;
+    BYTE const_info;
+    WORD const_result;
+    WORD const_addr;
+    // Backward branch of a polling loop (see drc_findIdleLoops)
+    bool idle_loop;
 } v810_instruction;
 #pragma pack()
 
-WORD* rom_block_map;
-WORD* ram_block_map;
-WORD* rom_entry_map;
-WORD* ram_entry_map;
+// V810 bytes covered by each page of the entry maps
+#define DRC_MAP_PAGE_SIZE 0x1000
+
+// A page of the entry maps. The maps only have a page directory up front, and
+// the pages get allocated as code in them is translated.
+typedef struct {
+    HWORD block[DRC_MAP_PAGE_SIZE/2]; // Index in block_ptr_start + 1, 0 if untranslated
+    HWORD entry[DRC_MAP_PAGE_SIZE/2]; // Offset of the entrypoint in the block
+} drc_map_page;
+
+// A block exit with a known target that can be patched into a direct branch
+typedef struct {
+    WORD* slot; // The "pop {pc}" that gets replaced by the branch
+    WORD target_PC;
+    exec_block* block; // The block the exit belongs to
+    exec_block* target;
+    WORD* block_ref; // Where the stub loads the address of the target block
+    bool linked;
+} drc_link;
+
+// Translation cache file, one per ROM (see drc_saveCache)
+#define DRC_CACHE_MAGIC     0x43524444 // "DDRC"
+#define DRC_CACHE_VERSION   4
+// The code starts at a page boundary so it can be mapped straight from the file
+#define DRC_CACHE_CODE_OFFSET 0x1000
+#define DRC_CACHE_NONE      0xFFFFFFFF
+
+typedef struct {
+    WORD magic;
+    WORD version;
+    char build_id[32];
+    WORD cache_size;
+    WORD crc32;
+    WORD rom_size;
+    WORD code_size; // In words
+    WORD cache_pos; // Offset from cache_start
+    WORD cur_region;
+    WORD num_blocks;
+    WORD num_entries;
+    WORD num_links;
+    WORD num_relocs;
+    WORD checksum; // FNV-1a of everything after the header
+} drc_cache_header;
+
+typedef struct {
+    WORD PC;
+    WORD entry; // Offset from cache_start
+    WORD block; // Index in block_ptr_start
+} drc_cache_entry;
+
+typedef struct {
+    WORD slot;
+    WORD target_PC;
+    WORD block;
+    WORD target; // DRC_CACHE_NONE if the exit isn't linked
+    WORD block_ref;
+} drc_cache_link;
+
+// The only absolute addresses in the translated code are the block pointers
+// loaded by the link stubs
+typedef struct {
+    WORD site; // Offset of the LDW_I_FIXED sequence from cache_start
+    WORD block;
+} drc_cache_reloc;
+
+// Filled in by drc_getStats, for the benchmark mode
+typedef struct {
+    unsigned int translated; // Blocks translated since drc_init
+    unsigned int blocks; // Blocks in the cache right now
+    unsigned int cache_used; // Bytes of translated code in the cache
+    unsigned int cache_size;
+} drc_stats;
+
+extern drc_map_page** rom_map;
+extern drc_map_page** ram_map;
 BYTE reg_usage[32];
 extern WORD* cache_start;
 extern WORD* cache_pos;
 exec_block* block_ptr_start;
+extern drc_link* link_table;
+extern int num_links;
 extern void* cache_dump_bin;
 
 int __divsi3(int a, int b);
@@ -81,22 +195,45 @@ void drc_mapRegs(exec_block *block);
 BYTE drc_getPhysReg(BYTE vb_reg, BYTE reg_map[]);
 
 void drc_scanBlockBounds(WORD *p_start_PC, WORD *p_end_PC);
+BYTE drc_getFlagsRead(v810_instruction *inst);
+BYTE drc_getFlagsWritten(v810_instruction *inst);
+int drc_findInst(v810_instruction *inst_cache, unsigned int num_inst, WORD PC);
+void drc_findLiveFlags(v810_instruction *inst_cache, unsigned int num_inst);
+void drc_propagateConstants(v810_instruction *inst_cache, unsigned int num_inst, WORD entry_PC);
+void drc_findIdleLoops(v810_instruction *inst_cache, unsigned int num_inst);
 unsigned int drc_decodeInstructions(exec_block *block, v810_instruction *inst_cache, WORD start_PC, WORD end_PC);
-int drc_translateBlock(exec_block* block);
+int drc_translateBlock(exec_block* block, WORD entry_PC);
 void drc_executeBlock(WORD* entrypoint, exec_block* block);
 int drc_handleInterrupts(WORD cpsr, WORD* PC);
+int drc_exitForEvents(WORD cpsr, WORD* PC);
 void drc_relocTable(void);
+int drc_skipIdle(int cycles);
 void drc_clearCache(void);
+void drc_freeBlock(exec_block* block);
+void drc_evictRegion(int region);
+void drc_nextRegion(void);
+void drc_invalidateRam(WORD start, WORD end);
+void drc_linkBlocks(void);
 
 WORD* drc_getEntry(WORD loc, exec_block **p_block);
 void drc_setEntry(WORD loc, WORD *entry, exec_block *block);
+void drc_freeMaps(void);
 exec_block* drc_getNextBlockStruct();
 
 void drc_init();
 void drc_exit();
 int drc_run();
-void drc_loadSavedCache();
+int drc_precompile(const WORD* roots, int num_roots);
+int drc_loadCache();
+int drc_saveCache();
+void drc_getStats(drc_stats* stats);
 void drc_dumpCache(char* filename);
 void drc_dumpDebugInfo();
 
+// Lockstep checking against the interpreter (see drc_lockstep.c)
+void drc_lockstepInit();
+void drc_lockstepExit();
+void drc_lockstepBegin();
+int drc_lockstepCheck(WORD entry_PC);
+
 #endif //DRC_CORE_H
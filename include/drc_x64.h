@@ -0,0 +1,19 @@
+/*
+ * V810 dynamic recompiler for x86-64
+ *
+ * This file is distributed under the MIT License, see drc_core.c.
+ */
+
+#ifndef DRC_X64_H
+#define DRC_X64_H
+
+#include "vb_types.h"
+
+// Where the map keeps the entrypoint for PC, NULL if PC isn't in RAM or ROM.
+// The entrypoint is NULL until something is translated there.
+BYTE** x64_getEntrySlot(WORD PC);
+// Translates the block around entry_PC and adds its entrypoints to the maps,
+// entry_PC always gets one
+int x64_translateBlock(WORD entry_PC);
+
+#endif //DRC_X64_H
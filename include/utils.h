@@ -1,6 +1,8 @@
 #ifndef _UTILS_H
 #define _UTILS_H
 
+#include <stdio.h>
+
 #include "vb_types.h"
 
 s32 k_patchSVC();
@@ -9,5 +11,17 @@ void hbHaxInit();
 void hbHaxExit();
 void FlushInvalidateCache();
 Result ReprotectMemory(u32* addr, u32 pages, u32 mode);
+int MapFileToMemory(FILE* f, u32 offset, void* addr, u32 size);
+void* StartThread(void (*entry)(void*), void* arg);
+void JoinThread(void* thread);
+void* CreateLock();
+void DestroyLock(void* lock);
+void LockMutex(void* lock);
+void UnlockMutex(void* lock);
+void SleepThread(u32 usecs);
+void* AllocLowMemory(u32 size);
+void FreeLowMemory(void* mem, u32 size);
+u64 GetTicks();
+u64 GetTicksPerSec();
 
 #endif // _UTILS_H
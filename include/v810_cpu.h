@@ -96,7 +96,20 @@ typedef struct {
     WORD cycles;
     int (*irq_handler)(WORD, WORD*);
     void(*reloc_table)(void);
+    // Used by the translated code to access VB RAM and ROM without going
+    // through mem_r*/mem_w* (see V810_MEMORYFETCH.off)
+    WORD ram_base;
+    WORD rom_base;
+    WORD rom_mask;
+    // Cycles from cycles to the next scheduled event. r10 counts the cycles run
+    // since then, and the block checks for events once it reaches this.
+    int next_event;
     BYTE ret;
+    // Set for every 256 byte page of VB RAM with translated code in it, so
+    // stores to it can drop the code (see drc_invalidateRam)
+    BYTE ram_code_pages[256];
+    // Set by HALT until an interrupt is taken (see drc_run)
+    BYTE halted;
 } cpu_state;
 #pragma pack()
 
@@ -126,7 +139,16 @@ void v810_int(WORD iNum, WORD PC);
 // Generate Exception #n
 void v810_exp(WORD iNum, WORD eCode);
 
+// Event handlers for the timer and the VIP (see vb_sched.h)
 int serviceInt(unsigned int cycles, WORD PC);
 int serviceDisplayInt(unsigned int cycles, WORD PC);
+void v810_resetTimer(unsigned int cycles);
+void v810_resetDisplay(unsigned int cycles);
+
+// Threaded interpreter (see v810_interp.c)
+void v810_interpReset();
+int v810_interpBlock();
+int v810_interpStep();
+int v810_interpRun();
 
 #endif
@@ -69,6 +69,34 @@ V810_HREGDAT   tHReg;
 
 extern int is_sram; //Flag if writes to sram...
 
+// The 27-bit address space in 4 KiB pages. Each entry of the tables is the
+// host address of the first byte of the page, or if it's below
+// MEM_NUM_HANDLERS, the handler that deals with the accesses to it (see
+// mem_initPages).
+#define MEM_PAGE_BITS   12
+#define MEM_PAGE_SIZE   (1 << MEM_PAGE_BITS)
+#define MEM_PAGE_MASK   (MEM_PAGE_SIZE - 1)
+#define MEM_NUM_PAGES   (0x08000000 >> MEM_PAGE_BITS)
+
+enum {
+    MEM_UNMAPPED,
+    MEM_ROM,        // Only when its size isn't a multiple of the page size
+    MEM_VIPCREG,
+    MEM_HCREG,
+    MEM_SOUND_RAM,  // Calls sound_update
+    MEM_CHR,        // Character tables and their mirror, invalidate all the DSP caches
+    MEM_BGMAP,      // Invalidate the cache of their BG map
+    MEM_OBJ,        // Invalidate the object cache
+    MEM_VB_RAM,     // Drop the code translated from them
+    MEM_GAME_RAM,   // Set is_sram
+    MEM_NUM_HANDLERS
+};
+
+extern uintptr_t mem_rpages[MEM_NUM_PAGES];
+extern uintptr_t mem_wpages[MEM_NUM_PAGES];
+
+void mem_initPages();
+
 // Memory read functions
 BYTE  mem_rbyte(WORD addr);
 HWORD mem_rhword(WORD addr);
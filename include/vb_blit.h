@@ -0,0 +1,160 @@
+////////////////////////////////////////////////////////////////
+// Inner loops of the character decoding and the transparent blits, with an
+// SSE2 version and a plain C one for everything else. A character row is a
+// HWORD of 8 2-bit pixels, leftmost pixel in the low bits. A pixel is
+// transparent when its palette value is 0.
+
+#ifndef VB_BLIT_H_
+#define VB_BLIT_H_
+
+#include <string.h>
+
+#include "vb_types.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// The palette and horizontal flip of a character, set up once for its rows
+typedef struct {
+#if defined(__SSE2__)
+    __m128i mul;        // Brings the pixel of each lane up to bits 14-15
+    __m128i pal[4];
+#else
+    HWORD lut[16];      // Two pixels for each 4 bits of a row
+    bool hflp;
+#endif
+} blit_chr;
+
+static inline void blit_prepareChr(blit_chr* chr, const BYTE pal[4], bool hflp) {
+#if defined(__SSE2__)
+    int i;
+
+    if (hflp)
+        chr->mul = _mm_setr_epi16(1<<0, 1<<2, 1<<4, 1<<6, 1<<8, 1<<10, 1<<12, 1<<14);
+    else
+        chr->mul = _mm_setr_epi16(1<<14, 1<<12, 1<<10, 1<<8, 1<<6, 1<<4, 1<<2, 1<<0);
+    for (i = 0; i < 4; i++)
+        chr->pal[i] = _mm_set1_epi16(pal[i]);
+#else
+    int i;
+
+    // Bytes in memory order, the builds are all little endian
+    if (hflp) {
+        for (i = 0; i < 16; i++)
+            chr->lut[i] = pal[i >> 2] | (pal[i & 3] << 8);
+    } else {
+        for (i = 0; i < 16; i++)
+            chr->lut[i] = pal[i & 3] | (pal[i >> 2] << 8);
+    }
+    chr->hflp = hflp;
+#endif
+}
+
+#if defined(__SSE2__)
+
+// The 8 pixels in the low half
+static inline __m128i blit_decodeRow(const blit_chr* chr, HWORD row) {
+    __m128i idx = _mm_srli_epi16(_mm_mullo_epi16(_mm_set1_epi16(row), chr->mul), 14);
+    __m128i pix;
+
+    pix = _mm_and_si128(_mm_cmpeq_epi16(idx, _mm_setzero_si128()), chr->pal[0]);
+    pix = _mm_or_si128(pix, _mm_and_si128(_mm_cmpeq_epi16(idx, _mm_set1_epi16(1)), chr->pal[1]));
+    pix = _mm_or_si128(pix, _mm_and_si128(_mm_cmpeq_epi16(idx, _mm_set1_epi16(2)), chr->pal[2]));
+    pix = _mm_or_si128(pix, _mm_and_si128(_mm_cmpeq_epi16(idx, _mm_set1_epi16(3)), chr->pal[3]));
+    return _mm_packus_epi16(pix, pix);
+}
+
+#else
+
+static inline void blit_decodeRow(const blit_chr* chr, HWORD row, WORD pix[2]) {
+    if (chr->hflp) {
+        pix[0] = chr->lut[row >> 12] | ((WORD)chr->lut[(row >> 8) & 15] << 16);
+        pix[1] = chr->lut[(row >> 4) & 15] | ((WORD)chr->lut[row & 15] << 16);
+    } else {
+        pix[0] = chr->lut[row & 15] | ((WORD)chr->lut[(row >> 4) & 15] << 16);
+        pix[1] = chr->lut[(row >> 8) & 15] | ((WORD)chr->lut[row >> 12] << 16);
+    }
+}
+
+// 0xFF in the bytes of pix that aren't 0
+static inline WORD blit_opaqueMask(WORD pix) {
+    WORD t = ((pix & 0x7F7F7F7F) + 0x7F7F7F7F) | pix;
+
+    return ((t & 0x80808080) >> 7) * 0xFF;
+}
+
+#endif
+
+// Decodes a row into the 8 bytes at dst
+static inline void blit_chrRow(const blit_chr* chr, HWORD row, BYTE* dst) {
+#if defined(__SSE2__)
+    _mm_storel_epi64((__m128i*)dst, blit_decodeRow(chr, row));
+#else
+    WORD pix[2];
+
+    blit_decodeRow(chr, row, pix);
+    memcpy(dst, pix, 8);
+#endif
+}
+
+// Same, leaving the bytes under transparent pixels alone
+static inline void blit_chrRowMasked(const blit_chr* chr, HWORD row, BYTE* dst) {
+#if defined(__SSE2__)
+    __m128i pix = blit_decodeRow(chr, row);
+    __m128i clear = _mm_cmpeq_epi8(pix, _mm_setzero_si128());
+    __m128i old = _mm_loadl_epi64((const __m128i*)dst);
+
+    _mm_storel_epi64((__m128i*)dst, _mm_or_si128(_mm_and_si128(clear, old), _mm_andnot_si128(clear, pix)));
+#else
+    WORD pix[2], old[2], mask;
+    int i;
+
+    blit_decodeRow(chr, row, pix);
+    memcpy(old, dst, 8);
+    for (i = 0; i < 2; i++) {
+        mask = blit_opaqueMask(pix[i]);
+        old[i] = (old[i] & ~mask) | pix[i];
+    }
+    memcpy(dst, old, 8);
+#endif
+}
+
+// Copies len pixels from src to dst, except the transparent ones
+static inline void blit_maskedSpan(BYTE* dst, const BYTE* src, int len) {
+    int i = 0;
+#if defined(__SSE2__)
+    __m128i pix, clear;
+
+    for (; i + 16 <= len; i += 16) {
+        pix = _mm_loadu_si128((const __m128i*)(src + i));
+        clear = _mm_cmpeq_epi8(pix, _mm_setzero_si128());
+        // All transparent is common enough to skip the store
+        if (_mm_movemask_epi8(clear) == 0xFFFF)
+            continue;
+        pix = _mm_or_si128(_mm_and_si128(clear, _mm_loadu_si128((const __m128i*)(dst + i))),
+                           _mm_andnot_si128(clear, pix));
+        _mm_storeu_si128((__m128i*)(dst + i), pix);
+    }
+#else
+    WORD pix, old, mask;
+
+    for (; i + 4 <= len; i += 4) {
+        memcpy(&pix, src + i, 4);
+        if (!pix)
+            continue;
+        mask = blit_opaqueMask(pix);
+        if (mask != 0xFFFFFFFF) {
+            memcpy(&old, dst + i, 4);
+            pix |= old & ~mask;
+        }
+        memcpy(dst + i, &pix, 4);
+    }
+#endif
+    for (; i < len; i++) {
+        if (src[i])
+            dst[i] = src[i];
+    }
+}
+
+#endif
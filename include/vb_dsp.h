@@ -94,12 +94,13 @@ typedef struct {
     HWORD	Dont_Write[5]; // Unused 5 HWORDS of data
 } VB_WORLD;
 
+// One line of an affine world
 typedef struct {
-	float pb_y;
+	int pb_y;       // BG map x at the left edge, 13.3 fixed point
 	int paralax;
-	float pd_y;
-	float pa;
-	float pc;
+	int pd_y;       // BG map y at the left edge, 13.3 fixed point
+	int pa;         // x step per pixel, 7.9 fixed point
+	int pc;         // y step per pixel, 7.9 fixed point
 	int u1;
 	int u2;
 	int u3;
@@ -126,6 +127,10 @@ typedef struct {
     BITMAP  *ObjCacheBMP[4];        // Obj Cache Bitmaps
     bool    BGCacheInvalid[14];     // Object Cache Is invalid
     BITMAP  *BGCacheBMP[14];        // BGMap Cache Bitmaps
+    bool    CharDirty;              // Some Chr changed since the BG Maps were updated
+    WORD    CharDirtyBits[2048/32]; // Chrs that changed, one bit each
+    bool    BGCellDirty[14];        // Some cell of the BGMap changed
+    WORD    BGCellDirtyBits[14][(BGMAP_SIZE>>1)/32]; // BGMap cells to repaint, one bit each
 	bool		CharCacheInvalid;
 	BITMAP	*CharacterCache;		//Character chace
     bool    DDSPDataWrite;          // Direct DisplayDraws True
@@ -158,6 +163,14 @@ void getBGmap(HWORD num, VB_BGMAP BGMap_Buff[]);
 // Converts a BG Map Buffer to a World Picture, With Chrs in place.
 void BGMap2World(HWORD num, BITMAP *wPlane);
 
+// Repaints only the cells of a cached BG Map that changed since it was drawn
+void updateBGMap(HWORD num, BITMAP *wPlane);
+
+// Called on writes to the Chr tables and the BG Maps, so updateBGMap knows
+// what to repaint
+void invalidateChr(HWORD num);
+void invalidateBGCell(WORD addr);
+
 ////////////////////////////////////////////////////////////////////
 // Returns a OBJ_buf Buffer VB_OBJ OBJ_Buff[1024]
 void getObj(HWORD num, VB_OBJ OBJ_Buff[]);
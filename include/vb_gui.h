@@ -37,7 +37,6 @@ void save_sram(void);
 int file_loadrom(void);
 int file_closerom(void);
 int file_exit(void);
-int options_maxcycles(void);
 int options_frameskip(void);
 int options_debug(void);
 int options_sound(void);
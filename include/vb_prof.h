@@ -0,0 +1,66 @@
+////////////////////////////////////////////////////////////////
+// Per-frame timing probes, only built with -DVB_PROFILE. Without it the
+// PROF_START/PROF_STOP macros are empty and nothing else is defined.
+
+#ifndef VB_PROF_H_
+#define VB_PROF_H_
+
+#include "vb_types.h"
+
+// What gets timed. The probes can nest, so each one includes whatever runs
+// inside it (execution includes the sound_update calls of its I/O writes, and
+// the sched_run calls of translated code).
+enum {
+    PROF_TRANSLATE,  // drc_translateBlock
+    PROF_EXECUTE,    // Translated code and the interpreter
+    PROF_INTERRUPTS, // sched_run, interrupts included
+    PROF_WORLD,      // World2Display
+    PROF_DSP2WORLD,  // DSP2World
+    PROF_BLIT,       // screen_blit
+    PROF_SOUND,      // sound_update
+    PROF_FRAME,      // Everything between two prof_endFrame calls
+    PROF_NUM_PROBES
+};
+
+#ifdef VB_PROFILE
+
+#include "utils.h"
+
+// Frame times in microseconds go in power of two buckets: bucket 0 counts
+// frames under 1us, bucket n the ones in [2^(n-1), 2^n) and the last one
+// everything longer
+#define PROF_NUM_BUCKETS 24
+
+typedef struct {
+    unsigned int frames;
+    u64 total_us;
+    unsigned int min_us;
+    unsigned int max_us;
+    unsigned int last_us;
+    unsigned int buckets[PROF_NUM_BUCKETS];
+} prof_stats;
+
+extern u64 prof_start_ticks[PROF_NUM_PROBES];
+extern u64 prof_frame_ticks[PROF_NUM_PROBES];
+
+#define PROF_START(probe) (prof_start_ticks[probe] = GetTicks())
+#define PROF_STOP(probe) (prof_frame_ticks[probe] += GetTicks() - prof_start_ticks[probe])
+
+// csv_filename gets a line per frame with the time of every probe, NULL for
+// none
+void prof_init(const char* csv_filename);
+void prof_exit();
+void prof_reset();
+// Adds the times of the frame to the histograms, and to the CSV file
+void prof_endFrame();
+const prof_stats* prof_getStats(int probe);
+const char* prof_getName(int probe);
+
+#else
+
+#define PROF_START(probe) do {} while (0)
+#define PROF_STOP(probe) do {} while (0)
+
+#endif
+
+#endif
@@ -0,0 +1,30 @@
+////////////////////////////////////////////////////////////////
+// Event scheduler, keeps everything that has to happen at a given V810 cycle
+
+#ifndef VB_SCHED_H_
+#define VB_SCHED_H_
+
+#include "vb_types.h"
+
+// Each event can be pending only once
+enum {
+    SCHED_VIP,      // Next step of the VIP row/frame state machine
+    SCHED_TIMER,    // Next tick of the hardware timer
+    SCHED_NUM_EVENTS
+};
+
+// Called with the cycle the event was due at and the PC to return to. Returns
+// nonzero if the CPU has to leave the current block.
+typedef int (*sched_handler)(unsigned int cycles, WORD PC);
+
+// Drops all pending events
+void sched_init();
+// Sets the absolute cycle the event is due at, moving it if already pending
+void sched_schedule(int event, WORD cycles);
+void sched_cancel(int event);
+bool sched_pending(int event);
+// Runs every event due at the given cycle in order. Returns nonzero if any of
+// them asked to leave the block.
+int sched_run(WORD cycles, WORD PC);
+
+#endif
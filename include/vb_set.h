@@ -36,7 +36,6 @@ enum VB_KCFG {
 
 // Global Options list
 typedef struct VB_OPT {
-    int   MAXCYCLES; // Number of cycles before checking for interrupts
     int   FRMSKIP;  // Frame Skip of course
     int   DSPMODE;  // Normal, 3D, etc
     int   DSPSWAP;  // Swap 3D effect, 0 normal, 1 swap
@@ -52,6 +51,10 @@ typedef struct VB_OPT {
     int   SCR_MODE; // 0-VGA, 1-VESA1, 2-VESA2
     int   SOUND;
     int   DYNAREC;
+    int   DRCTHREAD; // Translate likely targets on a second thread
+    int   INTERP;   // Run everything on the interpreter instead of the dynarec
+    int   LOCKSTEP; // Check every translated block against the interpreter
+    int   FASTMEM;  // Map the V810 memory into the host's for the x86-64 dynarec
     char *ROM_NAME; // Path\Name of game to open
     char *PROG_NAME; // Path\Name of program
     unsigned long CRC32; // CRC32 of ROM
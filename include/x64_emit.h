@@ -0,0 +1,322 @@
+/*
+ * V810 dynamic recompiler for x86-64
+ *
+ * This file is distributed under the MIT License, see drc_core.c.
+ */
+
+#ifndef X64_EMIT_H
+#define X64_EMIT_H
+
+#include <string.h>
+
+#include "vb_types.h"
+
+// The translated code keeps rbx pointing at v810_state and counts the cycles
+// run in r13d, like r11 and r10 in the ARM code. r14 holds x64_fastmem_base.
+// eax, ecx, edx, esi and edi are scratch, with edi and esi used to pass
+// arguments to the C helpers.
+enum {
+    X64_EAX = 0,
+    X64_ECX = 1,
+    X64_EDX = 2,
+    X64_EBX = 3,
+    X64_ESP = 4,
+    X64_EBP = 5,
+    X64_ESI = 6,
+    X64_EDI = 7,
+    X64_R13 = 13,
+    X64_R14 = 14,
+};
+
+// Condition codes, the opposite condition is cc^1
+enum {
+    X64_CC_O    = 0x0,
+    X64_CC_NO   = 0x1,
+    X64_CC_B    = 0x2, // Carry set
+    X64_CC_AE   = 0x3, // Carry clear
+    X64_CC_E    = 0x4,
+    X64_CC_NE   = 0x5,
+    X64_CC_L    = 0xC,
+    X64_CC_GE   = 0xD,
+};
+
+// ALU operations, the /digit of the immediate forms
+enum {
+    X64_ADD = 0,
+    X64_OR  = 1,
+    X64_AND = 4,
+    X64_SUB = 5,
+    X64_XOR = 6,
+    X64_CMP = 7,
+};
+
+// Shifts, also a /digit
+enum {
+    X64_SHL = 4,
+    X64_SHR = 5,
+    X64_SAR = 7,
+};
+
+#define X64_MOVZX8  0xB6
+#define X64_MOVZX16 0xB7
+#define X64_MOVSX8  0xBE
+#define X64_MOVSX16 0xBF
+
+extern BYTE* x64_ptr;
+
+static inline void x64_byte(BYTE b) {
+    *x64_ptr++ = b;
+}
+
+static inline void x64_word(WORD w) {
+    memcpy(x64_ptr, &w, 4);
+    x64_ptr += 4;
+}
+
+// REX prefix, only when r8-r15 or a 64-bit operand are involved
+static inline void x64_rex(BYTE w, BYTE reg, BYTE rm) {
+    if (w || reg >= 8 || rm >= 8)
+        x64_byte(0x40 | (w << 3) | ((reg >> 3) << 2) | (rm >> 3));
+}
+
+static inline void x64_modrmReg(BYTE reg, BYTE rm) {
+    x64_byte(0xC0 | ((reg & 7) << 3) | (rm & 7));
+}
+
+// ModRM and displacement for [rbx + disp]
+static inline void x64_modrmState(BYTE reg, int disp) {
+    x64_byte(0x80 | ((reg & 7) << 3) | X64_EBX);
+    x64_word(disp);
+}
+
+static inline void x64_opState(BYTE opcode, BYTE reg, int disp) {
+    x64_rex(0, reg, 0);
+    x64_byte(opcode);
+    x64_modrmState(reg, disp);
+}
+
+// mov reg, [rbx + disp]
+static inline void x64_load(BYTE reg, int disp) {
+    x64_opState(0x8B, reg, disp);
+}
+
+// mov [rbx + disp], reg
+static inline void x64_store(int disp, BYTE reg) {
+    x64_opState(0x89, reg, disp);
+}
+
+// op reg, [rbx + disp]
+static inline void x64_aluLoad(BYTE op, BYTE reg, int disp) {
+    x64_opState((op << 3) | 0x03, reg, disp);
+}
+
+// op [rbx + disp], reg
+static inline void x64_aluStore(BYTE op, int disp, BYTE reg) {
+    x64_opState((op << 3) | 0x01, reg, disp);
+}
+
+// op dword [rbx + disp], imm32
+static inline void x64_aluStateImm(BYTE op, int disp, WORD imm) {
+    x64_byte(0x81);
+    x64_modrmState(op, disp);
+    x64_word(imm);
+}
+
+// mov dword [rbx + disp], imm32
+static inline void x64_storeImm(int disp, WORD imm) {
+    x64_byte(0xC7);
+    x64_modrmState(0, disp);
+    x64_word(imm);
+}
+
+// mov byte [rbx + disp], imm8
+static inline void x64_storeImm8(int disp, BYTE imm) {
+    x64_byte(0xC6);
+    x64_modrmState(0, disp);
+    x64_byte(imm);
+}
+
+// op dst, src
+static inline void x64_alu(BYTE op, BYTE dst, BYTE src) {
+    x64_rex(0, src, dst);
+    x64_byte((op << 3) | 0x01);
+    x64_modrmReg(src, dst);
+}
+
+// op reg, imm32
+static inline void x64_aluImm(BYTE op, BYTE reg, WORD imm) {
+    x64_rex(0, 0, reg);
+    x64_byte(0x81);
+    x64_modrmReg(op, reg);
+    x64_word(imm);
+}
+
+// mov dst, src
+static inline void x64_mov(BYTE dst, BYTE src) {
+    x64_rex(0, src, dst);
+    x64_byte(0x89);
+    x64_modrmReg(src, dst);
+}
+
+// mov reg, imm32
+static inline void x64_movImm(BYTE reg, WORD imm) {
+    x64_rex(0, 0, reg);
+    x64_byte(0xB8 | (reg & 7));
+    x64_word(imm);
+}
+
+// test a, b
+static inline void x64_test(BYTE a, BYTE b) {
+    x64_rex(0, b, a);
+    x64_byte(0x85);
+    x64_modrmReg(b, a);
+}
+
+// test reg, imm32
+static inline void x64_testImm(BYTE reg, WORD imm) {
+    x64_rex(0, 0, reg);
+    x64_byte(0xF7);
+    x64_modrmReg(0, reg);
+    x64_word(imm);
+}
+
+static inline void x64_not(BYTE reg) {
+    x64_rex(0, 0, reg);
+    x64_byte(0xF7);
+    x64_modrmReg(2, reg);
+}
+
+// Shift by cl
+static inline void x64_shiftCl(BYTE op, BYTE reg) {
+    x64_rex(0, 0, reg);
+    x64_byte(0xD3);
+    x64_modrmReg(op, reg);
+}
+
+static inline void x64_shiftImm(BYTE op, BYTE reg, BYTE imm) {
+    x64_rex(0, 0, reg);
+    x64_byte(0xC1);
+    x64_modrmReg(op, reg);
+    x64_byte(imm);
+}
+
+// movzx/movsx dst, the low byte or halfword of src. Byte sources have to be
+// one of eax, ecx, edx or ebx.
+static inline void x64_movx(BYTE op, BYTE dst, BYTE src) {
+    x64_rex(0, dst, src);
+    x64_byte(0x0F);
+    x64_byte(op);
+    x64_modrmReg(dst, src);
+}
+
+// movzx dst, ah
+static inline void x64_movzxAh(BYTE dst) {
+    x64_byte(0x0F);
+    x64_byte(X64_MOVZX8);
+    x64_modrmReg(dst, 4);
+}
+
+// Loads SF, ZF and CF into bits 7, 6 and 0 of ah
+static inline void x64_lahf() {
+    x64_byte(0x9F);
+}
+
+// setcc on the low byte of eax, ecx, edx or ebx
+static inline void x64_setcc(BYTE cc, BYTE reg) {
+    x64_byte(0x0F);
+    x64_byte(0x90 | cc);
+    x64_modrmReg(0, reg);
+}
+
+// bt reg, bit
+static inline void x64_bt(BYTE reg, BYTE bit) {
+    x64_rex(0, 0, reg);
+    x64_byte(0x0F);
+    x64_byte(0xBA);
+    x64_modrmReg(4, reg);
+    x64_byte(bit);
+}
+
+// ModRM and SIB for [r14 + rdi], the address of the fastmem accesses
+static inline void x64_modrmFast(BYTE reg) {
+    x64_byte(((reg & 7) << 3) | 0x04);
+    x64_byte((X64_EDI << 3) | (X64_R14 & 7));
+}
+
+// movzx/movsx reg, [r14 + rdi], or mov when op is 0. These and x64_storeFast
+// are the only forms the fault handler in x64_fastmem.c can decode, so reg
+// has to be eax.
+static inline void x64_loadFast(BYTE op, BYTE reg) {
+    x64_byte(0x41);
+    if (op) {
+        x64_byte(0x0F);
+        x64_byte(op);
+    } else {
+        x64_byte(0x8B);
+    }
+    x64_modrmFast(reg);
+}
+
+// mov [r14 + rdi], the low size bytes of reg, which has to be esi. The REX
+// prefix makes the byte register sil.
+static inline void x64_storeFast(BYTE size, BYTE reg) {
+    if (size == 2)
+        x64_byte(0x66);
+    x64_byte(0x41);
+    x64_byte((size == 1) ? 0x88 : 0x89);
+    x64_modrmFast(reg);
+}
+
+// Points the rel32 at disp to target
+static inline void x64_patch(BYTE* disp, BYTE* target) {
+    int rel = (int)(target - (disp + 4));
+    memcpy(disp, &rel, 4);
+}
+
+// jcc rel32. Returns where the displacement is, for branches that get patched
+// later on.
+static inline BYTE* x64_jcc(BYTE cc, BYTE* target) {
+    BYTE* disp;
+
+    x64_byte(0x0F);
+    x64_byte(0x80 | cc);
+    disp = x64_ptr;
+    x64_word(0);
+    if (target)
+        x64_patch(disp, target);
+    return disp;
+}
+
+// jmp rel32
+static inline BYTE* x64_jmp(BYTE* target) {
+    BYTE* disp;
+
+    x64_byte(0xE9);
+    disp = x64_ptr;
+    x64_word(0);
+    if (target)
+        x64_patch(disp, target);
+    return disp;
+}
+
+// Calls a C function through rax, so it doesn't have to be within 2GB
+static inline void x64_call(void* func) {
+    x64_byte(0x48);
+    x64_byte(0xB8);
+    memcpy(x64_ptr, &func, 8);
+    x64_ptr += 8;
+    x64_byte(0xFF);
+    x64_byte(0xD0);
+}
+
+static inline void x64_push(BYTE reg) {
+    x64_rex(0, 0, reg);
+    x64_byte(0x50 | (reg & 7));
+}
+
+static inline void x64_pop(BYTE reg) {
+    x64_rex(0, 0, reg);
+    x64_byte(0x58 | (reg & 7));
+}
+
+#endif //X64_EMIT_H
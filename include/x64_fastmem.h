@@ -0,0 +1,27 @@
+/*
+ * V810 dynamic recompiler for x86-64
+ *
+ * This file is distributed under the MIT License, see drc_core.c.
+ */
+
+#ifndef X64_FASTMEM_H
+#define X64_FASTMEM_H
+
+#include "vb_types.h"
+
+// Size of the host view of the V810 address space
+#define X64_FASTMEM_SIZE 0x08000000
+
+// The view, NULL when fastmem is off. The translated code keeps it in r14.
+extern BYTE* x64_fastmem_base;
+
+// Sets up the view when tVBOpt.FASTMEM is on, after v810_init
+void x64_fastmemInit(BYTE* code_start, BYTE* code_end);
+void x64_fastmemExit();
+// Makes stores to the VB RAM in [start, end) fault, so they drop the code
+// translated from it
+void x64_fastmemProtectCode(WORD start, WORD end);
+// After all the code in VB RAM is dropped
+void x64_fastmemUnprotectCode();
+
+#endif //X64_FASTMEM_H
@@ -1,3 +1,4 @@
+#include <stdlib.h>
 #include <3ds.h>
 #include "utils.h"
 #include "vb_set.h"
@@ -57,3 +58,66 @@ Result ReprotectMemory(u32* addr, u32 pages, u32 mode) {
     svcDuplicateHandle(&processHandle, 0xFFFF8001);
     return svcControlProcessMemory(processHandle, (u32)addr, 0x0, pages*0x1000, MEMOP_PROT, mode);
 }
+
+// There's no mmap, so just read it into place
+int MapFileToMemory(FILE* f, u32 offset, void* addr, u32 size) {
+    if (fseek(f, offset, SEEK_SET))
+        return -1;
+    return (fread(addr, 1, size, f) == size) ? 0 : -1;
+}
+
+// Runs just below the main thread, preferably on the other core
+void* StartThread(void (*entry)(void*), void* arg) {
+    s32 prio = 0x30;
+    Thread thread;
+
+    svcGetThreadPriority(&prio, CUR_THREAD_HANDLE);
+    thread = threadCreate(entry, arg, 0x8000, prio + 1, 1, false);
+    if (!thread)
+        thread = threadCreate(entry, arg, 0x8000, prio + 1, -2, false);
+    return thread;
+}
+
+void JoinThread(void* thread) {
+    threadJoin(thread, U64_MAX);
+    threadFree(thread);
+}
+
+void* CreateLock() {
+    LightLock* lock = malloc(sizeof(LightLock));
+    if (lock)
+        LightLock_Init(lock);
+    return lock;
+}
+
+void DestroyLock(void* lock) {
+    free(lock);
+}
+
+void LockMutex(void* lock) {
+    LightLock_Lock(lock);
+}
+
+void UnlockMutex(void* lock) {
+    LightLock_Unlock(lock);
+}
+
+void SleepThread(u32 usecs) {
+    svcSleepThread((s64)usecs*1000);
+}
+
+void* AllocLowMemory(u32 size) {
+    return calloc(1, size);
+}
+
+void FreeLowMemory(void* mem, u32 size) {
+    free(mem);
+}
+
+u64 GetTicks() {
+    return svcGetSystemTick();
+}
+
+u64 GetTicksPerSec() {
+    return SYSCLOCK_ARM11;
+}
@@ -12,6 +12,7 @@
 #include "vb_sound.h"
 #include "vb_gui.h"
 #include "rom_db.h"
+#include "vb_prof.h"
 
 int main() {
     int qwe;
@@ -69,6 +70,9 @@ int main() {
 
     v810_reset();
     drc_init();
+#ifdef VB_PROFILE
+    prof_init(NULL);
+#endif
 
     clearCache();
     consoleClear();
@@ -92,7 +96,7 @@ int main() {
 #if DEBUGLEVEL == 0
             consoleSelect(&debug_console);
 #endif
-            err = drc_run();
+            err = tVBOpt.INTERP ? v810_interpRun() : drc_run();
             if (err) {
                 dprintf(0, "[DRC]: error #%d @ PC=0x%08X\n", err, v810_state->PC);
                 printf("\nDumping debug info...\n");
@@ -118,9 +122,19 @@ int main() {
             V810_Dsp_Frame(Left); //Temporary...
         }
 
+#ifdef VB_PROFILE
+        prof_endFrame();
+#endif
 #if DEBUGLEVEL == 0
         consoleSelect(&main_console);
         printf("\x1b[1J\x1b[0;0HFPS: %.2f\nFrame: %i\nPC: 0x%x\nDRC cache: %.2f%%", (tVBOpt.FRMSKIP+1)*(1000./(osGetTime() - startTime)), frame, v810_state->PC, (cache_pos-cache_start)*4*100./CACHE_SIZE);
+#ifdef VB_PROFILE
+        // Last frame, in ms
+        printf("\nCPU: %.1f DRC: %.1f IRQ: %.1f\nWorlds: %.1f Direct: %.1f Blit: %.1f",
+               prof_getStats(PROF_EXECUTE)->last_us/1000., prof_getStats(PROF_TRANSLATE)->last_us/1000.,
+               prof_getStats(PROF_INTERRUPTS)->last_us/1000., prof_getStats(PROF_WORLD)->last_us/1000.,
+               prof_getStats(PROF_DSP2WORLD)->last_us/1000., prof_getStats(PROF_BLIT)->last_us/1000.);
+#endif
 #else
         printf("\x1b[1J\x1b[0;0HFrame: %i\nPC: 0x%x", frame, (unsigned int) v810_state->PC);
 #endif
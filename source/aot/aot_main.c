@@ -0,0 +1,67 @@
+////////////////////////////////////////////////////////////////
+// r3Ddragon-aot: translates a whole ROM ahead of time and writes the
+// <CRC32>.drc cache file the emulator loads at startup
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "main.h"
+#include "v810_mem.h"
+#include "drc_core.h"
+#include "vb_set.h"
+
+// Read by vb_dsp.c, there's no input here
+int arm_keys;
+
+// Reset, interrupt and exception vectors
+static const WORD aot_roots[] = {
+    0xFFFFFFF0, // Reset
+    0xFFFFFE00, // Game pad
+    0xFFFFFE10, // Timer
+    0xFFFFFE20, // Game pak
+    0xFFFFFE30, // Communication
+    0xFFFFFE40, // VIP
+    0xFFFFFF60, // Floating-point exception
+    0xFFFFFF80, // Division by zero
+    0xFFFFFF90, // Invalid opcode
+    0xFFFFFFA0, // TRAP 0x00-0x0F
+    0xFFFFFFB0, // TRAP 0x10-0x1F
+    0xFFFFFFC0, // Address trap
+    0xFFFFFFD0, // Duplexed exception
+};
+
+int main(int argc, char* argv[]) {
+    int num_blocks;
+
+    if (argc < 2) {
+        printf("Usage: r3Ddragon-aot [ROM file]\n");
+        return 1;
+    }
+
+    setDefaults();
+    tVBOpt.DYNAREC = 1;
+    tVBOpt.DRCTHREAD = 0;
+    tVBOpt.ROM_NAME = argv[1];
+
+    if (!v810_init(argv[1])) {
+        printf("Couldn't open %s\n", argv[1]);
+        return 1;
+    }
+    v810_reset();
+    // Whatever was cached from earlier runs is kept and added to
+    drc_init();
+
+    num_blocks = drc_precompile(aot_roots, sizeof(aot_roots)/sizeof(aot_roots[0]));
+    if (num_blocks < 0) {
+        printf("r3Ddragon-aot needs the ARM dynarec, the cache files hold ARM code\n");
+        drc_exit();
+        v810_exit();
+        return 1;
+    }
+    printf("Translated %d blocks, writing %08lX.drc\n", num_blocks, tVBOpt.CRC32);
+
+    drc_exit();
+    v810_exit();
+    return 0;
+}
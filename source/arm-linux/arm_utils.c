@@ -1,4 +1,8 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
 #include <sys/mman.h>
 
 #include "utils.h"
@@ -22,3 +26,95 @@ Result ReprotectMemory(u32* addr, u32 pages, u32 mode) {
     dprintf(0, "[DRC]: mprotect returned %d\n", ret);
     return ret;
 }
+
+// Maps part of a file at addr as private (copy-on-write) executable memory
+int MapFileToMemory(FILE* f, u32 offset, void* addr, u32 size) {
+    void* ret = mmap(addr, size, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_FIXED, fileno(f), offset);
+    dprintf(0, "[DRC]: mmap returned %p\n", ret);
+    return (ret == addr) ? 0 : -1;
+}
+
+typedef struct {
+    pthread_t thread;
+    void (*entry)(void*);
+    void* arg;
+} linux_thread;
+
+static void* ThreadTrampoline(void* p) {
+    linux_thread* t = p;
+    t->entry(t->arg);
+    return NULL;
+}
+
+void* StartThread(void (*entry)(void*), void* arg) {
+    linux_thread* t = malloc(sizeof(linux_thread));
+    if (!t)
+        return NULL;
+    t->entry = entry;
+    t->arg = arg;
+    if (pthread_create(&t->thread, NULL, ThreadTrampoline, t)) {
+        free(t);
+        return NULL;
+    }
+    return t;
+}
+
+void JoinThread(void* thread) {
+    linux_thread* t = thread;
+    pthread_join(t->thread, NULL);
+    free(t);
+}
+
+void* CreateLock() {
+    pthread_mutex_t* lock = malloc(sizeof(pthread_mutex_t));
+    if (lock)
+        pthread_mutex_init(lock, NULL);
+    return lock;
+}
+
+void DestroyLock(void* lock) {
+    pthread_mutex_destroy(lock);
+    free(lock);
+}
+
+void LockMutex(void* lock) {
+    pthread_mutex_lock(lock);
+}
+
+void UnlockMutex(void* lock) {
+    pthread_mutex_unlock(lock);
+}
+
+void SleepThread(u32 usecs) {
+    usleep(usecs);
+}
+
+// The V810 memory offsets are 32-bit (see V810_MEMORYFETCH.off), so on 64-bit
+// hosts the emulated memory has to be in the low 4GB
+void* AllocLowMemory(u32 size) {
+#ifdef __x86_64__
+    void* mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_32BIT, -1, 0);
+    return (mem == MAP_FAILED) ? NULL : mem;
+#else
+    return calloc(1, size);
+#endif
+}
+
+void FreeLowMemory(void* mem, u32 size) {
+#ifdef __x86_64__
+    munmap(mem, size);
+#else
+    free(mem);
+#endif
+}
+
+u64 GetTicks() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u64)ts.tv_sec*1000000000 + ts.tv_nsec;
+}
+
+u64 GetTicksPerSec() {
+    return 1000000000;
+}
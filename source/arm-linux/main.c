@@ -2,6 +2,9 @@
 #include <stdio.h>
 #include <string.h>
 #include <signal.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
 
 #include "main.h"
 #include "v810_mem.h"
@@ -10,6 +13,7 @@
 #include "vb_set.h"
 #include "vb_gui.h"
 #include "rom_db.h"
+#include "vb_prof.h"
 
 int arm_keys;
 void sigint_handler(int sig) {
@@ -24,34 +28,189 @@ void sigint_handler(int sig) {
     arm_keys = 0xffffffff;
 }
 
+// Headless benchmark mode, see bench_report
+static int bench_frames = 0;
+static int bench_warmup = 0;
+// Keys held from a given frame on, read from the -i file
+static struct {
+    int frame;
+    int keys;
+} *bench_input = NULL;
+static int bench_num_input = 0;
+static int bench_pos = 0;
+// Nanoseconds spent per measured frame
+static uint64_t* bench_cpu_time;
+static uint64_t* bench_dsp_time;
+
+static uint64_t bench_now() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec*1000000000 + ts.tv_nsec;
+}
+
+// Reads "<frame> <keys>" lines, keys being the VB_KEY_* bits in hex. The keys
+// stay held until the next line.
+static int bench_loadInput(const char* filename) {
+    FILE* f = fopen(filename, "r");
+    int frame, keys;
+
+    if (!f)
+        return 1;
+    while (fscanf(f, "%d %x", &frame, &keys) == 2) {
+        bench_input = realloc(bench_input, (bench_num_input + 1)*sizeof(*bench_input));
+        bench_input[bench_num_input].frame = frame;
+        bench_input[bench_num_input].keys = keys;
+        bench_num_input++;
+    }
+    fclose(f);
+    return 0;
+}
+
+// Presses the scripted keys for the frame, the game reads them at most once
+static void bench_setKeys(int frame) {
+    while (bench_pos < bench_num_input && bench_input[bench_pos].frame <= frame)
+        bench_pos++;
+    arm_keys = bench_pos ? bench_input[bench_pos - 1].keys : 0;
+}
+
+// Where the times of a frame go, -1 if it isn't measured
+static int bench_index(int frame) {
+    frame -= bench_warmup;
+    return (frame >= 0 && frame < bench_frames) ? frame : -1;
+}
+
+static int bench_compare(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a;
+    uint64_t y = *(const uint64_t*)b;
+
+    return (x > y) - (x < y);
+}
+
+// Prints the min, median, 90th and 99th percentile and max of times in
+// microseconds. Sorts times.
+static void bench_percentiles(const char* name, uint64_t* times, int count) {
+    qsort(times, count, sizeof(uint64_t), bench_compare);
+    printf("%s_us_min=%.1f\n", name, times[0]/1000.0);
+    printf("%s_us_p50=%.1f\n", name, times[count/2]/1000.0);
+    printf("%s_us_p90=%.1f\n", name, times[count*9/10]/1000.0);
+    printf("%s_us_p99=%.1f\n", name, times[count*99/100]/1000.0);
+    printf("%s_us_max=%.1f\n", name, times[count - 1]/1000.0);
+}
+
+// Prints the results as key=value lines, for scripts to compare between
+// builds
+static void bench_report(uint64_t total) {
+    drc_stats stats;
+    uint64_t* frame_time = malloc(bench_frames*sizeof(uint64_t));
+    uint64_t cpu = 0, dsp = 0;
+    int i;
+
+    for (i = 0; i < bench_frames; i++) {
+        cpu += bench_cpu_time[i];
+        dsp += bench_dsp_time[i];
+        frame_time[i] = bench_cpu_time[i] + bench_dsp_time[i];
+    }
+
+    printf("rom=%s\n", tVBOpt.ROM_NAME);
+    printf("core=%s\n", tVBOpt.INTERP ? "interpreter" : "dynarec");
+    printf("frames=%d\n", bench_frames);
+    printf("warmup=%d\n", bench_warmup);
+    printf("fps=%.2f\n", bench_frames/(total/1e9));
+    printf("cpu_ms=%.3f\n", cpu/1e6);
+    printf("dsp_ms=%.3f\n", dsp/1e6);
+    bench_percentiles("frame", frame_time, bench_frames);
+    bench_percentiles("cpu", bench_cpu_time, bench_frames);
+    bench_percentiles("dsp", bench_dsp_time, bench_frames);
+    free(frame_time);
+
+    drc_getStats(&stats);
+    printf("blocks_translated=%u\n", stats.translated);
+    printf("blocks_cached=%u\n", stats.blocks);
+    printf("cache_used=%u\n", stats.cache_used);
+    printf("cache_size=%u\n", stats.cache_size);
+
+#ifdef VB_PROFILE
+    for (i = 0; i < PROF_NUM_PROBES; i++) {
+        const prof_stats* prof = prof_getStats(i);
+        printf("prof_%s_us_avg=%.1f\n", prof_getName(i), prof->frames ? (double)prof->total_us/prof->frames : 0);
+        printf("prof_%s_us_max=%u\n", prof_getName(i), prof->max_us);
+    }
+#endif
+}
+
+static void usage() {
+    printf("Usage: r3Ddragon [-b frames] [-w warm-up frames] [-i input file] [-p CSV file] [ROM file]\n");
+    printf("  -b runs that many frames headless and prints how long they took\n");
+    printf("  -p writes the per-frame times of a -DVB_PROFILE build\n");
+}
+
 int main(int argc, char* argv[]) {
     int qwe;
     int frame = 0;
     int err = 0;
     static int Left = 0;
     int skip = 0;
+    int opt, i;
+    uint64_t start, bench_start = 0;
+    char* prof_csv = NULL;
     signal(SIGINT, sigint_handler);
 
+    while ((opt = getopt(argc, argv, "b:w:i:p:")) != -1) {
+        switch (opt) {
+            case 'b':
+                bench_frames = atoi(optarg);
+                break;
+            case 'w':
+                bench_warmup = atoi(optarg);
+                break;
+            case 'i':
+                if (bench_loadInput(optarg)) {
+                    printf("Couldn't open %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'p':
+                prof_csv = optarg;
+                break;
+            default:
+                usage();
+                return 1;
+        }
+    }
+
     setDefaults();
     if (loadFileOptions() < 0)
         saveFileOptions();
 
     V810_DSP_Init();
 
-    if (argc < 2) {
-        printf("Usage: r3Ddragon [ROM file]\n");
+    if (optind >= argc || bench_frames < 0 || bench_warmup < 0) {
+        usage();
         return 1;
     }
+    if (bench_frames) {
+        bench_cpu_time = calloc(bench_frames, sizeof(uint64_t));
+        bench_dsp_time = calloc(bench_frames, sizeof(uint64_t));
+        // Every frame gets drawn, so the times don't depend on the config
+        tVBOpt.FRMSKIP = 0;
+    }
 
-    tVBOpt.ROM_NAME = argv[1];
-    printf("Opening %s\n", argv[1]);
+    tVBOpt.ROM_NAME = argv[optind];
+    printf("Opening %s\n", argv[optind]);
 
-    if (!v810_init(argv[1])) {
+    if (!v810_init(argv[optind])) {
         goto exit;
     }
 
     v810_reset();
     drc_init();
+#ifdef VB_PROFILE
+    prof_init(prof_csv);
+#else
+    if (prof_csv)
+        printf("Not built with -DVB_PROFILE, ignoring -p\n");
+#endif
 
     clearCache();
 
@@ -67,8 +226,26 @@ int main(int argc, char* argv[]) {
 //            }
 //        }
 
+        if (bench_frames) {
+            if (frame == bench_warmup) {
+                bench_start = bench_now();
+#ifdef VB_PROFILE
+                prof_reset();
+#endif
+            }
+            if (frame >= bench_warmup + bench_frames) {
+                bench_report(bench_now() - bench_start);
+                goto exit;
+            }
+        }
+
         for (qwe = 0; qwe <= tVBOpt.FRMSKIP; qwe++) {
-            err = drc_run();
+            if (bench_num_input)
+                bench_setKeys(frame);
+            start = bench_now();
+            err = tVBOpt.INTERP ? v810_interpRun() : drc_run();
+            if ((i = bench_index(frame)) >= 0)
+                bench_cpu_time[i] = bench_now() - start;
             if (err) {
                 dprintf(0, "[DRC]: error #%d @ PC=0x%08X\n", err, v810_state->PC);
                 printf("\nDumping debug info...\n");
@@ -89,11 +266,21 @@ int main(int argc, char* argv[]) {
 
         // Display
         if (tVIPREG.DPCTRL & 0x0002) {
+            start = bench_now();
             V810_Dsp_Frame(Left); //Temporary...
+            // Counted with the frame that was just run
+            if ((i = bench_index(frame - 1)) >= 0)
+                bench_dsp_time[i] = bench_now() - start;
         }
+#ifdef VB_PROFILE
+        prof_endFrame();
+#endif
     }
 
 exit:
+#ifdef VB_PROFILE
+    prof_exit();
+#endif
     v810_exit();
     V810_DSP_Quit();
     drc_exit();
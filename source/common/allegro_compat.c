@@ -4,6 +4,7 @@
 #include <dirent.h>
 #include "allegro_compat.h"
 #include "vb_dsp.h"
+#include "vb_blit.h"
 #include "vb_set.h"
 
 #ifdef _3DS
@@ -17,14 +18,25 @@
 
 // Graphics stuff
 
+// a modulo b, for negative a too
+static int wrap(int a, int b) {
+    a %= b;
+    return (a < 0) ? a + b : a;
+}
+
 void masked_blit(BITMAP *src, BITMAP *dst, int src_x, int src_y, int dst_x, int dst_y, int w, int h) {
-    int x, y;
+    int x, y, n, sx, dx;
+    unsigned char *src_line, *dst_line;
 
     for (y = 0; y < h; y++) {
-        for (x = 0; x < w; x++) {
-            if (src->line[(src_y+y)%(src->h)][(src_x+x)%(src->w)]) {
-                dst->line[(dst_y+y)%(dst->h)][(dst_x+x)%(dst->w)] = src->line[(src_y+y)%(src->h)][(src_x+x)%(src->w)];
-            }
+        src_line = src->line[wrap(src_y+y, src->h)];
+        dst_line = dst->line[wrap(dst_y+y, dst->h)];
+        // Both sides wrap around, so a line is copied in pieces
+        for (x = 0; x < w; x += n) {
+            sx = wrap(src_x+x, src->w);
+            dx = wrap(dst_x+x, dst->w);
+            n = MIN(w - x, MIN(src->w - sx, dst->w - dx));
+            blit_maskedSpan(dst_line + dx, src_line + sx, n);
         }
     }
 }
@@ -42,6 +42,8 @@
 #include "v810_mem.h"
 #include "v810_opt.h"
 #include "vb_set.h"
+#include "vb_sched.h"
+#include "vb_prof.h"
 #include "vb_gui.h"
 #include "vb_types.h"
 
@@ -51,6 +53,57 @@
 WORD* cache_start;
 WORD* cache_pos;
 int block_pos = 0;
+drc_map_page** rom_map;
+drc_map_page** ram_map;
+drc_link* link_table;
+int num_links = 0;
+// The region cache_pos is in
+int cur_region = 0;
+// Where cache_pos and cur_region are kept while translating code of the other
+// kind (RAM or ROM), see drc_swapRegions
+WORD* alt_cache_pos;
+int alt_region = DRC_RAM_REGION;
+// Code that didn't fit in a whole region, which drc_run leaves to the
+// interpreter
+static WORD big_start = 0;
+static WORD big_end = 0;
+// Block structures released by evicted regions
+HWORD free_blocks[MAX_NUM_BLOCKS];
+int num_free_blocks = 0;
+// Structures freed while translated code runs. postexec still reads the
+// reg_map of the block it leaves from, which can be one of them, so the worker
+// thread can't reuse them until drc_run gets control back.
+static HWORD pending_blocks[MAX_NUM_BLOCKS];
+static int num_pending_blocks = 0;
+static bool drc_executing = false;
+
+// Identifies the build that generated a cache file. Builds that generate the
+// same code (like the emulator and r3Ddragon-aot) can share one with
+// -DDRC_BUILD_ID=\"...\", which the makefiles set to the git revision.
+#ifndef DRC_BUILD_ID
+#define DRC_BUILD_ID __DATE__ " " __TIME__
+#endif
+static const char drc_build_id[32] = DRC_BUILD_ID;
+// A longer one would be cut short and match other builds
+_Static_assert(sizeof(DRC_BUILD_ID) <= sizeof(drc_build_id), "DRC_BUILD_ID is longer than 31 characters");
+
+// Background translation (see drc_workerMain). drc_lock guards all of the
+// translator state, and the main thread only lets go of it to run blocks.
+static void* drc_lock = NULL;
+static void* drc_worker = NULL;
+static volatile bool drc_worker_quit = false;
+// Set while the worker is translating, so its blocks don't queue more work
+static bool drc_in_worker = false;
+// Gets the targets found by drc_queueTargets, if anyone wants them
+static void (*drc_queueHook)(WORD PC) = NULL;
+// The worker wrote code since the main thread last flushed its caches
+static bool spec_unflushed = false;
+// Blocks translated since drc_init, see drc_getStats
+static unsigned int drc_num_translated = 0;
+// Single producer, single consumer ring of PCs for the worker
+static WORD spec_queue[DRC_SPEC_QUEUE_SIZE];
+static volatile unsigned int spec_head = 0;
+static volatile unsigned int spec_tail = 0;
 
 // Maps the most used registers in the block to V810 registers
 void drc_mapRegs(exec_block* block) {
@@ -87,260 +140,459 @@ BYTE drc_getPhysReg(BYTE vb_reg, BYTE reg_map[]) {
     return 0;
 }
 
-// Finds the starting and ending address of a V810 code block. It stops after a
-// jmp, jal, reti or a long jr unless it branches further.
-void drc_scanBlockBounds(WORD* p_start_PC, WORD* p_end_PC) {
-    WORD start_PC = *p_start_PC & V810_ROM1.highaddr;
-    WORD end_PC = start_PC;
-    WORD cur_PC = start_PC;
-    WORD branch_addr;
-    int branch_offset;
-    BYTE opcode;
-    bool finished = false;
-    BYTE lowB, highB, lowB2, highB2;
-
-    while(!finished) {
-        // TODO: implement reading from RAM
-        if ((cur_PC >>24) == 0x05) { // RAM
-            cur_PC = (cur_PC & V810_VB_RAM.highaddr);
-            lowB   = ((BYTE *)(V810_VB_RAM.off + cur_PC))[0];
-            highB  = ((BYTE *)(V810_VB_RAM.off + cur_PC))[1];
-            lowB2  = ((BYTE *)(V810_VB_RAM.off + cur_PC))[2];
-            highB2 = ((BYTE *)(V810_VB_RAM.off + cur_PC))[3];
-        } else if ((cur_PC >>24) >= 0x07) { // ROM
-            cur_PC = (cur_PC & V810_ROM1.highaddr);
-            lowB   = ((BYTE *)(V810_ROM1.off + cur_PC))[0];
-            highB  = ((BYTE *)(V810_ROM1.off + cur_PC))[1];
-            lowB2  = ((BYTE *)(V810_ROM1.off + cur_PC))[2];
-            highB2 = ((BYTE *)(V810_ROM1.off + cur_PC))[3];
-        } else {
-            return;
+// Points a forward branch emitted with Boff to the current instruction
+#define PATCH_BRANCH(branch) \
+    (branch)->b_bl.imm = (int) (inst_ptr - (branch)) - 2
+
+// Loads the value at the address in r0 into r0. Size is 0, 1 or 2 for a byte,
+// halfword or word. VB RAM and ROM are read inline through the bases in
+// v810_state and everything else goes through the C handler.
+static void drc_emitLoad(int size, int reloc) {
+    arm_inst *not_ram, *not_rom, *ram_done, *rom_done;
+    BYTE align = (BYTE) ((1 << size) - 1);
+
+    // r1 = addr >> 24
+    MOV_IS(1, 0, ARM_SHIFT_LSR, 24);
+    CMP_I(1, 0x05, 0);
+    not_ram = inst_ptr;
+    Boff(ARM_COND_NE, 0);
+    // 0x05xxxxxx -> 0x0500xxxx
+    BIC_RI(1, 0, 0xFF, 16);
+    if (align)
+        BIC_I(1, align, 0);
+    LDR_IO(12, 11, 70 * 4);
+    switch (size) {
+        case 0: LDRB_RO(0, 12, 1); break;
+        case 1: LDRH_RO(0, 12, 1); break;
+        default: LDR_RO(0, 12, 1); break;
+    }
+    ram_done = inst_ptr;
+    Boff(ARM_COND_AL, 0);
+
+    PATCH_BRANCH(not_ram);
+    CMP_I(1, 0x07, 0);
+    not_rom = inst_ptr;
+    Boff(ARM_COND_NE, 0);
+    LDR_IO(12, 11, 72 * 4);
+    AND(1, 0, 12);
+    if (align)
+        BIC_I(1, align, 0);
+    LDR_IO(12, 11, 71 * 4);
+    switch (size) {
+        case 0: LDRB_RO(0, 12, 1); break;
+        case 1: LDRH_RO(0, 12, 1); break;
+        default: LDR_RO(0, 12, 1); break;
+    }
+    rom_done = inst_ptr;
+    Boff(ARM_COND_AL, 0);
+
+    // Slow path
+    PATCH_BRANCH(not_rom);
+    LDR_IO(1, 11, 69 * 4);
+    ADD_I(1, 1, reloc*4, 0);
+    BLX(ARM_COND_AL, 1);
+
+    PATCH_BRANCH(ram_done);
+    PATCH_BRANCH(rom_done);
+}
+
+// Stores the value in src_reg at the address in r0. VB RAM is written inline
+// unless the page has translated code, and everything else goes through the C
+// handler.
+static void drc_emitStore(int size, BYTE src_reg, int reloc) {
+    arm_inst *not_ram, *code_page, *ram_done;
+    BYTE align = (BYTE) ((1 << size) - 1);
+
+    MOV_IS(1, 0, ARM_SHIFT_LSR, 24);
+    CMP_I(1, 0x05, 0);
+    not_ram = inst_ptr;
+    Boff(ARM_COND_NE, 0);
+    BIC_RI(1, 0, 0xFF, 16);
+    if (align)
+        BIC_I(1, align, 0);
+    // r12 = v810_state->ram_code_pages[(addr >> 8) & 0xFF]
+    MOV_IS(12, 1, ARM_SHIFT_LSL, 16);
+    MOV_IS(12, 12, ARM_SHIFT_LSR, 24);
+    ADD(12, 11, 12);
+    LDRB_IO(12, 12, 74 * 4 + 1);
+    CMP_I(12, 0, 0);
+    code_page = inst_ptr;
+    Boff(ARM_COND_NE, 0);
+    LDR_IO(12, 11, 70 * 4);
+    switch (size) {
+        case 0: STRB_RO(src_reg, 12, 1); break;
+        case 1: STRH_RO(src_reg, 12, 1); break;
+        default: STR_RO(src_reg, 12, 1); break;
+    }
+    ram_done = inst_ptr;
+    Boff(ARM_COND_AL, 0);
+
+    // Slow path
+    PATCH_BRANCH(not_ram);
+    PATCH_BRANCH(code_page);
+    MOV(1, src_reg);
+    LDR_IO(2, 11, 69 * 4);
+    ADD_I(2, 2, reloc*4, 0);
+    BLX(ARM_COND_AL, 2);
+
+    PATCH_BRANCH(ram_done);
+}
+
+// Emits the load of a ld/in instruction into r0. If the address is known at
+// translation time only the access for its region is emitted.
+static void drc_emitLoadInst(v810_instruction *inst, BYTE arm_reg1, int size, int reloc) {
+    WORD addr = inst->const_addr;
+
+    if (!(inst->const_info & DRC_CONST_ADDR)) {
+        LDW_I(0, sign_16(inst->imm));
+        if (inst->reg1 != 0)
+            ADD(0, 0, arm_reg1);
+        drc_emitLoad(size, reloc);
+        return;
+    }
+
+    if ((addr >> 24) == 0x05) {
+        LDW_I(1, addr & ~(0xFF0000 | ((1 << size) - 1)));
+        LDR_IO(12, 11, 70 * 4);
+        switch (size) {
+            case 0: LDRB_RO(0, 12, 1); break;
+            case 1: LDRH_RO(0, 12, 1); break;
+            default: LDR_RO(0, 12, 1); break;
         }
-        if ((highB & 0xE0) == 0x80)
-            opcode = highB>>1;
-        else
-            opcode = highB>>2;
+    } else {
+        LDW_I(0, addr);
+        LDR_IO(1, 11, 69 * 4);
+        ADD_I(1, 1, reloc*4, 0);
+        BLX(ARM_COND_AL, 1);
+    }
+}
 
-        switch (opcode) {
-            case V810_OP_JR:
-                branch_offset = (signed)sign_26(((highB & 0x3) << 24) + (lowB << 16) + (highB2 << 8) + lowB2);
-                if (abs(branch_offset) < 1024) {
-                    branch_addr = cur_PC + branch_offset;
-                    if (branch_addr < start_PC)
-                        start_PC = branch_addr;
-                    else if (branch_addr > end_PC)
-                        end_PC = branch_addr;
-                    break;
-                }
-            case V810_OP_JMP:
-            case V810_OP_JAL:
-            case V810_OP_RETI:
-                if (cur_PC >= end_PC) {
-                    end_PC = cur_PC;
-                    finished = true;
-                }
-                break;
-            case V810_OP_BV:
-            case V810_OP_BL:
-            case V810_OP_BE:
-            case V810_OP_BNH:
-            case V810_OP_BN:
-            case V810_OP_BR:
-            case V810_OP_BLT:
-            case V810_OP_BLE:
-            case V810_OP_BNV:
-            case V810_OP_BNL:
-            case V810_OP_BNE:
-            case V810_OP_BH:
-            case V810_OP_BP:
-            case V810_OP_BGE:
-            case V810_OP_BGT:
-                branch_addr = cur_PC + sign_9(((highB & 0x1) << 8) + (lowB & 0xFE));
+// Emits the store of a st/out instruction, see drc_emitLoadInst
+static void drc_emitStoreInst(v810_instruction *inst, BYTE arm_reg1, int size, BYTE src_reg, int reloc) {
+    arm_inst *code_page = NULL, *ram_done = NULL;
+    WORD addr = inst->const_addr;
+
+    if (!(inst->const_info & DRC_CONST_ADDR)) {
+        LDW_I(0, sign_16(inst->imm));
+        if (inst->reg1 != 0)
+            ADD(0, 0, arm_reg1);
+        drc_emitStore(size, src_reg, reloc);
+        return;
+    }
 
-                if (branch_addr < start_PC)
-                    start_PC = branch_addr;
-                else if (branch_addr > end_PC)
-                    end_PC = branch_addr;
-                break;
+    if ((addr >> 24) == 0x05) {
+        LDW_I(1, addr & ~(0xFF0000 | ((1 << size) - 1)));
+        // The page is known too, so its code bit can be read directly
+        LDRB_IO(12, 11, 74 * 4 + 1 + ((addr >> 8) & 0xFF));
+        CMP_I(12, 0, 0);
+        code_page = inst_ptr;
+        Boff(ARM_COND_NE, 0);
+        LDR_IO(12, 11, 70 * 4);
+        switch (size) {
+            case 0: STRB_RO(src_reg, 12, 1); break;
+            case 1: STRH_RO(src_reg, 12, 1); break;
+            default: STR_RO(src_reg, 12, 1); break;
         }
+        ram_done = inst_ptr;
+        Boff(ARM_COND_AL, 0);
+        PATCH_BRANCH(code_page);
+    }
+
+    LDW_I(0, addr);
+    MOV(1, src_reg);
+    LDR_IO(2, 11, 69 * 4);
+    ADD_I(2, 2, reloc*4, 0);
+    BLX(ARM_COND_AL, 2);
+
+    if (ram_done)
+        PATCH_BRANCH(ram_done);
+}
 
-        cur_PC += am_size_table[optable[opcode].addr_mode];
+// Emitted right before the branch of an idle loop. If the loop goes around
+// again the cycle counter is moved forward to the next event, so the HANDLEINT
+// that follows services it.
+static void drc_emitIdleSkip(BYTE arm_cond) {
+    arm_inst *loop_exit = NULL;
 
-        if (cur_PC > end_PC)
-            end_PC = cur_PC;
+    if (arm_cond != ARM_COND_AL) {
+        loop_exit = inst_ptr;
+        Boff(arm_cond ^ 1, 0);
     }
+    MRS(0);
+    STR_IO(0, 11, 34 * 4);
+    MOV(0, 10);
+    LDR_IO(1, 11, 69 * 4);
+    ADD_I(1, 1, DRC_RELOC_IDLE*4, 0);
+    BLX(ARM_COND_AL, 1);
+    MOV(10, 0);
+    LDR_IO(0, 11, 34 * 4);
+    MSR(0);
+    if (loop_exit)
+        PATCH_BRANCH(loop_exit);
+}
 
-    *p_start_PC = start_PC;
-    *p_end_PC = end_PC;
+// Tells if inst is a plain "ldr/str Rd, [r11, #off]" accessing v810_state
+static bool drc_isStateAccess(arm_inst *inst, BYTE l) {
+    return inst->type == ARM_LDST_IMM_OFF && inst->cond == ARM_COND_AL && inst->ldst_io.Rn == 11 &&
+           inst->ldst_io.p && inst->ldst_io.u && !inst->ldst_io.b && !inst->ldst_io.w && inst->ldst_io.l == l;
 }
 
-// Workaround for an issue where the CPSR is modified outside of the block
-// before a conditional branch.
-// Sets save_flags for all unconditional instructions prior to a branch.
-void drc_findLastConditionalInst(v810_instruction *inst_cache, int pos) {
-    int i;
-    for (i = pos - 1; i >= 0; i--) {
-        switch (inst_cache[i].opcode) {
-            case V810_OP_LD_B:
-            case V810_OP_LD_H:
-            case V810_OP_LD_W:
-            case V810_OP_IN_B:
-            case V810_OP_IN_H:
-            case V810_OP_IN_W:
-            case V810_OP_ST_B:
-            case V810_OP_ST_H:
-            case V810_OP_ST_W:
-            case V810_OP_OUT_B:
-            case V810_OP_OUT_H:
-            case V810_OP_OUT_W:
-                inst_cache[i].save_flags = true;
-                break;
-            default:
-                return;
+// Peephole pass over the ARM code of a block, before it's assembled. Removes
+// "mov rX, rX", loads from a v810_state slot right after storing to it (or
+// the other way around), and "mrs" right after a "msr" of the same register.
+// The removed instructions are compacted away, so the positions of the V810
+// instructions, the exits and the branches inside the block are remapped.
+// Returns the new number of ARM instructions.
+static unsigned int drc_peephole(arm_inst *trans_cache, unsigned int num_arm_inst, v810_instruction *inst_cache,
+                                 unsigned int num_v810_inst, HWORD *exit_pos, int num_exits) {
+    // new_pos[j] is where trans_cache[j] ends up, or where the next kept
+    // instruction does if it's removed
+    WORD *new_pos = malloc((num_arm_inst + 1)*sizeof(WORD));
+    bool *target = calloc(num_arm_inst + 1, sizeof(bool));
+    bool *removed = calloc(num_arm_inst + 1, sizeof(bool));
+    arm_inst *inst, *prev;
+    arm_inst *saved_inst_ptr = inst_ptr;
+    int last = -1, last_access = -1;
+    bool window_ok = false;
+    int i, j, k, dest;
+
+    if (!new_pos || !target || !removed) {
+        free(new_pos);
+        free(target);
+        free(removed);
+        return num_arm_inst;
+    }
+
+    // Anything that can be jumped to has to stay where it is
+    for (i = 0; i < num_v810_inst; i++) {
+        if (!(inst_cache[i].const_info & DRC_CONST_NO_ENTRY))
+            target[inst_cache[i].start_pos] = true;
+    }
+    for (j = 0; j < num_arm_inst; j++) {
+        if (trans_cache[j].type == ARM_BRANCH_LINK && !trans_cache[j].needs_branch) {
+            dest = j + 2 + (((trans_cache[j].b_bl.imm & 0xFFFFFF) ^ 0x800000) - 0x800000);
+            if (dest >= 0 && dest <= num_arm_inst)
+                target[dest] = true;
         }
     }
-}
 
-// Decodes the instructions from start_PC to end_PC and stores them in
-// inst_cache.
-// Returns the number of instructions decoded.
-unsigned int drc_decodeInstructions(exec_block *block, v810_instruction *inst_cache, WORD start_PC, WORD end_PC) {
-    unsigned int i;
-    // Up to 4 bytes for instruction (either 16 or 32 bits)
-    BYTE lowB, highB, lowB2, highB2;
-    WORD cur_PC = start_PC;
-
-    for (i = 0; (i < MAX_INST) && (cur_PC < end_PC); i++) {
-        cur_PC = (cur_PC &0x07FFFFFE);
-
-        if ((cur_PC >>24) == 0x05) { // RAM
-            cur_PC = (cur_PC & V810_VB_RAM.highaddr);
-            lowB   = ((BYTE *)(V810_VB_RAM.off + cur_PC))[0];
-            highB  = ((BYTE *)(V810_VB_RAM.off + cur_PC))[1];
-            lowB2  = ((BYTE *)(V810_VB_RAM.off + cur_PC))[2];
-            highB2 = ((BYTE *)(V810_VB_RAM.off + cur_PC))[3];
-        } else if ((cur_PC >>24) >= 0x07) { // ROM
-            cur_PC = (cur_PC & V810_ROM1.highaddr);
-            lowB   = ((BYTE *)(V810_ROM1.off + cur_PC))[0];
-            highB  = ((BYTE *)(V810_ROM1.off + cur_PC))[1];
-            lowB2  = ((BYTE *)(V810_ROM1.off + cur_PC))[2];
-            highB2 = ((BYTE *)(V810_ROM1.off + cur_PC))[3];
-        } else {
-            return 0;
+    for (j = 0; j < num_arm_inst; j++) {
+        inst = &trans_cache[j];
+
+        // mov rX, rX
+        if (inst->type == ARM_DATA_PROC_IMM_SHIFT && inst->dpis.opcode == ARM_OP_MOV && !inst->dpis.s &&
+                inst->dpis.Rd == inst->dpis.Rm && !inst->dpis.shift_imm && inst->dpis.shift == ARM_SHIFT_LSL) {
+            removed[j] = true;
+            continue;
         }
 
-        inst_cache[i].PC = cur_PC;
-        inst_cache[i].save_flags = false;
+        // msr cpsr_f, rX; mrs rX, cpsr
+        // rX already has the flags and only the flags are ever used
+        if (inst->type == ARM_MOV_FROM_CPSR && inst->cond == ARM_COND_AL && !target[j] && last >= 0 &&
+                trans_cache[last].type == ARM_MOV_REG_CPSR && trans_cache[last].cond == ARM_COND_AL &&
+                trans_cache[last].mrcpsr.Rm == inst->mfcpsr.Rd) {
+            removed[j] = true;
+            continue;
+        }
 
-        inst_cache[i].opcode = highB >> 2;
-        if ((highB & 0xE0) == 0x80)              // Special opcode format for
-            inst_cache[i].opcode = (highB >> 1); // type III instructions.
+        // A store to a v810_state slot followed by a load from it, or the
+        // other way around. Only a msr can be in between.
+        if (last_access >= 0 && window_ok && !target[j]) {
+            prev = &trans_cache[last_access];
+            if (drc_isStateAccess(prev, 0) && drc_isStateAccess(inst, 1) && prev->ldst_io.imm == inst->ldst_io.imm) {
+                if (prev->ldst_io.Rd == inst->ldst_io.Rd) {
+                    removed[j] = true;
+                    continue;
+                }
+                // ldr rB, [r11, #off] -> mov rB, rA
+                inst_ptr = inst;
+                MOV(inst->ldst_io.Rd, prev->ldst_io.Rd);
+            } else if (drc_isStateAccess(prev, 1) && drc_isStateAccess(inst, 0) && prev->ldst_io.imm == inst->ldst_io.imm &&
+                       prev->ldst_io.Rd == inst->ldst_io.Rd) {
+                removed[j] = true;
+                continue;
+            }
+        }
 
-        if ((inst_cache[i].opcode > 0x4F) || (inst_cache[i].opcode < 0))
-            return 0;
+        last = j;
+        if (inst->type == ARM_MOV_REG_CPSR) {
+            if (target[j])
+                window_ok = false;
+        } else {
+            last_access = j;
+            window_ok = true;
+        }
+    }
 
-        switch (optable[inst_cache[i].opcode].addr_mode) {
-            case AM_I:
-                inst_cache[i].reg1 = (BYTE)((lowB & 0x1F));
-                reg_usage[inst_cache[i].reg1]++;
+    // Compact the code
+    for (j = 0, k = 0; j < num_arm_inst; j++) {
+        new_pos[j] = k;
+        if (!removed[j])
+            trans_cache[k++] = trans_cache[j];
+    }
+    new_pos[num_arm_inst] = k;
+
+    for (j = 0; j < num_arm_inst; j++) {
+        if (removed[j] || trans_cache[new_pos[j]].type != ARM_BRANCH_LINK || trans_cache[new_pos[j]].needs_branch)
+            continue;
+        inst = &trans_cache[new_pos[j]];
+        dest = j + 2 + (((inst->b_bl.imm & 0xFFFFFF) ^ 0x800000) - 0x800000);
+        if (dest >= 0 && dest <= num_arm_inst)
+            inst->b_bl.imm = ((int)new_pos[dest] - (int)new_pos[j] - 2) & 0xFFFFFF;
+    }
 
-                // jmp [reg1] doesn't use the second register
-                if (inst_cache[i].opcode != V810_OP_JMP) {
-                    inst_cache[i].reg2 = (BYTE)((lowB >> 5) + ((highB & 0x3) << 3));
-                    reg_usage[inst_cache[i].reg2]++;
-                } else {
-                    inst_cache[i].reg2 = 0xFF;
-                }
-                break;
-            case AM_II:
-                inst_cache[i].imm = (unsigned)((lowB & 0x1F));
-                inst_cache[i].reg2 = (BYTE)((lowB >> 5) + ((highB & 0x3) << 3));
-                reg_usage[inst_cache[i].reg2]++;
+    for (i = 0; i < num_v810_inst; i++) {
+        WORD start_pos = inst_cache[i].start_pos;
+        inst_cache[i].start_pos = new_pos[start_pos];
+        inst_cache[i].trans_size = (BYTE) (new_pos[start_pos + inst_cache[i].trans_size] - new_pos[start_pos]);
+    }
+    for (i = 0; i < num_exits; i++)
+        exit_pos[i] = (HWORD) new_pos[exit_pos[i]];
+
+    inst_ptr = saved_inst_ptr;
+    free(new_pos);
+    free(target);
+    free(removed);
+    return k;
+}
 
-                inst_cache[i].reg1 = 0xFF;
-                break;
-            case AM_III: // Branch instructions
-                inst_cache[i].imm = (unsigned)(((highB & 0x1) << 8) + (lowB & 0xFE));
-                inst_cache[i].branch_offset = sign_9(inst_cache[i].imm);
+static void drc_lockCache() {
+    if (drc_lock)
+        LockMutex(drc_lock);
+}
 
-                inst_cache[i].reg1 = 0xFF;
-                inst_cache[i].reg2 = 0xFF;
+static void drc_unlockCache() {
+    if (drc_lock)
+        UnlockMutex(drc_lock);
+}
 
-                if (inst_cache[i].opcode != V810_OP_BR &&
-                    inst_cache[i].opcode != V810_OP_NOP)
-                    drc_findLastConditionalInst(inst_cache, i);
-                break;
-            case AM_IV: // Middle distance jump
-                inst_cache[i].imm = (unsigned)(((highB & 0x3) << 24) + (lowB << 16) + (highB2 << 8) + lowB2);
-                inst_cache[i].branch_offset = (signed)sign_26(inst_cache[i].imm);
+// Hands a ROM PC to the worker thread. Dropped if the queue is full.
+static void drc_queuePC(WORD PC) {
+    unsigned int next = (spec_head + 1) % DRC_SPEC_QUEUE_SIZE;
+
+    PC &= V810_ROM1.highaddr;
+    if ((PC >> 24) != 0x07 || next == spec_tail)
+        return;
+    spec_queue[spec_head] = PC;
+    // The PC has to be there before the worker sees the new head
+    __sync_synchronize();
+    spec_head = next;
+}
 
-                inst_cache[i].reg1 = 0xFF;
-                inst_cache[i].reg2 = 0xFF;
-                break;
-            case AM_V:
-                inst_cache[i].reg2 = (BYTE)((lowB >> 5) + ((highB & 0x3) << 3));
-                inst_cache[i].reg1 = (BYTE)((lowB & 0x1F));
-                inst_cache[i].imm = (highB2 << 8) + lowB2;
-                reg_usage[inst_cache[i].reg1]++;
-                reg_usage[inst_cache[i].reg2]++;
-                break;
-            case AM_VIa: // Mode6 form1
-                inst_cache[i].imm = (highB2 << 8) + lowB2;
-                inst_cache[i].reg1 = (BYTE)((lowB & 0x1F));
-                inst_cache[i].reg2 = (BYTE)((lowB >> 5) + ((highB & 0x3) << 3));
-                reg_usage[inst_cache[i].reg1]++;
-                reg_usage[inst_cache[i].reg2]++;
-                break;
-            case AM_VIb: // Mode6 form2
-                inst_cache[i].reg2 = (BYTE)((lowB >> 5) + ((highB & 0x3) << 3));
-                inst_cache[i].imm = (highB2 << 8) + lowB2; // Whats the order??? 2,3,1 or 1,3,2
-                inst_cache[i].reg1 = (BYTE)((lowB & 0x1F));
-                reg_usage[inst_cache[i].reg1]++;
-                reg_usage[inst_cache[i].reg2]++;
-                break;
-            case AM_VII: // Unhandled
-                break;
-            case AM_VIII: // Unhandled
-                break;
-            case AM_IX:
-                inst_cache[i].imm = (unsigned)((lowB & 0x1)); // Mode ID, Ignore for now
+// Queues the branch targets out of the block and the return addresses of its
+// calls with drc_queueHook
+static void drc_queueTargets(v810_instruction *inst_cache, unsigned int num_inst, WORD start_PC, WORD end_PC) {
+    WORD target;
+    int i;
 
-                inst_cache[i].reg1 = 0xFF;
-                inst_cache[i].reg2 = 0xFF;
-                break;
-            case AM_BSTR: // Bit String Subopcodes
-                inst_cache[i].reg2 = (BYTE)((lowB >> 5) + ((highB & 0x3) << 3));
-                inst_cache[i].reg1 = (BYTE)((lowB & 0x1F));
-                reg_usage[inst_cache[i].reg1]++;
-                reg_usage[inst_cache[i].reg2]++;
-                break;
-            case AM_FPP: // Floating Point Subcode
-                inst_cache[i].reg2 = (BYTE)((lowB >> 5) + ((highB & 0x3) << 3));
-                inst_cache[i].reg1 = (BYTE)((lowB & 0x1F));
-                inst_cache[i].imm = (unsigned)(((highB2 >> 2)&0x3F));
-                reg_usage[inst_cache[i].reg1]++;
-                reg_usage[inst_cache[i].reg2]++;
-                break;
-            case AM_UDEF: // Invalid opcode.
-                inst_cache[i].reg1 = 0xFF;
-                inst_cache[i].reg2 = 0xFF;
+    for (i = 0; i < num_inst; i++) {
+        switch (inst_cache[i].opcode) {
+            case V810_OP_JAL:
+                drc_queueHook(inst_cache[i].PC + 4);
+                // Fall through
+            case V810_OP_JR:
                 break;
-            default: // Invalid opcode.
-                inst_cache[i].reg1 = 0xFF;
-                inst_cache[i].reg2 = 0xFF;
-                cur_PC += 2;
+            default:
+                if (inst_cache[i].opcode < V810_OP_BV || inst_cache[i].opcode > V810_OP_BGT ||
+                        inst_cache[i].opcode == V810_OP_NOP)
+                    continue;
                 break;
         }
+        target = inst_cache[i].PC + inst_cache[i].branch_offset;
+        if (target < start_PC || target >= end_PC)
+            drc_queueHook(target);
+    }
+}
+
+// Translates the queued PCs ahead of time while the main thread runs the guest.
+// The blocks show up in the entry maps like any other, and the main thread
+// flushes its caches before running anything after that. Nothing is evicted
+// here since the main thread might be running that code.
+static void drc_workerMain(void* arg) {
+    exec_block* block;
+    WORD PC;
+
+    while (!drc_worker_quit) {
+        if (spec_tail == spec_head) {
+            SleepThread(1000);
+            continue;
+        }
+        PC = spec_queue[spec_tail];
+        __sync_synchronize();
+        spec_tail = (spec_tail + 1) % DRC_SPEC_QUEUE_SIZE;
+
+        LockMutex(drc_lock);
+        if (drc_getEntry(PC, NULL) == cache_start && (block = drc_getNextBlockStruct())) {
+            drc_in_worker = true;
+            block->phys_offset = (WORD) (cache_pos - cache_start);
+            if (drc_translateBlock(block, PC)) {
+                drc_freeBlock(block);
+            } else {
+                dprintf(3, "[DRC]: speculative block - 0x%x\n", PC);
+                cache_pos += block->size;
+                // Write the code back from this core's cache
+                FlushInvalidateCache();
+                spec_unflushed = true;
+            }
+            drc_in_worker = false;
+        }
+        UnlockMutex(drc_lock);
+    }
+}
 
-        cur_PC += am_size_table[optable[inst_cache[i].opcode].addr_mode];
-        block->cycles += opcycle[inst_cache[i].opcode];
+// Starts the background translation thread if enabled
+static void drc_startWorker() {
+    if (!tVBOpt.DYNAREC || !tVBOpt.DRCTHREAD)
+        return;
+    spec_head = spec_tail = 0;
+    drc_worker_quit = false;
+    drc_lock = CreateLock();
+    drc_worker = StartThread(drc_workerMain, NULL);
+    if (!drc_worker) {
+        dprintf(0, "[DRC]: couldn't start the worker thread\n");
+        DestroyLock(drc_lock);
+        drc_lock = NULL;
+        return;
     }
+    drc_queueHook = drc_queuePC;
+}
+
+static void drc_stopWorker() {
+    if (!drc_worker)
+        return;
+    drc_queueHook = NULL;
+    drc_worker_quit = true;
+    JoinThread(drc_worker);
+    drc_worker = NULL;
+    DestroyLock(drc_lock);
+    drc_lock = NULL;
+}
 
-    return i;
+// Exits the block towards a known target_PC. If no event is due yet, the
+// "pop {pc}" in the middle is taken, and drc_linkBlocks can later patch it into
+// a direct branch to the target block. Otherwise we go back to drc_run so
+// the events are serviced.
+#define LINKABLE_EXIT(target_PC) { \
+    LDW_I(0, target_PC); \
+    STR_IO(0, 11, 33 * 4); \
+    MRS(1); \
+    ADD_I(10, 10, cycles & 0xFF, 0); \
+    LDR_IO(2, 11, 73 * 4); \
+    CMP(10, 2); \
+    Boff(ARM_COND_GE, 3); \
+    MSR(1); \
+    if (num_exits < MAX_BLOCK_LINKS) { \
+        exit_pos[num_exits] = (HWORD) (inst_ptr - trans_cache); \
+        exit_PC[num_exits++] = target_PC; \
+    } \
+    POP(1 << 15); \
+    MSR(1); \
+    POP(1 << 15); \
+    cycles = 0; \
 }
 
 // Translates a V810 block into ARM code
-int drc_translateBlock(exec_block *block) {
+int drc_translateBlock(exec_block *block, WORD entry_PC) {
     int i, j;
     int err = 0;
     // Stores the number of clock cycles since the last branch
@@ -352,7 +604,8 @@ int drc_translateBlock(exec_block *block) {
     // they're not cached, they will be mapped to r2 and r3.
     BYTE arm_reg1, arm_reg2;
     BYTE arm_cond;
-    WORD start_PC = v810_state->PC;
+    BYTE opcode;
+    WORD start_PC = entry_PC;
     WORD end_PC;
     // For each V810 instruction, tells if either reg1 or reg2 is cached
     bool unmapped_registers;
@@ -360,11 +613,17 @@ int drc_translateBlock(exec_block *block) {
     // Tells if reg1 or reg2 has been modified by the current V810 instruction
     bool reg1_modified;
     bool reg2_modified;
+    // Tells if any of the flags set by the current V810 instruction are live
+    bool set_flags;
     // The value of inst_ptr at the start of a V810 instruction
     arm_inst* inst_ptr_start;
+    // Position in trans_cache and target of each linkable exit
+    HWORD exit_pos[MAX_BLOCK_LINKS];
+    WORD exit_PC[MAX_BLOCK_LINKS];
+    int num_exits = 0;
 
     v810_instruction *inst_cache = linearAlloc(MAX_INST*sizeof(v810_instruction));
-    arm_inst* trans_cache = linearAlloc(8*MAX_INST*sizeof(arm_inst));
+    arm_inst* trans_cache;
     WORD* pool_cache_start = NULL;
 #ifdef LITERAL_POOL
     pool_cache_start = linearAlloc(256*4);
@@ -373,6 +632,8 @@ int drc_translateBlock(exec_block *block) {
 
     drc_scanBlockBounds(&start_PC, &end_PC);
     dprintf(0, "[DRC]: new block - 0x%x->0x%x\n", start_PC, end_PC);
+    block->virt_loc = start_PC;
+    block->end_pc = end_PC;
 
     // Clear previous block register stats
     memset(reg_usage, 0, 32);
@@ -381,6 +642,24 @@ int drc_translateBlock(exec_block *block) {
     num_v810_inst = drc_decodeInstructions(block, inst_cache, start_PC, end_PC);
     dprintf(3, "[DRC]: V810 block size - %d\n", num_v810_inst);
 
+    // Find out which flags are actually read so we only compute and preserve
+    // those
+    drc_findLiveFlags(inst_cache, num_v810_inst);
+
+    // Find the values known at translation time
+    drc_propagateConstants(inst_cache, num_v810_inst, entry_PC);
+
+    // Find the loops that just wait for something to happen
+    drc_findIdleLoops(inst_cache, num_v810_inst);
+
+    // Let the worker thread get a head start on where we'll go next
+    if (drc_queueHook && !drc_in_worker)
+        drc_queueTargets(inst_cache, num_v810_inst, start_PC, end_PC);
+
+    // The inline memory accesses make the worst case quite a bit bigger than
+    // the average, so size the buffer for the block we actually have
+    trans_cache = linearAlloc((num_v810_inst + 1)*MAX_ARM_INST_PER_V810*sizeof(arm_inst));
+
     // Second pass: map the most used V810 registers to ARM registers
     drc_mapRegs(block);
     for (i = 0; i < 32; i++)
@@ -391,20 +670,27 @@ int drc_translateBlock(exec_block *block) {
 
     // Third pass: generate ARM instructions
     for (i = 0; i < num_v810_inst; i++) {
-        inst_cache[i].start_pos = (HWORD) (inst_ptr - trans_cache + pool_offset);
+        inst_cache[i].start_pos = (WORD) (inst_ptr - trans_cache + pool_offset);
         inst_ptr_start = inst_ptr;
-        drc_setEntry(inst_cache[i].PC, cache_start + block->phys_offset + inst_cache[i].start_pos, block);
+        if (!(inst_cache[i].const_info & DRC_CONST_NO_ENTRY))
+            drc_setEntry(inst_cache[i].PC, cache_start + block->phys_offset + inst_cache[i].start_pos, block);
         cycles += opcycle[inst_cache[i].opcode];
 
         reg1_modified = false;
         reg2_modified = false;
+        set_flags = (inst_cache[i].live_flags & drc_getFlagsWritten(&inst_cache[i])) != 0;
         unmapped_registers = false;
         next_available_reg = 2;
         arm_reg1 = 0;
         arm_reg2 = 0;
+        // Instructions with a result known at translation time just set it
+        if (inst_cache[i].const_info & (DRC_CONST_RESULT | DRC_CONST_DEAD))
+            opcode = DRC_OP_CONST;
+        else
+            opcode = inst_cache[i].opcode;
 
         // Map V810 registers and preload them if unmapped
-        if (inst_cache[i].reg1 != 0xFF) {
+        if (inst_cache[i].reg1 != 0xFF && opcode != DRC_OP_CONST && !(inst_cache[i].const_info & DRC_CONST_ADDR)) {
             arm_reg1 = phys_regs[inst_cache[i].reg1];
             if (!arm_reg1) {
                 unmapped_registers = true;
@@ -421,19 +707,29 @@ int drc_translateBlock(exec_block *block) {
             if (!arm_reg2) {
                 unmapped_registers = true;
                 arm_reg2 = next_available_reg++;
-                if (inst_cache[i].reg2)
-                    LDR_IO(arm_reg2, 11, inst_cache[i].reg2 * 4);
-                else
-                    MOV_I(arm_reg2, 0, 0);
+                // Folded instructions only write it
+                if (opcode != DRC_OP_CONST) {
+                    if (inst_cache[i].reg2)
+                        LDR_IO(arm_reg2, 11, inst_cache[i].reg2 * 4);
+                    else
+                        MOV_I(arm_reg2, 0, 0);
+                }
             }
         }
 
+        // Keep the flags in v810_state->flags across the helper calls
         if (inst_cache[i].save_flags) {
             MRS(0);
-            PUSH(1<<0);
+            STR_IO(0, 11, 34 * 4);
         }
 
-        switch (inst_cache[i].opcode) {
+        switch (opcode) {
+            case DRC_OP_CONST:
+                if (!(inst_cache[i].const_info & DRC_CONST_DEAD)) {
+                    LDW_I(arm_reg2, inst_cache[i].const_result);
+                    reg2_modified = true;
+                }
+                break;
             case V810_OP_JMP: // jmp [reg1]
                 STR_IO(arm_reg1, 11, 33 * 4);
                 ADDCYCLES();
@@ -441,28 +737,25 @@ int drc_translateBlock(exec_block *block) {
                 break;
             case V810_OP_JR: // jr imm26
                 if (abs(inst_cache[i].branch_offset) < 1024) {
-                    HANDLEINT(inst_cache[i].PC + inst_cache[i].branch_offset);
+                    if (inst_cache[i].idle_loop)
+                        drc_emitIdleSkip(ARM_COND_AL);
+                    if (inst_cache[i].live_flags)
+                        HANDLEINT(inst_cache[i].PC + inst_cache[i].branch_offset)
+                    else
+                        HANDLEINT_NOFLAGS(inst_cache[i].PC + inst_cache[i].branch_offset)
                     B(ARM_COND_AL, 0);
                 } else {
-                    ADDCYCLES();
-                    LDW_I(0, inst_cache[i].PC + inst_cache[i].branch_offset);
-                    // Save the new PC
-                    STR_IO(0, 11, 33 * 4);
-                    POP(1 << 15);
+                    LINKABLE_EXIT(inst_cache[i].PC + inst_cache[i].branch_offset);
                 }
                 break;
             case V810_OP_JAL: // jal disp26
-                LDW_I(0, inst_cache[i].PC + inst_cache[i].branch_offset);
                 LDW_I(1, inst_cache[i].PC + 4);
-                // Save the new PC
-                STR_IO(0, 11, 33 * 4);
                 // Link the return address
                 if (phys_regs[31])
                     MOV(phys_regs[31], 1);
                 else
                     STR_IO(1, 11, 31 * 4);
-                ADDCYCLES();
-                POP(1 << 15);
+                LINKABLE_EXIT(inst_cache[i].PC + inst_cache[i].branch_offset);
                 break;
             case V810_OP_RETI:
                 LDR_IO(0, 11, (35 + PSW) * 4);
@@ -480,6 +773,16 @@ int drc_translateBlock(exec_block *block) {
                 STR_IO(2, 11, (35 + PSW) * 4);
                 POP(1 << 15);
                 break;
+            case V810_OP_HALT:
+                // Go back to drc_run, which skips ahead until an interrupt
+                // wakes the CPU up, and then resumes after the halt
+                LDW_I(0, inst_cache[i].PC + 2);
+                STR_IO(0, 11, 33 * 4);
+                MOV_I(0, 1, 0);
+                STRB_IO(0, 11, 74 * 4 + 1 + 256);
+                ADDCYCLES();
+                POP(1 << 15);
+                break;
             case V810_OP_BV:
             case V810_OP_BL:
             case V810_OP_BE:
@@ -494,7 +797,13 @@ int drc_translateBlock(exec_block *block) {
             case V810_OP_BGE:
             case V810_OP_BGT:
                 arm_cond = cond_map[inst_cache[i].opcode & 0xF];
-                HANDLEINT(inst_cache[i].PC);
+                if (inst_cache[i].idle_loop)
+                    drc_emitIdleSkip(arm_cond);
+                // The branch is executed again if we exit the block here
+                if (inst_cache[i].live_flags | drc_getFlagsRead(&inst_cache[i]))
+                    HANDLEINT(inst_cache[i].PC)
+                else
+                    HANDLEINT_NOFLAGS(inst_cache[i].PC)
                 B(arm_cond, 0);
                 break;
             // Special case: bnh and bh can't be directly translated to ARM
@@ -543,37 +852,68 @@ int drc_translateBlock(exec_block *block) {
                 reg2_modified = true;
                 break;
             case V810_OP_ADD: // add reg1, reg2
-                ADDS(arm_reg2, arm_reg2, arm_reg1);
+                if (set_flags)
+                    ADDS(arm_reg2, arm_reg2, arm_reg1);
+                else
+                    ADD(arm_reg2, arm_reg2, arm_reg1);
                 reg2_modified = true;
                 break;
             case V810_OP_SUB: // sub reg1, reg2
-                SUBS(arm_reg2, arm_reg2, arm_reg1);
-                INV_CARRY();
+                if (set_flags) {
+                    SUBS(arm_reg2, arm_reg2, arm_reg1);
+                    if (inst_cache[i].live_flags & DRC_FLAG_C)
+                        INV_CARRY();
+                } else {
+                    SUB(arm_reg2, arm_reg2, arm_reg1);
+                }
                 reg2_modified = true;
                 break;
             case V810_OP_CMP: // cmp reg1, reg2
+                // Nothing to do if the result is never checked
+                if (!set_flags)
+                    break;
                 if (inst_cache[i].reg1 == 0)
                     CMP_I(arm_reg2, 0, 0);
                 else if (inst_cache[i].reg2 == 0)
                     RSBS_I(0, arm_reg1, 0, 0);
                 else
                     CMP(arm_reg2, arm_reg1);
-                INV_CARRY();
+                if (inst_cache[i].live_flags & DRC_FLAG_C)
+                    INV_CARRY();
                 break;
             case V810_OP_SHL: // shl reg1, reg2
-                LSLS(arm_reg2, arm_reg2, arm_reg1);
+                if (set_flags)
+                    LSLS(arm_reg2, arm_reg2, arm_reg1);
+                else
+                    LSL(arm_reg2, arm_reg2, arm_reg1);
+                // The ARM shifts leave V alone
+                if (inst_cache[i].live_flags & DRC_FLAG_V)
+                    CLEAR_OVERFLOW();
                 reg2_modified = true;
                 break;
             case V810_OP_SHR: // shr reg1, reg2
-                LSRS(arm_reg2, arm_reg2, arm_reg1);
+                if (set_flags)
+                    LSRS(arm_reg2, arm_reg2, arm_reg1);
+                else
+                    LSR(arm_reg2, arm_reg2, arm_reg1);
+                if (inst_cache[i].live_flags & DRC_FLAG_V)
+                    CLEAR_OVERFLOW();
                 reg2_modified = true;
                 break;
             case V810_OP_SAR: // sar reg1, reg2
-                ASRS(arm_reg2, arm_reg2, arm_reg1);
+                if (set_flags)
+                    ASRS(arm_reg2, arm_reg2, arm_reg1);
+                else
+                    ASR(arm_reg2, arm_reg2, arm_reg1);
+                if (inst_cache[i].live_flags & DRC_FLAG_V)
+                    CLEAR_OVERFLOW();
                 reg2_modified = true;
                 break;
             case V810_OP_MUL: // mul reg1, reg2
-                SMULLS(arm_reg2, phys_regs[30], arm_reg2, arm_reg1);
+                if (set_flags)
+                    SMULLS(arm_reg2, phys_regs[30], arm_reg2, arm_reg1);
+                else
+                    SMULL(arm_reg2, phys_regs[30], arm_reg2, arm_reg1);
                 // If the 30th register isn't being used in the block, the high
                 // word of the multiplication will be in r0 (because
                 // phys_regs[30] == 0) and we'll have to save it manually
@@ -583,7 +923,10 @@ int drc_translateBlock(exec_block *block) {
                 reg2_modified = true;
                 break;
             case V810_OP_MULU: // mul reg1, reg2
-                UMULLS(arm_reg2, phys_regs[30], arm_reg2, arm_reg1);
+                if (set_flags)
+                    UMULLS(arm_reg2, phys_regs[30], arm_reg2, arm_reg1);
+                else
+                    UMULL(arm_reg2, phys_regs[30], arm_reg2, arm_reg1);
                 if (!phys_regs[30]) {
                     STR_IO(0, 11, 30 * 4);
                 }
@@ -636,19 +979,31 @@ int drc_translateBlock(exec_block *block) {
                     MOV(phys_regs[30], 0);
                 break;
             case V810_OP_OR: // or reg1, reg2
-                ORRS(arm_reg2, arm_reg2, arm_reg1);
+                if (set_flags)
+                    ORRS(arm_reg2, arm_reg2, arm_reg1);
+                else
+                    ORR(arm_reg2, arm_reg2, arm_reg1);
                 reg2_modified = true;
                 break;
             case V810_OP_AND: // and reg1, reg2
-                ANDS(arm_reg2, arm_reg2, arm_reg1);
+                if (set_flags)
+                    ANDS(arm_reg2, arm_reg2, arm_reg1);
+                else
+                    AND(arm_reg2, arm_reg2, arm_reg1);
                 reg2_modified = true;
                 break;
             case V810_OP_XOR: // xor reg1, reg2
-                EORS(arm_reg2, arm_reg2, arm_reg1);
+                if (set_flags)
+                    EORS(arm_reg2, arm_reg2, arm_reg1);
+                else
+                    EOR(arm_reg2, arm_reg2, arm_reg1);
                 reg2_modified = true;
                 break;
             case V810_OP_NOT: // not reg1, reg2
-                MVNS(arm_reg2, arm_reg1);
+                if (set_flags)
+                    MVNS(arm_reg2, arm_reg1);
+                else
+                    MVN(arm_reg2, arm_reg1);
                 reg2_modified = true;
                 break;
             case V810_OP_MOV_I: // mov imm5, reg2
@@ -658,46 +1013,67 @@ int drc_translateBlock(exec_block *block) {
                 break;
             case V810_OP_ADD_I: // add imm5, reg2
                 MOV_I(0, (sign_5(inst_cache[i].imm) & 0xFF), 8);
-                ADDS_IS(arm_reg2, arm_reg2, 0, ARM_SHIFT_ASR, 24);
+                if (set_flags)
+                    ADDS_IS(arm_reg2, arm_reg2, 0, ARM_SHIFT_ASR, 24);
+                else
+                    ADD_IS(arm_reg2, arm_reg2, 0, ARM_SHIFT_ASR, 24);
                 reg2_modified = true;
                 break;
             case V810_OP_CMP_I: // cmp imm5, reg2
+                if (!set_flags)
+                    break;
                 MOV_I(0, (sign_5(inst_cache[i].imm) & 0xFF), 8);
                 CMP_IS(arm_reg2, 0, ARM_SHIFT_ASR, 24);
-                INV_CARRY();
+                if (inst_cache[i].live_flags & DRC_FLAG_C)
+                    INV_CARRY();
                 reg2_modified = true;
                 break;
             case V810_OP_SHL_I: // shl imm5, reg2
                 // lsl reg2, reg2, #imm5
-                new_data_proc_imm_shift(ARM_COND_AL, ARM_OP_MOV, 1, 0, arm_reg2, inst_cache[i].imm, ARM_SHIFT_LSL, arm_reg2);
+                new_data_proc_imm_shift(ARM_COND_AL, ARM_OP_MOV, set_flags, 0, arm_reg2, inst_cache[i].imm, ARM_SHIFT_LSL, arm_reg2);
+                if (inst_cache[i].live_flags & DRC_FLAG_V)
+                    CLEAR_OVERFLOW();
                 reg2_modified = true;
                 break;
             case V810_OP_SHR_I: // shr imm5, reg2
                 // lsr reg2, reg2, #imm5
-                new_data_proc_imm_shift(ARM_COND_AL, ARM_OP_MOV, 1, 0, arm_reg2, inst_cache[i].imm, ARM_SHIFT_LSR, arm_reg2);
+                new_data_proc_imm_shift(ARM_COND_AL, ARM_OP_MOV, set_flags, 0, arm_reg2, inst_cache[i].imm, ARM_SHIFT_LSR, arm_reg2);
+                if (inst_cache[i].live_flags & DRC_FLAG_V)
+                    CLEAR_OVERFLOW();
                 reg2_modified = true;
                 break;
             case V810_OP_SAR_I: // sar imm5, reg2
                 // asr reg2, reg2, #imm5
-                new_data_proc_imm_shift(ARM_COND_AL, ARM_OP_MOV, 1, 0, arm_reg2, inst_cache[i].imm, ARM_SHIFT_ASR, arm_reg2);
+                new_data_proc_imm_shift(ARM_COND_AL, ARM_OP_MOV, set_flags, 0, arm_reg2, inst_cache[i].imm, ARM_SHIFT_ASR, arm_reg2);
+                if (inst_cache[i].live_flags & DRC_FLAG_V)
+                    CLEAR_OVERFLOW();
                 reg2_modified = true;
                 break;
             case V810_OP_ANDI: // andi imm16, reg1, reg2
                 MOV_I(0, (inst_cache[i].imm >> 8), 24);
                 ORR_I(0, (inst_cache[i].imm & 0xFF), 0);
-                ANDS(arm_reg2, arm_reg1, 0);
+                if (set_flags)
+                    ANDS(arm_reg2, arm_reg1, 0);
+                else
+                    AND(arm_reg2, arm_reg1, 0);
                 reg2_modified = true;
                 break;
             case V810_OP_XORI: // xori imm16, reg1, reg2
                 MOV_I(0, (inst_cache[i].imm >> 8), 24);
                 ORR_I(0, (inst_cache[i].imm & 0xFF), 0);
-                EORS(arm_reg2, arm_reg1, 0);
+                if (set_flags)
+                    EORS(arm_reg2, arm_reg1, 0);
+                else
+                    EOR(arm_reg2, arm_reg1, 0);
                 reg2_modified = true;
                 break;
             case V810_OP_ORI: // ori imm16, reg1, reg2
                 MOV_I(0, (inst_cache[i].imm >> 8), 24);
                 ORR_I(0, (inst_cache[i].imm & 0xFF), 0);
-                ORRS(arm_reg2, arm_reg1, 0);
+                if (set_flags)
+                    ORRS(arm_reg2, arm_reg1, 0);
+                else
+                    ORR(arm_reg2, arm_reg1, 0);
                 reg2_modified = true;
                 break;
             case V810_OP_ADDI: // addi imm16, reg1, reg2
@@ -705,19 +1081,15 @@ int drc_translateBlock(exec_block *block) {
                 ORR_I(0, (inst_cache[i].imm & 0xFF), 16);
                 // asr r0, r0, #16
                 new_data_proc_imm_shift(ARM_COND_AL, ARM_OP_MOV, 0, 0, 0, 16, ARM_SHIFT_ASR, 0);
-                ADDS(arm_reg2, arm_reg1, 0);
+                if (set_flags)
+                    ADDS(arm_reg2, arm_reg1, 0);
+                else
+                    ADD(arm_reg2, arm_reg1, 0);
                 reg2_modified = true;
                 break;
             case V810_OP_LD_B: // ld.b disp16 [reg1], reg2
             case V810_OP_IN_B: // in.b disp16 [reg1], reg2
-                LDW_I(0, sign_16(inst_cache[i].imm));
-                if (inst_cache[i].reg1 != 0) {
-                    ADD(0, 0, arm_reg1);
-                }
-
-                LDR_IO(1, 11, 69 * 4);
-                ADD_I(1, 1, DRC_RELOC_RBYTE*4, 0);
-                BLX(ARM_COND_AL, 1);
+                drc_emitLoadInst(&inst_cache[i], arm_reg1, 0, DRC_RELOC_RBYTE);
 
                 if (inst_cache[i].opcode == V810_OP_LD_B) {
                     // TODO: Implement sxtb
@@ -732,14 +1104,7 @@ int drc_translateBlock(exec_block *block) {
                 break;
             case V810_OP_LD_H: // ld.h disp16 [reg1], reg2
             case V810_OP_IN_H: // in.h disp16 [reg1], reg2
-                LDW_I(0, sign_16(inst_cache[i].imm));
-                if (inst_cache[i].reg1 != 0) {
-                    ADD(0, 0, arm_reg1);
-                }
-
-                LDR_IO(1, 11, 69 * 4);
-                ADD_I(1, 1, DRC_RELOC_RHWORD*4, 0);
-                BLX(ARM_COND_AL, 1);
+                drc_emitLoadInst(&inst_cache[i], arm_reg1, 1, DRC_RELOC_RHWORD);
 
                 if (inst_cache[i].opcode == V810_OP_LD_H) {
                     // TODO: Implement sxth
@@ -754,65 +1119,25 @@ int drc_translateBlock(exec_block *block) {
                 break;
             case V810_OP_LD_W: // ld.w disp16 [reg1], reg2
             case V810_OP_IN_W: // in.w disp16 [reg1], reg2
-                LDW_I(0, sign_16(inst_cache[i].imm));
-                if (inst_cache[i].reg1 != 0) {
-                    ADD(0, 0, arm_reg1);
-                }
-
-                LDR_IO(1, 11, 69 * 4);
-                ADD_I(1, 1, DRC_RELOC_RWORD*4, 0);
-                BLX(ARM_COND_AL, 1);
+                drc_emitLoadInst(&inst_cache[i], arm_reg1, 2, DRC_RELOC_RWORD);
 
                 MOV(arm_reg2, 0);
                 reg2_modified = true;
                 break;
             case V810_OP_ST_B:  // st.h reg2, disp16 [reg1]
             case V810_OP_OUT_B: // out.h reg2, disp16 [reg1]
-                LDW_I(0, sign_16(inst_cache[i].imm));
-                if (inst_cache[i].reg1 != 0) {
-                    ADD(0, 0, arm_reg1);
-                }
-
-                if (inst_cache[i].reg2 == 0)
-                    MOV_I(1, 0, 0);
-                else
-                    MOV(1, arm_reg2);
-
-                LDR_IO(2, 11, 69 * 4);
-                ADD_I(2, 2, DRC_RELOC_WBYTE*4, 0);
-                BLX(ARM_COND_AL, 2);
+                // arm_reg2 holds 0 if reg2 is the zero-register
+                drc_emitStoreInst(&inst_cache[i], arm_reg1, 0, arm_reg2, DRC_RELOC_WBYTE);
                 break;
             case V810_OP_ST_H:  // st.h reg2, disp16 [reg1]
             case V810_OP_OUT_H: // out.h reg2, disp16 [reg1]
-                LDW_I(0, sign_16(inst_cache[i].imm));
-                if (inst_cache[i].reg1 != 0) {
-                    ADD(0, 0, arm_reg1);
-                }
-
-                if (inst_cache[i].reg2 == 0)
-                    MOV_I(1, 0, 0);
-                else
-                    MOV(1, arm_reg2);
-
-                LDR_IO(2, 11, 69 * 4);
-                ADD_I(2, 2, DRC_RELOC_WHWORD*4, 0);
-                BLX(ARM_COND_AL, 2);
+                // arm_reg2 holds 0 if reg2 is the zero-register
+                drc_emitStoreInst(&inst_cache[i], arm_reg1, 1, arm_reg2, DRC_RELOC_WHWORD);
                 break;
             case V810_OP_ST_W:  // st.h reg2, disp16 [reg1]
             case V810_OP_OUT_W: // out.h reg2, disp16 [reg1]
-                LDW_I(0, sign_16(inst_cache[i].imm));
-                if (inst_cache[i].reg1 != 0) {
-                    ADD(0, 0, arm_reg1);
-                }
-
-                if (inst_cache[i].reg2 == 0)
-                    MOV_I(1, 0, 0);
-                else
-                    MOV(1, arm_reg2);
-
-                LDR_IO(2, 11, 69 * 4);
-                ADD_I(2, 2, DRC_RELOC_WWORD*4, 0);
-                BLX(ARM_COND_AL, 2);
+                // arm_reg2 holds 0 if reg2 is the zero-register
+                drc_emitStoreInst(&inst_cache[i], arm_reg1, 2, arm_reg2, DRC_RELOC_WWORD);
                 break;
             case V810_OP_LDSR: // ldsr reg2, regID
                 // Stores reg2 in v810_state->S_REG[regID]
@@ -914,7 +1239,7 @@ int drc_translateBlock(exec_block *block) {
         }
 
         if (inst_cache[i].save_flags) {
-            POP(1<<0);
+            LDR_IO(0, 11, 34 * 4);
             MSR(0);
         }
 
@@ -944,14 +1269,23 @@ int drc_translateBlock(exec_block *block) {
     }
 
     num_arm_inst = (unsigned int)(inst_ptr - trans_cache);
-    if ((cache_pos - cache_start + num_arm_inst)*4 > CACHE_SIZE) {
+#ifndef LITERAL_POOL
+    // Clean up the ARM code before assembling it. The V810 instructions move
+    // around, so their entrypoints have to be set again.
+    num_arm_inst = drc_peephole(trans_cache, num_arm_inst, inst_cache, num_v810_inst, exit_pos, num_exits);
+    for (i = 0; i < num_v810_inst; i++) {
+        if (!(inst_cache[i].const_info & DRC_CONST_NO_ENTRY))
+            drc_setEntry(inst_cache[i].PC, cache_start + block->phys_offset + inst_cache[i].start_pos, block);
+    }
+#endif
+    if (cache_pos + num_arm_inst > cache_start + (cur_region + 1)*(DRC_REGION_SIZE/4)) {
         err = DRC_ERR_CACHE_FULL;
         goto cleanup;
     }
 
     // Fourth pass: assemble and link
     for (i = 0; i < num_v810_inst; i++) {
-        HWORD start_pos = inst_cache[i].start_pos;
+        WORD start_pos = inst_cache[i].start_pos;
         for (j = start_pos; j < (start_pos + inst_cache[i].trans_size); j++) {
 #ifdef LITERAL_POOL
             if (trans_cache[j].needs_pool) {
@@ -973,7 +1307,24 @@ int drc_translateBlock(exec_block *block) {
     }
 
     block->size = num_arm_inst + pool_offset;
-    block->end_pc = v810_state->PC;
+
+    // Stores to these pages will have to drop the block
+    if ((start_PC >> 24) == 0x05) {
+        for (i = start_PC & ~0xFF; i < end_PC; i += 0x100)
+            v810_state->ram_code_pages[(i >> 8) & 0xFF] = 1;
+    }
+
+    // Register the exits so they can be linked once their targets exist
+    for (i = 0; i < num_exits && num_links < MAX_NUM_LINKS; i++) {
+        link_table[num_links].slot = cache_start + block->phys_offset + exit_pos[i];
+        link_table[num_links].target_PC = exit_PC[i];
+        link_table[num_links].block = block;
+        link_table[num_links].target = NULL;
+        link_table[num_links].block_ref = NULL;
+        link_table[num_links].linked = false;
+        num_links++;
+    }
+    drc_num_translated++;
 
 cleanup:
 #ifdef LITERAL_POOL
@@ -988,126 +1339,432 @@ cleanup:
 void drc_clearCache() {
     dprintf(0, "[DRC]: clearing cache...\n");
     cache_pos = cache_start;
+    cur_region = 0;
+    alt_cache_pos = cache_start + DRC_RAM_REGION*(DRC_REGION_SIZE/4);
+    alt_region = DRC_RAM_REGION;
     block_pos = 0;
+    num_free_blocks = 0;
+    num_pending_blocks = 0;
+    // All the linked branches are gone along with the blocks
+    num_links = 0;
+    big_start = big_end = 0;
 
     memset(cache_start, 0, CACHE_SIZE);
-    memset(rom_block_map, 0, sizeof(WORD)*((V810_ROM1.highaddr - V810_ROM1.lowaddr) >> 1));
-    memset(rom_entry_map, 0, sizeof(WORD)*((V810_ROM1.highaddr - V810_ROM1.lowaddr) >> 1));
-    memset(ram_block_map, 0, sizeof(WORD)*((V810_VB_RAM.highaddr - V810_VB_RAM.lowaddr) >> 1));
-    memset(rom_entry_map, 0, sizeof(WORD)*((V810_VB_RAM.highaddr - V810_VB_RAM.lowaddr) >> 1));
+    drc_freeMaps();
+    memset(v810_state->ram_code_pages, 0, sizeof(v810_state->ram_code_pages));
 
     FlushInvalidateCache();
 }
 
-// Returns the entrypoint for the V810 instruction in location loc if it exists
-// and NULL if it needs to be translated. If p_block != NULL it will point to
-// the block structure.
-WORD* drc_getEntry(WORD loc, exec_block **p_block) {
-    unsigned int map_pos;
+// Turns a linked exit back into a return to the dispatcher
+static void drc_unlink(drc_link* link) {
+    *link->slot = gen_ldst_multiple(ARM_COND_AL, 0, 1, 0, 1, 1, 13, 1 << 15);
+    link->target = NULL;
+    link->block_ref = NULL;
+    link->linked = false;
+}
+
+// Clears the entries that still point to a block and returns its structure to
+// the free list. The code itself is left in place.
+void drc_freeBlock(exec_block* block) {
+    exec_block* entry_block;
+    WORD PC;
+
+    for (PC = block->virt_loc; PC < block->end_pc; PC += 2) {
+        if (drc_getEntry(PC, &entry_block) != cache_start && entry_block == block)
+            drc_setEntry(PC, cache_start, block_ptr_start);
+    }
+
+    block->size = 0;
+    if (drc_executing)
+        pending_blocks[num_pending_blocks++] = (HWORD) (block - block_ptr_start);
+    else
+        free_blocks[num_free_blocks++] = (HWORD) (block - block_ptr_start);
+}
+
+// Removes the links out of freed blocks and unlinks the ones into freed blocks
+// or through a stub between stub_start and stub_end
+static void drc_pruneLinks(WORD* stub_start, WORD* stub_end) {
+    int i, j;
+
+    for (i = 0, j = 0; i < num_links; i++) {
+        drc_link* link = &link_table[i];
+        if (!link->block->size) {
+            // The block might still be running if it was invalidated by its
+            // own store, so make sure it goes back to the dispatcher
+            if (link->linked)
+                drc_unlink(link);
+            continue;
+        }
+        if (link->linked && (!link->target->size ||
+                (link->block_ref >= stub_start && link->block_ref < stub_end)))
+            drc_unlink(link);
+        link_table[j++] = *link;
+    }
+    num_links = j;
+}
+
+// Drops every block in a cache region along with the links that go into or out
+// of it, so the region can be reused
+void drc_evictRegion(int region) {
+    WORD* region_start = cache_start + region*(DRC_REGION_SIZE/4);
+    WORD* region_end = region_start + DRC_REGION_SIZE/4;
+    exec_block* block;
+    int i;
+
+    dprintf(0, "[DRC]: evicting region %d...\n", region);
+
+    for (i = 0; i < block_pos; i++) {
+        block = &block_ptr_start[i];
+        if (block->size && cache_start + block->phys_offset >= region_start && cache_start + block->phys_offset < region_end)
+            drc_freeBlock(block);
+    }
+    drc_pruneLinks(region_start, region_end);
+
+    if (region == DRC_RAM_REGION)
+        memset(v810_state->ram_code_pages, 0, sizeof(v810_state->ram_code_pages));
+
+    FlushInvalidateCache();
+}
+
+// Moves cache_pos to the start of the next region, evicting whatever was there.
+// The RAM region just starts over.
+void drc_nextRegion() {
+    if (cur_region != DRC_RAM_REGION)
+        cur_region = (cur_region + 1) % DRC_RAM_REGION;
+    drc_evictRegion(cur_region);
+    cache_pos = cache_start + cur_region*(DRC_REGION_SIZE/4);
+}
+
+// Switches cache_pos between the ROM regions and the RAM region
+static void drc_swapRegions() {
+    WORD* pos = cache_pos;
+    int region = cur_region;
+
+    cache_pos = alt_cache_pos;
+    cur_region = alt_region;
+    alt_cache_pos = pos;
+    alt_region = region;
+}
+
+// Tells if the VB RAM code from code_start to code_end overlaps the range from
+// start to end, which has been folded into the first mirror. The code can be
+// at any mirror, and wrap around into the next one.
+static bool drc_ramOverlaps(WORD code_start, WORD code_end, WORD start, WORD end) {
+    WORD ram_size = V810_VB_RAM.highaddr - V810_VB_RAM.lowaddr + 1;
+    WORD len = code_end - code_start;
+
+    code_start = V810_VB_RAM.lowaddr + ((code_start - V810_VB_RAM.lowaddr) & (ram_size - 1));
+    code_end = code_start + len;
+    return (code_start < end && code_end > start) || code_end - ram_size > start;
+}
+
+// Drops the code translated from the VB RAM pages between start and end after
+// they've been written to
+void drc_invalidateRam(WORD start, WORD end) {
+    exec_block* block;
+    bool found = false;
+    int i;
+
+    start = V810_VB_RAM.lowaddr + ((start - V810_VB_RAM.lowaddr) & V810_VB_RAM.highaddr & ~0xFF);
+    end = V810_VB_RAM.lowaddr + ((end - V810_VB_RAM.lowaddr - 1) & V810_VB_RAM.highaddr) + 1;
+    end = (end + 0xFF) & ~0xFF;
+
+    drc_lockCache();
+    for (i = 0; i < block_pos; i++) {
+        block = &block_ptr_start[i];
+        if (block->size && (block->virt_loc >> 24) == 0x05 && drc_ramOverlaps(block->virt_loc, block->end_pc, start, end)) {
+            drc_freeBlock(block);
+            found = true;
+        }
+    }
+    for (i = (start >> 8) & 0xFF; i < (int) (end - V810_VB_RAM.lowaddr) >> 8; i++)
+        v810_state->ram_code_pages[i] = 0;
+    // The new code might fit
+    if ((big_start >> 24) == 0x05 && drc_ramOverlaps(big_start, big_end, start, end))
+        big_start = big_end = 0;
+
+    if (found) {
+        dprintf(3, "[DRC]: invalidated RAM code 0x%x->0x%x\n", start, end);
+        drc_pruneLinks(NULL, NULL);
+        FlushInvalidateCache();
+    }
+    drc_unlockCache();
+}
+
+// Patches every unlinked exit whose target has been translated into a direct
+// branch. The branch goes through a stub placed after the last block that
+// reconciles the register maps of both blocks and updates the block pointer
+// postexec uses to save the cached registers.
+void drc_linkBlocks() {
+    int i, j, k;
+    WORD* entry;
+    WORD* stub;
+    exec_block* src;
+    exec_block* target;
+    arm_inst stub_cache[LINK_STUB_SIZE];
+    bool patched = false;
+
+    // Every block has to come back to drc_run to be checked
+    if (tVBOpt.LOCKSTEP)
+        return;
+
+    for (i = 0; i < num_links; i++) {
+        if (link_table[i].linked)
+            continue;
+
+        entry = drc_getEntry(link_table[i].target_PC, &target);
+        if (!entry || entry == cache_start)
+            continue;
+        if (cache_pos + LINK_STUB_SIZE > cache_start + (cur_region + 1)*(DRC_REGION_SIZE/4))
+            break;
+
+        src = link_table[i].block;
+        inst_ptr = &stub_cache[0];
+
+        // Save the registers that aren't kept in place by the target block...
+        for (j = 0; j < ARM_NUM_CACHE_REGS; j++) {
+            if (src->reg_map[j] != 32 && src->reg_map[j] != target->reg_map[j])
+                STR_IO(j + ARM_CACHE_REG_START, 11, src->reg_map[j] * 4);
+        }
+        // ...and load the ones it expects
+        for (j = 0; j < ARM_NUM_CACHE_REGS; j++) {
+            if (target->reg_map[j] != 32 && target->reg_map[j] != src->reg_map[j])
+                LDR_IO(j + ARM_CACHE_REG_START, 11, target->reg_map[j] * 4);
+        }
+        // The block pointer is right above the postexec return address. It's
+        // loaded with a fixed sequence so it can be relocated.
+        stub = cache_pos;
+        link_table[i].block_ref = stub + (inst_ptr - stub_cache);
+        LDW_I_FIXED(0, (WORD) target);
+        STR_IO(0, 13, 4);
+        new_branch_link(ARM_COND_AL, 0, 0);
+
+        for (k = 0; k < (inst_ptr - stub_cache); k++) {
+            if (stub_cache[k].type == ARM_BRANCH_LINK)
+                stub_cache[k].b_bl.imm = (WORD) (entry - &stub[k] - 2) & 0xffffff;
+            drc_assemble(&stub[k], &stub_cache[k]);
+        }
+        cache_pos += k;
+
+        *link_table[i].slot = gen_branch_link(ARM_COND_AL, 0, (WORD) (stub - link_table[i].slot - 2));
+        link_table[i].target = target;
+        link_table[i].linked = true;
+        patched = true;
+    }
+
+    if (patched)
+        FlushInvalidateCache();
+}
+
+// Returns the slot in the page directory for location loc, or NULL if it isn't
+// in RAM or ROM. map_pos is set to the position inside the page.
+static drc_map_page** drc_getMapPage(WORD loc, unsigned int *map_pos) {
+    WORD offset;
 
     switch (loc>>24) {
         case 5:
-            map_pos = ((loc-V810_VB_RAM.lowaddr)&V810_VB_RAM.highaddr)>>1;
-            if (p_block)
-                *p_block = block_ptr_start + ram_block_map[map_pos];
-            return cache_start + ram_entry_map[map_pos];
+            offset = (loc-V810_VB_RAM.lowaddr)&V810_VB_RAM.highaddr;
+            *map_pos = (offset & (DRC_MAP_PAGE_SIZE-1))>>1;
+            return &ram_map[offset/DRC_MAP_PAGE_SIZE];
         case 7:
-            map_pos = ((loc-V810_ROM1.lowaddr)&V810_ROM1.highaddr)>>1;
-            if (p_block)
-                *p_block = block_ptr_start + rom_block_map[map_pos];
-            return cache_start + rom_entry_map[map_pos];
+            offset = (loc-V810_ROM1.lowaddr)&V810_ROM1.highaddr;
+            *map_pos = (offset & (DRC_MAP_PAGE_SIZE-1))>>1;
+            return &rom_map[offset/DRC_MAP_PAGE_SIZE];
         default:
             return NULL;
     }
 }
 
+// Frees all the pages of the entry maps
+void drc_freeMaps() {
+    unsigned int i;
+
+    for (i = 0; i < (V810_ROM1.highaddr - V810_ROM1.lowaddr)/DRC_MAP_PAGE_SIZE + 1; i++) {
+        free(rom_map[i]);
+        rom_map[i] = NULL;
+    }
+    for (i = 0; i < (V810_VB_RAM.highaddr - V810_VB_RAM.lowaddr)/DRC_MAP_PAGE_SIZE + 1; i++) {
+        free(ram_map[i]);
+        ram_map[i] = NULL;
+    }
+}
+
+// Returns the entrypoint for the V810 instruction in location loc if it exists
+// and cache_start if it needs to be translated, or NULL if loc is outside of
+// RAM and ROM. If p_block != NULL it will point to the block structure.
+WORD* drc_getEntry(WORD loc, exec_block **p_block) {
+    drc_map_page** page;
+    exec_block* block;
+    unsigned int map_pos;
+
+    page = drc_getMapPage(loc, &map_pos);
+    if (!page)
+        return NULL;
+    if (!*page || !(*page)->block[map_pos]) {
+        if (p_block)
+            *p_block = block_ptr_start;
+        return cache_start;
+    }
+
+    block = block_ptr_start + (*page)->block[map_pos] - 1;
+    if (p_block)
+        *p_block = block;
+    return cache_start + block->phys_offset + (*page)->entry[map_pos];
+}
+
 // Sets a new entrypoint for the V810 instruction in location loc and the
-// corresponding block
+// corresponding block. Setting it to cache_start marks it as untranslated.
 void drc_setEntry(WORD loc, WORD *entry, exec_block *block) {
+    drc_map_page** page;
     unsigned int map_pos;
 
-    switch (loc>>24) {
-        case 5:
-            map_pos = ((loc-V810_VB_RAM.lowaddr)&V810_VB_RAM.highaddr)>>1;
-            ram_block_map[map_pos] = block - block_ptr_start;
-            ram_entry_map[map_pos] = entry - cache_start;
-            break;
-        case 7:
-            map_pos = ((loc-V810_ROM1.lowaddr)&V810_ROM1.highaddr)>>1;
-            rom_block_map[map_pos] = block - block_ptr_start;
-            rom_entry_map[map_pos] = entry - cache_start;
-            break;
-        default:
+    page = drc_getMapPage(loc, &map_pos);
+    if (!page)
+        return;
+
+    if (entry == cache_start) {
+        if (*page)
+            (*page)->block[map_pos] = 0;
+        return;
+    }
+
+    if (!*page) {
+        *page = calloc(1, sizeof(drc_map_page));
+        if (!*page)
             return;
     }
+    (*page)->block[map_pos] = (HWORD) (block - block_ptr_start + 1);
+    (*page)->entry[map_pos] = (HWORD) (entry - (cache_start + block->phys_offset));
 }
 
 // Initialize the dynarec
 void drc_init() {
     // V810 instructions are 16-bit aligned, so we can ignore the last bit of the PC
-    rom_block_map = calloc(sizeof(WORD), (V810_ROM1.highaddr - V810_ROM1.lowaddr) >> 1);
-    rom_entry_map = calloc(sizeof(WORD), (V810_ROM1.highaddr - V810_ROM1.lowaddr) >> 1);
-    ram_block_map = calloc(sizeof(WORD), (V810_VB_RAM.highaddr - V810_VB_RAM.lowaddr) >> 1);
-    ram_entry_map = calloc(sizeof(WORD), (V810_VB_RAM.highaddr - V810_VB_RAM.lowaddr) >> 1);
+    rom_map = calloc(sizeof(drc_map_page*), (V810_ROM1.highaddr - V810_ROM1.lowaddr)/DRC_MAP_PAGE_SIZE + 1);
+    ram_map = calloc(sizeof(drc_map_page*), (V810_VB_RAM.highaddr - V810_VB_RAM.lowaddr)/DRC_MAP_PAGE_SIZE + 1);
     block_ptr_start = linearAlloc(MAX_NUM_BLOCKS*sizeof(exec_block));
+    link_table = calloc(sizeof(drc_link), MAX_NUM_LINKS);
 
     hbHaxInit();
 
-    if (tVBOpt.DYNAREC) {
-        cache_start = memalign(0x1000, CACHE_SIZE);
+    cache_start = memalign(0x1000, CACHE_SIZE);
+    if (tVBOpt.DYNAREC)
         ReprotectMemory(cache_start, CACHE_SIZE/0x1000, 0x7);
-        FlushInvalidateCache();
-    } else {
-        // cache_start = &cache_dump_bin;
-        drc_loadSavedCache();
-    }
-
     cache_pos = cache_start;
+
+    // Start with a warm cache if there is a valid one for this ROM. Its blocks
+    // are linked, which the lockstep checks can't have.
+    if (tVBOpt.LOCKSTEP || drc_loadCache())
+        drc_clearCache();
+    FlushInvalidateCache();
+    if (tVBOpt.LOCKSTEP)
+        drc_lockstepInit();
+
     dprintf(0, "[DRC]: cache_start = %p\n", cache_start);
+
+    drc_startWorker();
 }
 
 // Cleanup and exit
 void drc_exit() {
+    drc_stopWorker();
+    if (tVBOpt.LOCKSTEP)
+        drc_lockstepExit();
     if (tVBOpt.DYNAREC)
-        free(cache_start);
-    free(rom_block_map);
-    free(rom_entry_map);
-    free(ram_block_map);
-    free(ram_entry_map);
+        drc_saveCache();
+    free(cache_start);
+    drc_freeMaps();
+    free(rom_map);
+    free(ram_map);
+    free(link_table);
     linearFree(block_ptr_start);
     hbHaxExit();
 }
 
 exec_block* drc_getNextBlockStruct() {
-    if (block_pos > MAX_NUM_BLOCKS)
+    if (num_free_blocks)
+        return &block_ptr_start[free_blocks[--num_free_blocks]];
+    if (block_pos >= MAX_NUM_BLOCKS)
         return NULL;
     return &block_ptr_start[block_pos++];
 }
 
+// Called by the idle loops with r10. Returns it moved forward to the next
+// scheduled event.
+int drc_skipIdle(int cycles) {
+    return (cycles < v810_state->next_event) ? v810_state->next_event : cycles;
+}
+
 // Run V810 code until the next frame interrupt
 int drc_run() {
-    static unsigned int clocks;
     exec_block* cur_block = NULL;
     WORD* entrypoint;
     WORD entry_PC;
+    bool in_ram;
+    int i, err;
+
+    while (true) {
+        // Service whatever came due during the last block, until the frame
+        // is done
+        sched_run(v810_state->cycles, v810_state->PC);
+        if (v810_state->ret)
+            break;
 
-    while (!serviceDisplayInt(clocks, v810_state->PC)) {
-        serviceInt(clocks, v810_state->PC);
+        // Nothing runs while halted, so go straight to the next event
+        if (v810_state->halted) {
+            v810_state->cycles += v810_state->next_event;
+            continue;
+        }
 
         v810_state->PC &= V810_ROM1.highaddr;
         entry_PC = v810_state->PC;
 
         // Try to find a cached block
         // TODO: make sure we have enough free space
+        drc_lockCache();
         entrypoint = drc_getEntry(v810_state->PC, &cur_block);
-        if (tVBOpt.DYNAREC && (entrypoint == cache_start)) {
-            cur_block = drc_getNextBlockStruct();
-            if (!cur_block)
+        if (tVBOpt.DYNAREC && (entrypoint == cache_start) && (entry_PC < big_start || entry_PC >= big_end)) {
+            // Evict the oldest regions until a block structure is free
+            for (i = 0; i < DRC_NUM_REGIONS && !(cur_block = drc_getNextBlockStruct()); i++)
+                drc_nextRegion();
+            if (!cur_block) {
+                drc_unlockCache();
                 return DRC_ERR_NO_BLOCKS;
+            }
+
+            // RAM code goes in a region of its own so it can be thrown away
+            // without touching the ROM code
+            in_ram = (entry_PC >> 24) == 0x05;
+            if (in_ram)
+                drc_swapRegions();
             cur_block->phys_offset = (uint32_t) (cache_pos - cache_start);
 
-            if (drc_translateBlock(cur_block) == DRC_ERR_CACHE_FULL) {
-                drc_clearCache();
+            PROF_START(PROF_TRANSLATE);
+            err = drc_translateBlock(cur_block, entry_PC);
+            PROF_STOP(PROF_TRANSLATE);
+            if (err == DRC_ERR_CACHE_FULL) {
+                // Drop the entries set for the unfinished block
+                drc_freeBlock(cur_block);
+                // Not even an empty region is big enough, so the interpreter
+                // runs that code from now on
+                if (cache_pos == cache_start + cur_region*(DRC_REGION_SIZE/4)) {
+                    dprintf(0, "[DRC]: block 0x%x->0x%x doesn't fit in a region\n", cur_block->virt_loc, cur_block->end_pc);
+                    big_start = cur_block->virt_loc;
+                    big_end = cur_block->end_pc;
+                    // Stores to it have to forget about it (see drc_invalidateRam)
+                    if (in_ram) {
+                        for (i = big_start & ~0xFF; i < big_end; i += 0x100)
+                            v810_state->ram_code_pages[(i >> 8) & 0xFF] = 1;
+                        drc_swapRegions();
+                    }
+                    drc_unlockCache();
+                    continue;
+                }
+                drc_nextRegion();
+                if (in_ram)
+                    drc_swapRegions();
+                drc_unlockCache();
                 continue;
             }
 
@@ -1116,49 +1773,441 @@ int drc_run() {
             FlushInvalidateCache();
 
             cache_pos += cur_block->size;
+            drc_linkBlocks();
+            if (in_ram)
+                drc_swapRegions();
             entrypoint = drc_getEntry(entry_PC, NULL);
+        } else if (entrypoint == cache_start) {
+            // Not cached and we can't translate it, so interpret it instead
+            drc_unlockCache();
+            PROF_START(PROF_EXECUTE);
+            err = v810_interpBlock();
+            PROF_STOP(PROF_EXECUTE);
+            if (err)
+                return err;
+            continue;
+        }
+        // Code from the worker thread isn't in our instruction cache yet
+        if (spec_unflushed) {
+            spec_unflushed = false;
+            FlushInvalidateCache();
         }
         dprintf(3, "[DRC]: entry - 0x%x (0x%x)\n", entry_PC, (int)(entrypoint - cache_start)*4);
-        if ((entrypoint < cache_start) || (entrypoint > cache_start + CACHE_SIZE))
+        if ((entrypoint < cache_start) || (entrypoint > cache_start + CACHE_SIZE)) {
+            drc_unlockCache();
             return DRC_ERR_BAD_ENTRY;
+        }
+        drc_executing = true;
+        drc_unlockCache();
 
-        v810_state->cycles = clocks;
+        if (tVBOpt.LOCKSTEP)
+            drc_lockstepBegin();
+        PROF_START(PROF_EXECUTE);
         drc_executeBlock(entrypoint, cur_block);
+        PROF_STOP(PROF_EXECUTE);
+
+        // Nothing refers to the blocks freed in the meantime anymore
+        drc_lockCache();
+        drc_executing = false;
+        while (num_pending_blocks)
+            free_blocks[num_free_blocks++] = pending_blocks[--num_pending_blocks];
+        drc_unlockCache();
+        if (tVBOpt.LOCKSTEP && (err = drc_lockstepCheck(entry_PC)))
+            return err;
 
         v810_state->PC &= V810_ROM1.highaddr;
-        clocks = v810_state->cycles;
 
         dprintf(4, "[DRC]: end - 0x%x\n", v810_state->PC);
         if (v810_state->PC < V810_VB_RAM.lowaddr || v810_state->PC > V810_ROM1.highaddr)
             return DRC_ERR_BAD_PC;
+    }
+    v810_state->ret = 0;
+
+    return 0;
+}
+
+// PCs drc_precompile still has to look at
+static WORD* aot_stack = NULL;
+static unsigned int aot_sp = 0;
+static unsigned int aot_stack_size = 0;
 
-        if (v810_state->ret) {
-            v810_state->ret = 0;
+static void drc_aotPush(WORD PC) {
+    WORD* stack;
+
+    PC &= V810_ROM1.highaddr;
+    if ((PC >> 24) != 0x07)
+        return;
+    if (aot_sp == aot_stack_size) {
+        stack = realloc(aot_stack, (aot_stack_size + 0x1000)*sizeof(WORD));
+        if (!stack)
+            return;
+        aot_stack = stack;
+        aot_stack_size += 0x1000;
+    }
+    aot_stack[aot_sp++] = PC;
+}
+
+// Translates all the ROM code reachable from the given PCs by following the
+// direct branches and calls, so it can be saved with drc_saveCache. Code that
+// is only reached through registers is left for drc_run. The last ROM region
+// is kept free for that. Returns the number of blocks translated, or -1 if the
+// backend has no cache files.
+int drc_precompile(const WORD* roots, int num_roots) {
+    exec_block* block;
+    WORD PC;
+    int num_blocks = 0;
+    int i;
+
+    for (i = 0; i < num_roots; i++)
+        drc_aotPush(roots[i]);
+    drc_queueHook = drc_aotPush;
+
+    while (aot_sp) {
+        PC = aot_stack[--aot_sp];
+        if (drc_getEntry(PC, NULL) != cache_start)
+            continue;
+        block = drc_getNextBlockStruct();
+        if (!block) {
+            dprintf(0, "[DRC]: out of blocks\n");
             break;
         }
+        block->phys_offset = (WORD) (cache_pos - cache_start);
+        if (drc_translateBlock(block, PC) == DRC_ERR_CACHE_FULL) {
+            drc_freeBlock(block);
+            // drc_run interprets the ones that don't fit anywhere
+            if (cache_pos == cache_start + cur_region*(DRC_REGION_SIZE/4))
+                continue;
+            if (cur_region + 2 >= DRC_RAM_REGION) {
+                dprintf(0, "[DRC]: out of cache space\n");
+                break;
+            }
+            // The next region is still empty
+            drc_nextRegion();
+            drc_aotPush(PC);
+            continue;
+        }
+        cache_pos += block->size;
+        drc_linkBlocks();
+        num_blocks++;
     }
 
-    return 0;
+    drc_queueHook = NULL;
+    free(aot_stack);
+    aot_stack = NULL;
+    aot_sp = aot_stack_size = 0;
+    FlushInvalidateCache();
+
+    return num_blocks;
+}
+
+// Gets the path of the translation cache file for the current ROM
+static void drc_getCachePath(char* path) {
+    sprintf(path, "%08lX.drc", tVBOpt.CRC32);
+}
+
+// FNV-1a, used to check the integrity of the cache file
+static WORD drc_hash(WORD hash, const void* data, size_t size) {
+    const BYTE* bytes = data;
+    size_t i;
+    for (i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 16777619;
+    }
+    return hash;
+}
+
+// Rewrites the block pointer loaded by a link stub
+static void drc_relocBlockRef(WORD* site, exec_block* block) {
+    arm_inst reloc_cache[4];
+    int i;
+
+    inst_ptr = &reloc_cache[0];
+    LDW_I_FIXED(0, (WORD) block);
+    for (i = 0; i < 4; i++)
+        drc_assemble(&site[i], &reloc_cache[i]);
 }
 
-void drc_loadSavedCache() {
+// Loads the translation cache file for the current ROM. The code is mapped
+// straight into the cache, and the entries, blocks and links are restored.
+// Returns 0 on success. On failure, the cache is left in an undefined state and
+// has to be cleared.
+int drc_loadCache() {
+    char path[32];
     FILE* f;
-    int ret;
-    f = fopen("rom_block_map", "r");
-    ret = fread(rom_block_map, sizeof(WORD), (V810_ROM1.highaddr - V810_ROM1.lowaddr) >> 1, f);
-    fclose(f);
-    f = fopen("rom_entry_map", "r");
-    ret = fread(rom_entry_map, sizeof(WORD), (V810_ROM1.highaddr - V810_ROM1.lowaddr) >> 1, f);
-    fclose(f);
-    f = fopen("ram_block_map", "r");
-    ret = fread(ram_block_map, sizeof(WORD), (V810_VB_RAM.highaddr - V810_VB_RAM.lowaddr) >> 1, f);
-    fclose(f);
-    f = fopen("ram_entry_map", "r");
-    ret = fread(ram_entry_map, sizeof(WORD), (V810_VB_RAM.highaddr - V810_VB_RAM.lowaddr) >> 1, f);
+    drc_cache_header header;
+    exec_block* blocks = NULL;
+    drc_cache_entry* entries = NULL;
+    drc_cache_link* links = NULL;
+    drc_cache_reloc* relocs = NULL;
+    WORD code_bytes, checksum;
+    long file_size;
+    unsigned int i;
+    int err = DRC_ERR_BAD_CACHE;
+
+    drc_getCachePath(path);
+    f = fopen(path, "rb");
+    if (!f)
+        return DRC_ERR_BAD_CACHE;
+
+    if (fread(&header, sizeof(header), 1, f) != 1)
+        goto cleanup;
+
+    // Reject anything that wasn't generated by this build for this ROM
+    if (header.magic != DRC_CACHE_MAGIC || header.version != DRC_CACHE_VERSION ||
+            strncmp(header.build_id, drc_build_id, sizeof(drc_build_id)) ||
+            header.cache_size != CACHE_SIZE || header.crc32 != (WORD) tVBOpt.CRC32 ||
+            header.rom_size != V810_ROM1.highaddr - V810_ROM1.lowaddr + 1 ||
+            header.code_size > CACHE_SIZE/4 || header.cache_pos > header.code_size ||
+            header.cur_region >= DRC_RAM_REGION || header.cache_pos < header.cur_region*(DRC_REGION_SIZE/4) ||
+            header.cache_pos > (header.cur_region + 1)*(DRC_REGION_SIZE/4) || header.num_blocks > MAX_NUM_BLOCKS ||
+            header.num_links > MAX_NUM_LINKS || header.num_relocs > header.num_links ||
+            header.num_entries > (header.rom_size >> 1)) {
+        dprintf(0, "[DRC]: stale cache file %s\n", path);
+        goto cleanup;
+    }
+
+    code_bytes = (header.code_size*4 + 0xFFF) & ~0xFFF;
+    fseek(f, 0, SEEK_END);
+    file_size = ftell(f);
+    if (file_size != DRC_CACHE_CODE_OFFSET + code_bytes +
+            header.num_blocks*sizeof(exec_block) + header.num_entries*sizeof(drc_cache_entry) +
+            header.num_links*sizeof(drc_cache_link) + header.num_relocs*sizeof(drc_cache_reloc)) {
+        dprintf(0, "[DRC]: truncated cache file %s\n", path);
+        goto cleanup;
+    }
+
+    blocks = malloc(header.num_blocks*sizeof(exec_block) + 1);
+    entries = malloc(header.num_entries*sizeof(drc_cache_entry) + 1);
+    links = malloc(header.num_links*sizeof(drc_cache_link) + 1);
+    relocs = malloc(header.num_relocs*sizeof(drc_cache_reloc) + 1);
+    if (!blocks || !entries || !links || !relocs)
+        goto cleanup;
+
+    fseek(f, DRC_CACHE_CODE_OFFSET + code_bytes, SEEK_SET);
+    if (fread(blocks, sizeof(exec_block), header.num_blocks, f) != header.num_blocks ||
+            fread(entries, sizeof(drc_cache_entry), header.num_entries, f) != header.num_entries ||
+            fread(links, sizeof(drc_cache_link), header.num_links, f) != header.num_links ||
+            fread(relocs, sizeof(drc_cache_reloc), header.num_relocs, f) != header.num_relocs)
+        goto cleanup;
+
+    if (code_bytes && MapFileToMemory(f, DRC_CACHE_CODE_OFFSET, cache_start, code_bytes))
+        goto cleanup;
+
+    checksum = drc_hash(2166136261U, cache_start, code_bytes);
+    checksum = drc_hash(checksum, blocks, header.num_blocks*sizeof(exec_block));
+    checksum = drc_hash(checksum, entries, header.num_entries*sizeof(drc_cache_entry));
+    checksum = drc_hash(checksum, links, header.num_links*sizeof(drc_cache_link));
+    checksum = drc_hash(checksum, relocs, header.num_relocs*sizeof(drc_cache_reloc));
+    if (checksum != header.checksum) {
+        dprintf(0, "[DRC]: corrupt cache file %s\n", path);
+        goto cleanup;
+    }
+
+    // Make sure nothing points outside of the cache before using it
+    for (i = 0; i < header.num_blocks; i++) {
+        if (blocks[i].phys_offset + blocks[i].size > header.code_size)
+            goto cleanup;
+    }
+    for (i = 0; i < header.num_entries; i++) {
+        if (entries[i].entry >= header.code_size || entries[i].block >= header.num_blocks ||
+                (entries[i].PC >> 24) != 0x07 || entries[i].entry < blocks[entries[i].block].phys_offset ||
+                entries[i].entry >= blocks[entries[i].block].phys_offset + blocks[entries[i].block].size)
+            goto cleanup;
+    }
+    for (i = 0; i < header.num_links; i++) {
+        if (links[i].slot >= header.code_size || links[i].block >= header.num_blocks ||
+                (links[i].target != DRC_CACHE_NONE && (links[i].target >= header.num_blocks ||
+                links[i].block_ref + 6 > header.code_size)))
+            goto cleanup;
+    }
+    for (i = 0; i < header.num_relocs; i++) {
+        if (relocs[i].site + 4 > header.code_size || relocs[i].block >= header.num_blocks)
+            goto cleanup;
+    }
+
+    drc_clearCache();
+
+    memcpy(block_ptr_start, blocks, header.num_blocks*sizeof(exec_block));
+    block_pos = header.num_blocks;
+    // RAM code isn't kept, so its blocks are free along with the evicted ones
+    for (i = 0; i < header.num_blocks; i++) {
+        if (!block_ptr_start[i].size || (block_ptr_start[i].virt_loc >> 24) != 0x07) {
+            block_ptr_start[i].size = 0;
+            free_blocks[num_free_blocks++] = (HWORD) i;
+        }
+    }
+    for (i = 0; i < header.num_entries; i++)
+        drc_setEntry(entries[i].PC, cache_start + entries[i].entry, block_ptr_start + entries[i].block);
+
+    for (i = 0; i < header.num_links; i++) {
+        link_table[i].slot = cache_start + links[i].slot;
+        link_table[i].target_PC = links[i].target_PC;
+        link_table[i].block = block_ptr_start + links[i].block;
+        if (links[i].target != DRC_CACHE_NONE) {
+            link_table[i].target = block_ptr_start + links[i].target;
+            link_table[i].block_ref = cache_start + links[i].block_ref;
+            link_table[i].linked = true;
+        } else {
+            // Go back to the dispatcher until it's linked again
+            drc_unlink(&link_table[i]);
+        }
+    }
+    num_links = header.num_links;
+
+    for (i = 0; i < header.num_relocs; i++)
+        drc_relocBlockRef(cache_start + relocs[i].site, block_ptr_start + relocs[i].block);
+
+    cache_pos = cache_start + header.cache_pos;
+    cur_region = header.cur_region;
+    // Stubs in the RAM region would be overwritten by new RAM code
+    drc_evictRegion(DRC_RAM_REGION);
+    dprintf(0, "[DRC]: loaded %d blocks from %s\n", block_pos, path);
+    err = 0;
+
+cleanup:
+    free(blocks);
+    free(entries);
+    free(links);
+    free(relocs);
     fclose(f);
-    f = fopen("block_heap", "r");
-    ret = fread(block_ptr_start, sizeof(exec_block*), MAX_NUM_BLOCKS, f);
+    return err;
+}
+
+// Saves the translation cache for the current ROM. Code translated from RAM
+// isn't kept since RAM will have different contents next time, and links to it
+// are saved unlinked. It's written to a temporary file first since the old
+// file might still be mapped.
+int drc_saveCache() {
+    char path[32], tmp_path[36];
+    FILE* f;
+    drc_cache_header header;
+    drc_cache_entry entry;
+    drc_cache_link link;
+    drc_cache_reloc reloc;
+    exec_block* block;
+    WORD page, code_bytes, checksum;
+    BYTE zero = 0;
+    int i;
+
+    if (cache_pos == cache_start)
+        return 0;
+
+    drc_getCachePath(path);
+    sprintf(tmp_path, "%s.tmp", path);
+    f = fopen(tmp_path, "wb");
+    if (!f)
+        return DRC_ERR_BAD_CACHE;
+
+    memset(&header, 0, sizeof(header));
+    header.magic = DRC_CACHE_MAGIC;
+    header.version = DRC_CACHE_VERSION;
+    strncpy(header.build_id, drc_build_id, sizeof(header.build_id));
+    header.cache_size = CACHE_SIZE;
+    header.crc32 = (WORD) tVBOpt.CRC32;
+    header.rom_size = V810_ROM1.highaddr - V810_ROM1.lowaddr + 1;
+    // Once the cache has wrapped around there can be live code past cache_pos
+    header.code_size = (WORD) (cache_pos - cache_start);
+    for (i = 0; i < block_pos; i++) {
+        if (block_ptr_start[i].size && (block_ptr_start[i].virt_loc >> 24) == 0x07 &&
+                block_ptr_start[i].phys_offset + block_ptr_start[i].size > header.code_size)
+            header.code_size = block_ptr_start[i].phys_offset + block_ptr_start[i].size;
+    }
+    for (i = 0; i < num_links; i++) {
+        if (link_table[i].linked && link_table[i].block_ref + 6 > cache_start + header.code_size)
+            header.code_size = (WORD) (link_table[i].block_ref + 6 - cache_start);
+    }
+    header.cache_pos = (WORD) (cache_pos - cache_start);
+    header.cur_region = cur_region;
+    header.num_blocks = block_pos;
+    // The header is written again once we have the counts and the checksum
+    fwrite(&header, sizeof(header), 1, f);
+
+    code_bytes = (header.code_size*4 + 0xFFF) & ~0xFFF;
+    fseek(f, DRC_CACHE_CODE_OFFSET, SEEK_SET);
+    fwrite(cache_start, 4, header.code_size, f);
+    for (i = header.code_size*4; i < code_bytes; i++)
+        fwrite(&zero, 1, 1, f);
+    checksum = drc_hash(2166136261U, cache_start, header.code_size*4);
+    for (i = header.code_size*4; i < code_bytes; i++)
+        checksum = drc_hash(checksum, &zero, 1);
+
+    fwrite(block_ptr_start, sizeof(exec_block), block_pos, f);
+    checksum = drc_hash(checksum, block_ptr_start, block_pos*sizeof(exec_block));
+
+    // Only the pages of the entry map that have been allocated can have entries
+    for (page = 0; page < (V810_ROM1.highaddr - V810_ROM1.lowaddr)/DRC_MAP_PAGE_SIZE + 1; page++) {
+        if (!rom_map[page])
+            continue;
+        for (i = 0; i < DRC_MAP_PAGE_SIZE/2; i++) {
+            if (!rom_map[page]->block[i])
+                continue;
+            block = block_ptr_start + rom_map[page]->block[i] - 1;
+            entry.PC = V810_ROM1.lowaddr + page*DRC_MAP_PAGE_SIZE + i*2;
+            entry.entry = block->phys_offset + rom_map[page]->entry[i];
+            entry.block = (WORD) (block - block_ptr_start);
+            fwrite(&entry, sizeof(entry), 1, f);
+            checksum = drc_hash(checksum, &entry, sizeof(entry));
+            header.num_entries++;
+        }
+    }
+
+    for (i = 0; i < num_links; i++) {
+        if ((link_table[i].block->virt_loc >> 24) != 0x07)
+            continue;
+        link.slot = (WORD) (link_table[i].slot - cache_start);
+        link.target_PC = link_table[i].target_PC;
+        link.block = (WORD) (link_table[i].block - block_ptr_start);
+        if (link_table[i].linked && (link_table[i].target_PC >> 24) == 0x07) {
+            link.target = (WORD) (link_table[i].target - block_ptr_start);
+            link.block_ref = (WORD) (link_table[i].block_ref - cache_start);
+        } else {
+            link.target = DRC_CACHE_NONE;
+            link.block_ref = DRC_CACHE_NONE;
+        }
+        fwrite(&link, sizeof(link), 1, f);
+        checksum = drc_hash(checksum, &link, sizeof(link));
+        header.num_links++;
+    }
+
+    for (i = 0; i < num_links; i++) {
+        if ((link_table[i].block->virt_loc >> 24) != 0x07 || !link_table[i].linked ||
+                !link_table[i].block_ref || (link_table[i].target_PC >> 24) != 0x07)
+            continue;
+        reloc.site = (WORD) (link_table[i].block_ref - cache_start);
+        reloc.block = (WORD) (link_table[i].target - block_ptr_start);
+        fwrite(&reloc, sizeof(reloc), 1, f);
+        checksum = drc_hash(checksum, &reloc, sizeof(reloc));
+        header.num_relocs++;
+    }
+
+    header.checksum = checksum;
+    fseek(f, 0, SEEK_SET);
+    fwrite(&header, sizeof(header), 1, f);
     fclose(f);
+
+    remove(path);
+    if (rename(tmp_path, path))
+        return DRC_ERR_BAD_CACHE;
+
+    dprintf(0, "[DRC]: saved %d blocks to %s\n", block_pos, path);
+    return 0;
+}
+
+void drc_getStats(drc_stats* stats) {
+    int i;
+
+    drc_lockCache();
+    stats->translated = drc_num_translated;
+    stats->blocks = 0;
+    stats->cache_used = 0;
+    stats->cache_size = CACHE_SIZE;
+    for (i = 0; i < block_pos; i++) {
+        if (block_ptr_start[i].size) {
+            stats->blocks++;
+            stats->cache_used += block_ptr_start[i].size*4;
+        }
+    }
+    drc_unlockCache();
 }
 
 // Dumps the translation cache onto a file
@@ -1166,22 +2215,6 @@ void drc_dumpCache(char* filename) {
     FILE* f = fopen(filename, "w");
     fwrite(cache_start, CACHE_SIZE, 1, f);
     fclose(f);
-
-    f = fopen("rom_block_map", "w");
-    fwrite(rom_block_map, sizeof(WORD), (V810_ROM1.highaddr - V810_ROM1.lowaddr) >> 1, f);
-    fclose(f);
-    f = fopen("rom_entry_map", "w");
-    fwrite(rom_entry_map, sizeof(WORD), (V810_ROM1.highaddr - V810_ROM1.lowaddr) >> 1, f);
-    fclose(f);
-    f = fopen("ram_block_map", "w");
-    fwrite(ram_block_map, sizeof(WORD), (V810_VB_RAM.highaddr - V810_VB_RAM.lowaddr) >> 1, f);
-    fclose(f);
-    f = fopen("ram_entry_map", "w");
-    fwrite(ram_entry_map, sizeof(WORD), (V810_VB_RAM.highaddr - V810_VB_RAM.lowaddr) >> 1, f);
-    fclose(f);
-    f = fopen("block_heap", "w");
-    fwrite(block_ptr_start, sizeof(exec_block*), MAX_NUM_BLOCKS, f);
-    fclose(f);
 }
 
 void drc_dumpDebugInfo() {
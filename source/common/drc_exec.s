@@ -3,7 +3,7 @@
 
 .data
 
-.extern v810_state, serviceDisplayInt, serviceInt, serviceint, tVBOpt
+.extern v810_state, sched_run
 
 .text
 
@@ -70,25 +70,20 @@ drc_executeBlock:
     push    {lr}
 
     ldRegs
-    @ r10 = -MAXCYCLES
-    ldr     r10, =tVBOpt
-    ldr     r10, [r10]
-    neg     r10, r10
+    @ r10 = cycles run since v810_state->cycles
+    mov     r10, #0
     bx      r0
 
 postexec:
     pop     {r0}
     stRegs
-    @ v810_state->cycles += MAXCYCLES + r10 excess
-    ldr     r0, =tVBOpt
-    ldr     r0, [r0]
-    add     r10, r0
+    @ v810_state->cycles += r10
     ldr     r0, [r11, #67<<2]
     add     r0, r10
     str     r0, [r11, #67<<2]
     pop     {r4-r11, ip, pc}
 
-@ Checks for pending interrupts and exits the block if necessary
+@ Runs the events that are due and exits the block if necessary
 .globl drc_handleInterrupts
 drc_handleInterrupts:
     push    {r4, r5, lr}
@@ -96,31 +91,19 @@ drc_handleInterrupts:
     mov     r4, r0
     mov     r5, r1
 
-    @ Load v810_state->cycles and add it to the total number of cycles
-    @ (MAXCYCLES + r10 excess)
+    @ v810_state->cycles += r10, and start counting from there again
     ldr     r0, [r11, #67<<2]
     add     r0, r10
-    ldr     r2, =tVBOpt
-    ldr     r2, [r2]
-    add     r0, r2
     str     r0, [r11, #67<<2]
+    mov     r10, #0
 
-    bl      serviceDisplayInt
-    cmp     r0, #0
-    bne     exit_block
-
-    ldr     r0, [r11, #67<<2]
+    @ sched_run(v810_state->cycles, PC)
     mov     r1, r5
-    bl      serviceInt
+    bl      sched_run
     cmp     r0, #0
     bne     exit_block
 
 ret_to_block:
-    @ r10 = -MAXCYCLES
-    ldr     r10, =tVBOpt
-    ldr     r10, [r10]
-    neg     r10, r10
-
     @ Return to the block
     mov     r0, r4
     pop     {r4, r5, pc}
@@ -132,3 +115,22 @@ exit_block:
     @ Exit the block ignoring linked return address
     pop     {r4, r5}
     pop     {r0, pc}
+
+@ Stands in for drc_handleInterrupts in lockstep mode. The interpreter can't
+@ replay events run in the middle of a block, so the block exits and drc_run
+@ services them in between
+.globl drc_exitForEvents
+drc_exitForEvents:
+    push    {r4, r5, lr}
+
+    mov     r4, r0
+
+    @ v810_state->cycles += r10, and start counting from there again
+    ldr     r0, [r11, #67<<2]
+    add     r0, r10
+    str     r0, [r11, #67<<2]
+    mov     r10, #0
+
+    @ v810_state->PC = PC
+    str     r1, [r11, #33<<2]
+    b       exit_block
@@ -0,0 +1,277 @@
+/*
+ * Lockstep checking of the dynarec against the interpreter
+ *
+ * With tVBOpt.LOCKSTEP set, drc_run snapshots the CPU and the writable memory
+ * before each translated block, and afterwards replays the same instructions
+ * on the interpreter from that snapshot. Any difference in the registers, the
+ * flags, the cycle count or memory is reported along with the last replayed
+ * instruction that set it, and the earliest of those. Only the state at the
+ * end of the block is compared, so the bad instruction can be before it.
+ *
+ * Hardware registers aren't part of the snapshot, so I/O writes are done
+ * twice, which is fine as long as writing the same value again is. Block
+ * linking and the idle loop skip are off in this mode, and blocks exit when an
+ * event comes due instead of running it (see drc_exitForEvents), so drc_run
+ * gets to check every block on its own.
+ *
+ * This file is distributed under the MIT License, see drc_core.c.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "drc_core.h"
+#include "v810_cpu.h"
+#include "v810_mem.h"
+#include "v810_opt.h"
+#include "vb_types.h"
+
+// Longest replay that can be traced, longer ones are still compared
+#define LOCKSTEP_MAX_TRACE 0x1000
+// Differences reported before giving up on listing them
+#define LOCKSTEP_MAX_DIFFS 16
+
+#define LOCKSTEP_NUM_REGIONS 4
+
+typedef struct {
+    WORD PC;
+    BYTE opcode;
+    bool flags; // Changed the flags
+    bool store;
+    WORD regs; // Mask of the registers it changed
+    WORD addr; // Where it stored to
+} lockstep_step;
+
+static V810_MEMORYFETCH* const lockstep_regions[LOCKSTEP_NUM_REGIONS] = {
+    &V810_DISPLAY_RAM,
+    &V810_SOUND_RAM,
+    &V810_VB_RAM,
+    &V810_GAME_RAM,
+};
+
+// State before the block and after the dynarec ran it
+static cpu_state lockstep_pre;
+static cpu_state lockstep_drc;
+static BYTE* lockstep_pre_mem[LOCKSTEP_NUM_REGIONS];
+static BYTE* lockstep_drc_mem[LOCKSTEP_NUM_REGIONS];
+
+static lockstep_step lockstep_trace[LOCKSTEP_MAX_TRACE];
+static int lockstep_num_steps;
+// Earliest step a difference was traced back to, -1 if none
+static int lockstep_first;
+static int lockstep_num_diffs;
+
+static WORD drc_lockstepSize(int region) {
+    return (lockstep_regions[region]->highaddr + 1) - lockstep_regions[region]->lowaddr;
+}
+
+void drc_lockstepInit() {
+    int i;
+
+    for (i = 0; i < LOCKSTEP_NUM_REGIONS; i++) {
+        lockstep_pre_mem[i] = malloc(drc_lockstepSize(i));
+        lockstep_drc_mem[i] = malloc(drc_lockstepSize(i));
+    }
+    dprintf(0, "[LOCK]: checking the dynarec against the interpreter\n");
+}
+
+void drc_lockstepExit() {
+    int i;
+
+    for (i = 0; i < LOCKSTEP_NUM_REGIONS; i++) {
+        free(lockstep_pre_mem[i]);
+        free(lockstep_drc_mem[i]);
+        lockstep_pre_mem[i] = lockstep_drc_mem[i] = NULL;
+    }
+}
+
+// Takes the snapshot the block gets replayed from
+void drc_lockstepBegin() {
+    int i;
+
+    lockstep_pre = *v810_state;
+    for (i = 0; i < LOCKSTEP_NUM_REGIONS; i++)
+        memcpy(lockstep_pre_mem[i], lockstep_regions[i]->pmemory, drc_lockstepSize(i));
+}
+
+// Decodes enough of the instruction at PC to know what it wrote
+static void drc_lockstepDecode(lockstep_step* step, WORD PC) {
+    HWORD hw = mem_rhword(PC);
+
+    step->PC = PC;
+    step->opcode = ((hw >> 13) == 0x4) ? (hw >> 9) : (hw >> 10);
+    switch (step->opcode) {
+        case V810_OP_ST_B:
+        case V810_OP_ST_H:
+        case V810_OP_ST_W:
+        case V810_OP_OUT_B:
+        case V810_OP_OUT_H:
+        case V810_OP_OUT_W:
+        case V810_OP_CAXI:
+            step->store = true;
+            step->addr = v810_state->P_REG[hw & 0x1F] + (WORD)(signed short)mem_rhword(PC + 2);
+            break;
+        default:
+            step->store = false;
+            break;
+    }
+}
+
+static BYTE drc_lockstepStoreSize(BYTE opcode) {
+    switch (opcode & 0x3) {
+        case 0:  return 1;
+        case 1:  return 2;
+        default: return 4; // Words and CAXI
+    }
+}
+
+// Reports a difference and traces it back to the last replayed instruction
+// that changed it. found is that step, or -1 when the interpreter never touched
+// it, in which case the dynarec shouldn't have either.
+static void drc_lockstepReport(const char* what, WORD drc_val, WORD ref_val, int found) {
+    if (lockstep_num_diffs++ >= LOCKSTEP_MAX_DIFFS)
+        return;
+    if (found >= 0)
+        dprintf(0, "[LOCK]: %s is 0x%08x, should be 0x%08x (set at 0x%08x)\n",
+                what, drc_val, ref_val, lockstep_trace[found].PC);
+    else
+        dprintf(0, "[LOCK]: %s is 0x%08x, should be 0x%08x\n", what, drc_val, ref_val);
+    if (found < 0)
+        found = 0;
+    if (lockstep_first < 0 || found < lockstep_first)
+        lockstep_first = found;
+}
+
+static int drc_lockstepFindReg(int reg) {
+    int i;
+
+    for (i = lockstep_num_steps - 1; i >= 0; i--) {
+        if (lockstep_trace[i].regs & (1U << reg))
+            return i;
+    }
+    return -1;
+}
+
+static int drc_lockstepFindFlags() {
+    int i;
+
+    for (i = lockstep_num_steps - 1; i >= 0; i--) {
+        if (lockstep_trace[i].flags)
+            return i;
+    }
+    return -1;
+}
+
+static int drc_lockstepFindStore(int region, WORD offset) {
+    V810_MEMORYFETCH* mem = lockstep_regions[region];
+    WORD mask = mem->highaddr - mem->lowaddr;
+    WORD start;
+    int i;
+
+    for (i = lockstep_num_steps - 1; i >= 0; i--) {
+        if (!lockstep_trace[i].store || (lockstep_trace[i].addr >> 24) != (mem->lowaddr >> 24))
+            continue;
+        start = (lockstep_trace[i].addr - mem->lowaddr) & mask & ~(drc_lockstepStoreSize(lockstep_trace[i].opcode) - 1);
+        if (offset >= start && offset < start + drc_lockstepStoreSize(lockstep_trace[i].opcode))
+            return i;
+    }
+    return -1;
+}
+
+// Replays what the dynarec did since drc_lockstepBegin on the interpreter and
+// compares the results. Leaves the dynarec's state in place and returns
+// DRC_ERR_LOCKSTEP if they differ.
+int drc_lockstepCheck(WORD entry_PC) {
+    WORD budget, regs_before[32], flags_before;
+    lockstep_step* step;
+    WORD ref_PC, drc_PC;
+    char what[16];
+    int i, j, err = 0;
+
+    lockstep_drc = *v810_state;
+    for (i = 0; i < LOCKSTEP_NUM_REGIONS; i++) {
+        memcpy(lockstep_drc_mem[i], lockstep_regions[i]->pmemory, drc_lockstepSize(i));
+        memcpy(lockstep_regions[i]->pmemory, lockstep_pre_mem[i], drc_lockstepSize(i));
+    }
+    *v810_state = lockstep_pre;
+
+    // Every instruction the dynarec ran counted its cycles, so the same
+    // instructions take the interpreter just as many
+    budget = lockstep_drc.cycles - lockstep_pre.cycles;
+    lockstep_num_steps = 0;
+    while (v810_state->cycles - lockstep_pre.cycles < budget && !v810_state->halted) {
+        step = (lockstep_num_steps < LOCKSTEP_MAX_TRACE) ? &lockstep_trace[lockstep_num_steps] : NULL;
+        if (step) {
+            drc_lockstepDecode(step, v810_state->PC & V810_ROM1.highaddr);
+            memcpy(regs_before, v810_state->P_REG, sizeof(regs_before));
+            flags_before = v810_state->flags;
+        }
+        if ((err = v810_interpStep()))
+            break;
+        if (step) {
+            step->regs = 0;
+            for (i = 1; i < 32; i++) {
+                if (v810_state->P_REG[i] != regs_before[i])
+                    step->regs |= 1U << i;
+            }
+            step->flags = v810_state->flags != flags_before;
+            lockstep_num_steps++;
+        }
+    }
+
+    lockstep_first = -1;
+    lockstep_num_diffs = 0;
+    if (err)
+        dprintf(0, "[LOCK]: the interpreter failed with error #%d at 0x%08x\n", err, v810_state->PC);
+
+    ref_PC = v810_state->PC & V810_ROM1.highaddr;
+    drc_PC = lockstep_drc.PC & V810_ROM1.highaddr;
+    if (drc_PC != ref_PC)
+        drc_lockstepReport("PC", drc_PC, ref_PC, lockstep_num_steps - 1);
+    if (lockstep_drc.cycles != v810_state->cycles)
+        drc_lockstepReport("cycles", lockstep_drc.cycles, v810_state->cycles, lockstep_num_steps - 1);
+    if (lockstep_drc.halted != v810_state->halted)
+        drc_lockstepReport("halted", lockstep_drc.halted, v810_state->halted, lockstep_num_steps - 1);
+    if (lockstep_drc.flags != v810_state->flags)
+        drc_lockstepReport("flags", lockstep_drc.flags, v810_state->flags, drc_lockstepFindFlags());
+    for (i = 1; i < 32; i++) {
+        if (lockstep_drc.P_REG[i] != v810_state->P_REG[i]) {
+            sprintf(what, "r%d", i);
+            drc_lockstepReport(what, lockstep_drc.P_REG[i], v810_state->P_REG[i], drc_lockstepFindReg(i));
+        }
+    }
+    for (i = 0; i < 32; i++) {
+        if (lockstep_drc.S_REG[i] != v810_state->S_REG[i]) {
+            sprintf(what, "sr%d", i);
+            drc_lockstepReport(what, lockstep_drc.S_REG[i], v810_state->S_REG[i], lockstep_num_steps - 1);
+        }
+    }
+    for (i = 0; i < LOCKSTEP_NUM_REGIONS; i++) {
+        if (!memcmp(lockstep_drc_mem[i], lockstep_regions[i]->pmemory, drc_lockstepSize(i)))
+            continue;
+        for (j = 0; j < drc_lockstepSize(i); j++) {
+            if (lockstep_drc_mem[i][j] != lockstep_regions[i]->pmemory[j]) {
+                sprintf(what, "[0x%08x]", lockstep_regions[i]->lowaddr + j);
+                drc_lockstepReport(what, lockstep_drc_mem[i][j], lockstep_regions[i]->pmemory[j],
+                                   drc_lockstepFindStore(i, j));
+            }
+        }
+    }
+
+    // Back to what the dynarec did, either way
+    *v810_state = lockstep_drc;
+    for (i = 0; i < LOCKSTEP_NUM_REGIONS; i++)
+        memcpy(lockstep_regions[i]->pmemory, lockstep_drc_mem[i], drc_lockstepSize(i));
+
+    if (!lockstep_num_diffs && !err)
+        return 0;
+
+    dprintf(0, "[LOCK]: %d differences after the block at 0x%08x\n", lockstep_num_diffs, entry_PC);
+    if (lockstep_first >= 0 && lockstep_first < lockstep_num_steps)
+        dprintf(0, "[LOCK]: earliest instruction involved: %s at 0x%08x\n",
+                optable[lockstep_trace[lockstep_first].opcode].opname, lockstep_trace[lockstep_first].PC);
+    for (i = 0; i < lockstep_num_steps; i++)
+        dprintf(1, "[LOCK]: %4d 0x%08x %s\n", i, lockstep_trace[i].PC, optable[lockstep_trace[i].opcode].opname);
+    return DRC_ERR_LOCKSTEP;
+}
@@ -0,0 +1,687 @@
+/*
+ * Block scanning, decoding and analysis passes of the V810 dynamic recompiler.
+ * They don't depend on the host, so every backend shares them.
+ *
+ * This file is distributed under the MIT License, see drc_core.c.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "drc_core.h"
+#include "v810_cpu.h"
+#include "v810_mem.h"
+#include "v810_opt.h"
+#include "vb_set.h"
+#include "vb_types.h"
+
+// Finds the starting and ending address of a V810 code block. It stops after a
+// jmp, jal, reti or a long jr unless it branches further.
+void drc_scanBlockBounds(WORD* p_start_PC, WORD* p_end_PC) {
+    WORD start_PC = *p_start_PC & V810_ROM1.highaddr;
+    WORD end_PC = start_PC;
+    WORD cur_PC = start_PC;
+    WORD branch_addr;
+    int branch_offset;
+    BYTE opcode;
+    bool finished = false;
+    BYTE lowB, highB, lowB2, highB2;
+
+    while(!finished) {
+        // TODO: implement reading from RAM
+        if ((cur_PC >>24) == 0x05) { // RAM
+            cur_PC = (cur_PC & V810_VB_RAM.highaddr);
+            lowB   = ((BYTE *)(V810_VB_RAM.off + cur_PC))[0];
+            highB  = ((BYTE *)(V810_VB_RAM.off + cur_PC))[1];
+            lowB2  = ((BYTE *)(V810_VB_RAM.off + cur_PC))[2];
+            highB2 = ((BYTE *)(V810_VB_RAM.off + cur_PC))[3];
+        } else if ((cur_PC >>24) >= 0x07) { // ROM
+            cur_PC = (cur_PC & V810_ROM1.highaddr);
+            lowB   = ((BYTE *)(V810_ROM1.off + cur_PC))[0];
+            highB  = ((BYTE *)(V810_ROM1.off + cur_PC))[1];
+            lowB2  = ((BYTE *)(V810_ROM1.off + cur_PC))[2];
+            highB2 = ((BYTE *)(V810_ROM1.off + cur_PC))[3];
+        } else {
+            return;
+        }
+        if ((highB & 0xE0) == 0x80)
+            opcode = highB>>1;
+        else
+            opcode = highB>>2;
+
+        switch (opcode) {
+            case V810_OP_JR:
+                branch_offset = (signed)sign_26(((highB & 0x3) << 24) + (lowB << 16) + (highB2 << 8) + lowB2);
+                if (abs(branch_offset) < 1024) {
+                    branch_addr = cur_PC + branch_offset;
+                    if (branch_addr < start_PC)
+                        start_PC = branch_addr;
+                    else if (branch_addr > end_PC)
+                        end_PC = branch_addr;
+                    break;
+                }
+            case V810_OP_JMP:
+            case V810_OP_JAL:
+            case V810_OP_RETI:
+                if (cur_PC >= end_PC) {
+                    end_PC = cur_PC;
+                    finished = true;
+                }
+                break;
+            case V810_OP_BV:
+            case V810_OP_BL:
+            case V810_OP_BE:
+            case V810_OP_BNH:
+            case V810_OP_BN:
+            case V810_OP_BR:
+            case V810_OP_BLT:
+            case V810_OP_BLE:
+            case V810_OP_BNV:
+            case V810_OP_BNL:
+            case V810_OP_BNE:
+            case V810_OP_BH:
+            case V810_OP_BP:
+            case V810_OP_BGE:
+            case V810_OP_BGT:
+                branch_addr = cur_PC + sign_9(((highB & 0x1) << 8) + (lowB & 0xFE));
+
+                if (branch_addr < start_PC)
+                    start_PC = branch_addr;
+                else if (branch_addr > end_PC)
+                    end_PC = branch_addr;
+                break;
+        }
+
+        cur_PC += am_size_table[optable[opcode].addr_mode];
+
+        if (cur_PC > end_PC)
+            end_PC = cur_PC;
+    }
+
+    *p_start_PC = start_PC;
+    *p_end_PC = end_PC;
+}
+
+// The flags read by each V810 condition code (see cond_map)
+static const BYTE cond_flags[16] = {
+    // V, C, Z, NH, N, T
+    DRC_FLAG_V, DRC_FLAG_C, DRC_FLAG_Z, DRC_FLAG_C|DRC_FLAG_Z, DRC_FLAG_N, 0,
+    // LT, LE, NV, NC, NZ, H
+    DRC_FLAG_N|DRC_FLAG_V, DRC_FLAG_N|DRC_FLAG_Z|DRC_FLAG_V, DRC_FLAG_V, DRC_FLAG_C, DRC_FLAG_Z, DRC_FLAG_C|DRC_FLAG_Z,
+    // NS, F, GE, GT
+    DRC_FLAG_N, 0, DRC_FLAG_N|DRC_FLAG_V, DRC_FLAG_N|DRC_FLAG_Z|DRC_FLAG_V
+};
+
+// Returns the flags an instruction reads
+BYTE drc_getFlagsRead(v810_instruction *inst) {
+    if (inst->opcode >= V810_OP_BV && inst->opcode <= V810_OP_BGT)
+        return cond_flags[inst->opcode & 0xF];
+    if (inst->opcode == V810_OP_SETF)
+        return cond_flags[inst->imm & 0xF];
+    return 0;
+}
+
+// Returns the flags the translated instruction always overwrites. Helper calls
+// leave the flags undefined, so the V810 instructions that set flags through
+// one count as overwriting all of them.
+BYTE drc_getFlagsWritten(v810_instruction *inst) {
+    switch (inst->opcode) {
+        case V810_OP_ADD:
+        case V810_OP_SUB:
+        case V810_OP_CMP:
+        case V810_OP_ADD_I:
+        case V810_OP_CMP_I:
+        case V810_OP_ADDI:
+        case V810_OP_DIV:
+        case V810_OP_DIVU:
+        // The shifts set CY and clear OV too
+        case V810_OP_SHL:
+        case V810_OP_SHR:
+        case V810_OP_SAR:
+        case V810_OP_SHL_I:
+        case V810_OP_SHR_I:
+        case V810_OP_SAR_I:
+            return DRC_FLAGS_ALL;
+        case V810_OP_MUL:
+        case V810_OP_MULU:
+        case V810_OP_OR:
+        case V810_OP_AND:
+        case V810_OP_XOR:
+        case V810_OP_NOT:
+        case V810_OP_ORI:
+        case V810_OP_ANDI:
+        case V810_OP_XORI:
+            return DRC_FLAG_N | DRC_FLAG_Z;
+        case V810_OP_FPP:
+            switch (inst->imm) {
+                case V810_OP_CVT_WS:
+                case V810_OP_CVT_SW:
+                case V810_OP_CMPF_S:
+                case V810_OP_ADDF_S:
+                case V810_OP_SUBF_S:
+                case V810_OP_MULF_S:
+                case V810_OP_DIVF_S:
+                    return 0;
+                default:
+                    return DRC_FLAGS_ALL;
+            }
+        default:
+            return 0;
+    }
+}
+
+// Returns the position in inst_cache of the instruction at PC, or -1 if it's
+// not in the block
+int drc_findInst(v810_instruction *inst_cache, unsigned int num_inst, WORD PC) {
+    int low = 0, high = (int)num_inst - 1, mid;
+
+    while (low <= high) {
+        mid = (low + high) / 2;
+        if (inst_cache[mid].PC == PC)
+            return mid;
+        else if (inst_cache[mid].PC < PC)
+            low = mid + 1;
+        else
+            high = mid - 1;
+    }
+    return -1;
+}
+
+// Backwards flag liveness pass. Sets live_flags to the flags that may be read
+// after each instruction, and save_flags for memory accesses that would
+// otherwise clobber live flags with the helper call. All flags are live when
+// leaving the block, and branches get the flags live at their target, so we
+// iterate until nothing changes.
+void drc_findLiveFlags(v810_instruction *inst_cache, unsigned int num_inst) {
+    BYTE live_in[MAX_INST];
+    BYTE live_out;
+    int i, target;
+    bool changed = true;
+
+    memset(live_in, 0, num_inst);
+
+    while (changed) {
+        changed = false;
+        for (i = (int)num_inst - 1; i >= 0; i--) {
+            switch (inst_cache[i].opcode) {
+                case V810_OP_JMP:
+                case V810_OP_JAL:
+                case V810_OP_RETI:
+                case V810_OP_HALT:
+                case END_BLOCK:
+                    live_out = DRC_FLAGS_ALL;
+                    break;
+                case V810_OP_JR:
+                case V810_OP_BR:
+                    target = drc_findInst(inst_cache, num_inst, inst_cache[i].PC + inst_cache[i].branch_offset);
+                    live_out = (target >= 0 && abs(inst_cache[i].branch_offset) < 1024) ? live_in[target] : DRC_FLAGS_ALL;
+                    break;
+                default:
+                    live_out = (i == (int)num_inst - 1) ? DRC_FLAGS_ALL : live_in[i + 1];
+                    if (inst_cache[i].opcode >= V810_OP_BV && inst_cache[i].opcode <= V810_OP_BGT &&
+                            inst_cache[i].opcode != V810_OP_NOP) {
+                        target = drc_findInst(inst_cache, num_inst, inst_cache[i].PC + inst_cache[i].branch_offset);
+                        live_out |= (target >= 0) ? live_in[target] : DRC_FLAGS_ALL;
+                    }
+                    break;
+            }
+
+            inst_cache[i].live_flags = live_out;
+            live_out = drc_getFlagsRead(&inst_cache[i]) | (live_out & ~drc_getFlagsWritten(&inst_cache[i]));
+            if (live_out != live_in[i]) {
+                live_in[i] = live_out;
+                changed = true;
+            }
+        }
+    }
+
+    for (i = 0; i < num_inst; i++) {
+        switch (inst_cache[i].opcode) {
+            case V810_OP_LD_B:
+            case V810_OP_LD_H:
+            case V810_OP_LD_W:
+            case V810_OP_IN_B:
+            case V810_OP_IN_H:
+            case V810_OP_IN_W:
+            case V810_OP_ST_B:
+            case V810_OP_ST_H:
+            case V810_OP_ST_W:
+            case V810_OP_OUT_B:
+            case V810_OP_OUT_H:
+            case V810_OP_OUT_W:
+                inst_cache[i].save_flags = (inst_cache[i].live_flags != 0);
+                break;
+            default:
+                inst_cache[i].save_flags = false;
+                break;
+        }
+    }
+}
+
+// Tells if the instruction is a branch to somewhere inside the block
+static bool drc_isLocalBranch(v810_instruction *inst) {
+    if (inst->opcode == V810_OP_JR)
+        return abs(inst->branch_offset) < 1024;
+    return inst->opcode >= V810_OP_BV && inst->opcode <= V810_OP_BGT && inst->opcode != V810_OP_NOP;
+}
+
+// Forward constant propagation pass. Keeps track of the registers with a value
+// known at translation time, and marks the instructions whose result or memory
+// address can be computed here. Branches can exit the block to service
+// interrupts and come back through their entrypoint, so tracking starts over at
+// every branch and branch target. Instructions that rely on a known value don't
+// get an entrypoint, since jumping straight to them would skip the instructions
+// that set it.
+void drc_propagateConstants(v810_instruction *inst_cache, unsigned int num_inst, WORD entry_PC) {
+    bool barrier[MAX_INST];
+    WORD values[32];
+    WORD known; // A bit for each register, r0 is always known
+    WORD result = 0, v1, v2, addr;
+    bool k1, k2, flags_dead, folded;
+    BYTE reg1, reg2;
+    int i, target;
+
+    memset(barrier, 0, sizeof(barrier));
+    barrier[0] = true;
+    for (i = 0; i < num_inst; i++) {
+        if (inst_cache[i].PC == entry_PC)
+            barrier[i] = true;
+        if (drc_isLocalBranch(&inst_cache[i])) {
+            barrier[i] = true;
+            target = drc_findInst(inst_cache, num_inst, inst_cache[i].PC + inst_cache[i].branch_offset);
+            if (target >= 0)
+                barrier[target] = true;
+        }
+    }
+
+    values[0] = 0;
+    known = 1;
+    for (i = 0; i < num_inst; i++) {
+        if (barrier[i])
+            known = 1;
+
+        inst_cache[i].const_info = (known != 1) ? DRC_CONST_NO_ENTRY : 0;
+        reg1 = inst_cache[i].reg1;
+        reg2 = inst_cache[i].reg2;
+        k1 = reg1 < 32 && ((known >> reg1) & 1);
+        k2 = reg2 < 32 && ((known >> reg2) & 1);
+        v1 = k1 ? values[reg1] : 0;
+        v2 = k2 ? values[reg2] : 0;
+        flags_dead = !(inst_cache[i].live_flags & drc_getFlagsWritten(&inst_cache[i]));
+        folded = false;
+
+        switch (inst_cache[i].opcode) {
+            case V810_OP_MOVHI:
+                folded = k1;
+                result = v1 + (inst_cache[i].imm << 16);
+                break;
+            case V810_OP_MOVEA:
+                folded = k1;
+                result = v1 + sign_16(inst_cache[i].imm);
+                break;
+            case V810_OP_MOV:
+                folded = k1;
+                result = v1;
+                break;
+            case V810_OP_MOV_I:
+                folded = true;
+                result = sign_5(inst_cache[i].imm);
+                break;
+            case V810_OP_ADDI:
+                folded = k1 && flags_dead;
+                result = v1 + sign_16(inst_cache[i].imm);
+                break;
+            case V810_OP_ORI:
+                folded = k1 && flags_dead;
+                result = v1 | inst_cache[i].imm;
+                break;
+            case V810_OP_ANDI:
+                folded = k1 && flags_dead;
+                result = v1 & inst_cache[i].imm;
+                break;
+            case V810_OP_XORI:
+                folded = k1 && flags_dead;
+                result = v1 ^ inst_cache[i].imm;
+                break;
+            case V810_OP_NOT:
+                folded = k1 && flags_dead;
+                result = ~v1;
+                break;
+            case V810_OP_ADD_I:
+                folded = k2 && flags_dead;
+                result = v2 + sign_5(inst_cache[i].imm);
+                break;
+            case V810_OP_ADD:
+                folded = k1 && k2 && flags_dead;
+                result = v2 + v1;
+                break;
+            case V810_OP_SUB:
+                folded = k1 && k2 && flags_dead;
+                result = v2 - v1;
+                break;
+            case V810_OP_OR:
+                folded = k1 && k2 && flags_dead;
+                result = v2 | v1;
+                break;
+            case V810_OP_AND:
+                folded = k1 && k2 && flags_dead;
+                result = v2 & v1;
+                break;
+            case V810_OP_XOR:
+                folded = k1 && k2 && flags_dead;
+                result = v2 ^ v1;
+                break;
+            case V810_OP_SHL_I:
+                folded = k2 && flags_dead;
+                result = v2 << inst_cache[i].imm;
+                break;
+            case V810_OP_SHR_I:
+                folded = k2 && flags_dead;
+                result = v2 >> inst_cache[i].imm;
+                break;
+            case V810_OP_SAR_I:
+                folded = k2 && flags_dead;
+                result = (WORD) ((int) v2 >> inst_cache[i].imm);
+                break;
+            case V810_OP_LD_B:
+            case V810_OP_LD_H:
+            case V810_OP_LD_W:
+            case V810_OP_IN_B:
+            case V810_OP_IN_H:
+            case V810_OP_IN_W:
+                if (!k1)
+                    break;
+                addr = v1 + sign_16(inst_cache[i].imm);
+                // The ROM can't change, so we can do the load right now
+                if ((addr >> 24) == 0x07) {
+                    folded = true;
+                    switch (inst_cache[i].opcode) {
+                        case V810_OP_LD_B: result = (WORD) (signed char) mem_rbyte(addr); break;
+                        case V810_OP_IN_B: result = mem_rbyte(addr); break;
+                        case V810_OP_LD_H: result = sign_16(mem_rhword(addr)); break;
+                        case V810_OP_IN_H: result = mem_rhword(addr); break;
+                        default: result = mem_rword(addr); break;
+                    }
+                } else {
+                    inst_cache[i].const_info |= DRC_CONST_ADDR;
+                    inst_cache[i].const_addr = addr;
+                }
+                break;
+            case V810_OP_ST_B:
+            case V810_OP_ST_H:
+            case V810_OP_ST_W:
+            case V810_OP_OUT_B:
+            case V810_OP_OUT_H:
+            case V810_OP_OUT_W:
+                if (k1) {
+                    inst_cache[i].const_info |= DRC_CONST_ADDR;
+                    inst_cache[i].const_addr = v1 + sign_16(inst_cache[i].imm);
+                }
+                // Nothing is written to a register
+                reg2 = 0xFF;
+                break;
+            case V810_OP_CMP:
+            case V810_OP_CMP_I:
+            case V810_OP_LDSR:
+            case V810_OP_SEI:
+            case V810_OP_CLI:
+            case V810_OP_NOP:
+                reg2 = 0xFF;
+                break;
+            case V810_OP_SETF:
+            case V810_OP_STSR:
+                break;
+            case V810_OP_MUL:
+            case V810_OP_MULU:
+            case V810_OP_DIV:
+            case V810_OP_DIVU:
+                // The high word or the remainder go to r30
+                known &= ~(1U << 30);
+                break;
+            default:
+                if (drc_isLocalBranch(&inst_cache[i])) {
+                    reg2 = 0xFF;
+                    break;
+                }
+                // Anything else might write anywhere or leave the block
+                known = 1;
+                reg2 = 0xFF;
+                break;
+        }
+
+        if (reg2 == 0 || reg2 >= 32)
+            continue;
+        if (folded) {
+            inst_cache[i].const_info |= DRC_CONST_RESULT;
+            inst_cache[i].const_result = result;
+            values[reg2] = result;
+            known |= 1U << reg2;
+        } else {
+            known &= ~(1U << reg2);
+        }
+    }
+
+    // The first half of a movhi/movea pair doesn't have to be materialized
+    for (i = 0; i < (int)num_inst - 1; i++) {
+        if ((inst_cache[i].const_info & DRC_CONST_RESULT) && (inst_cache[i + 1].const_info & DRC_CONST_RESULT) &&
+                inst_cache[i].reg2 == inst_cache[i + 1].reg2 && !barrier[i + 1])
+            inst_cache[i].const_info |= DRC_CONST_DEAD;
+    }
+}
+
+// Marks the backward branches that close a polling loop, where each iteration
+// only loads, tests and branches back without carrying any register over to the
+// next one. Whatever it waits for can only change with an interrupt or a
+// VIP/timer event, so the translated code skips to the next one of those
+// instead of spinning (see drc_skipIdle).
+void drc_findIdleLoops(v810_instruction *inst_cache, unsigned int num_inst) {
+    WORD read, written, carried;
+    bool writes, idle;
+    BYTE reg1, reg2;
+    int i, j, target;
+
+    for (i = 0; i < num_inst; i++) {
+        inst_cache[i].idle_loop = false;
+        // The interpreter would spin instead, so lockstep checks can't have it
+        if (tVBOpt.LOCKSTEP || !drc_isLocalBranch(&inst_cache[i]) || inst_cache[i].branch_offset > 0)
+            continue;
+        // Neither never taken nor split in two ARM branches
+        if (inst_cache[i].opcode == V810_OP_BNV || inst_cache[i].opcode == V810_OP_BNH ||
+                inst_cache[i].opcode == V810_OP_BH)
+            continue;
+        target = drc_findInst(inst_cache, num_inst, inst_cache[i].PC + inst_cache[i].branch_offset);
+        if (target < 0 || i - target > MAX_IDLE_LOOP_INST)
+            continue;
+
+        written = 0;
+        carried = 0;
+        idle = true;
+        for (j = target; j < i && idle; j++) {
+            reg1 = inst_cache[j].reg1;
+            reg2 = inst_cache[j].reg2;
+            read = (reg1 < 32) ? 1U << reg1 : 0;
+            writes = true;
+            switch (inst_cache[j].opcode) {
+                case V810_OP_LD_B:
+                case V810_OP_LD_H:
+                case V810_OP_LD_W:
+                case V810_OP_IN_B:
+                case V810_OP_IN_H:
+                case V810_OP_IN_W:
+                case V810_OP_MOV:
+                case V810_OP_NOT:
+                case V810_OP_MOV_I:
+                case V810_OP_MOVEA:
+                case V810_OP_MOVHI:
+                case V810_OP_ADDI:
+                case V810_OP_ORI:
+                case V810_OP_ANDI:
+                case V810_OP_XORI:
+                    break;
+                case V810_OP_ADD:
+                case V810_OP_SUB:
+                case V810_OP_OR:
+                case V810_OP_AND:
+                case V810_OP_XOR:
+                case V810_OP_ADD_I:
+                case V810_OP_SHL_I:
+                case V810_OP_SHR_I:
+                case V810_OP_SAR_I:
+                    read |= 1U << reg2;
+                    break;
+                case V810_OP_CMP:
+                case V810_OP_CMP_I:
+                    read |= 1U << reg2;
+                    writes = false;
+                    break;
+                default:
+                    idle = false;
+                    break;
+            }
+            // Registers read before being set in this iteration
+            carried |= read & ~written;
+            if (writes)
+                written |= 1U << reg2;
+        }
+
+        if (idle && !(carried & written & ~1U)) {
+            inst_cache[i].idle_loop = true;
+            dprintf(3, "[DRC]: idle loop at 0x%x\n", inst_cache[i].PC);
+        }
+    }
+}
+
+// Decodes the instructions from start_PC to end_PC and stores them in
+// inst_cache.
+// Returns the number of instructions decoded.
+unsigned int drc_decodeInstructions(exec_block *block, v810_instruction *inst_cache, WORD start_PC, WORD end_PC) {
+    unsigned int i;
+    // Up to 4 bytes for instruction (either 16 or 32 bits)
+    BYTE lowB, highB, lowB2, highB2;
+    WORD cur_PC = start_PC;
+
+    for (i = 0; (i < MAX_INST) && (cur_PC < end_PC); i++) {
+        cur_PC = (cur_PC &0x07FFFFFE);
+
+        if ((cur_PC >>24) == 0x05) { // RAM
+            cur_PC = (cur_PC & V810_VB_RAM.highaddr);
+            lowB   = ((BYTE *)(V810_VB_RAM.off + cur_PC))[0];
+            highB  = ((BYTE *)(V810_VB_RAM.off + cur_PC))[1];
+            lowB2  = ((BYTE *)(V810_VB_RAM.off + cur_PC))[2];
+            highB2 = ((BYTE *)(V810_VB_RAM.off + cur_PC))[3];
+        } else if ((cur_PC >>24) >= 0x07) { // ROM
+            cur_PC = (cur_PC & V810_ROM1.highaddr);
+            lowB   = ((BYTE *)(V810_ROM1.off + cur_PC))[0];
+            highB  = ((BYTE *)(V810_ROM1.off + cur_PC))[1];
+            lowB2  = ((BYTE *)(V810_ROM1.off + cur_PC))[2];
+            highB2 = ((BYTE *)(V810_ROM1.off + cur_PC))[3];
+        } else {
+            return 0;
+        }
+
+        inst_cache[i].PC = cur_PC;
+        inst_cache[i].save_flags = false;
+
+        inst_cache[i].opcode = highB >> 2;
+        if ((highB & 0xE0) == 0x80)              // Special opcode format for
+            inst_cache[i].opcode = (highB >> 1); // type III instructions.
+
+        if ((inst_cache[i].opcode > 0x4F) || (inst_cache[i].opcode < 0))
+            return 0;
+
+        switch (optable[inst_cache[i].opcode].addr_mode) {
+            case AM_I:
+                inst_cache[i].reg1 = (BYTE)((lowB & 0x1F));
+                reg_usage[inst_cache[i].reg1]++;
+
+                // jmp [reg1] doesn't use the second register
+                if (inst_cache[i].opcode != V810_OP_JMP) {
+                    inst_cache[i].reg2 = (BYTE)((lowB >> 5) + ((highB & 0x3) << 3));
+                    reg_usage[inst_cache[i].reg2]++;
+                } else {
+                    inst_cache[i].reg2 = 0xFF;
+                }
+                break;
+            case AM_II:
+                inst_cache[i].imm = (unsigned)((lowB & 0x1F));
+                inst_cache[i].reg2 = (BYTE)((lowB >> 5) + ((highB & 0x3) << 3));
+                reg_usage[inst_cache[i].reg2]++;
+
+                inst_cache[i].reg1 = 0xFF;
+                break;
+            case AM_III: // Branch instructions
+                inst_cache[i].imm = (unsigned)(((highB & 0x1) << 8) + (lowB & 0xFE));
+                inst_cache[i].branch_offset = sign_9(inst_cache[i].imm);
+
+                inst_cache[i].reg1 = 0xFF;
+                inst_cache[i].reg2 = 0xFF;
+                break;
+            case AM_IV: // Middle distance jump
+                inst_cache[i].imm = (unsigned)(((highB & 0x3) << 24) + (lowB << 16) + (highB2 << 8) + lowB2);
+                inst_cache[i].branch_offset = (signed)sign_26(inst_cache[i].imm);
+
+                inst_cache[i].reg1 = 0xFF;
+                inst_cache[i].reg2 = 0xFF;
+                break;
+            case AM_V:
+                inst_cache[i].reg2 = (BYTE)((lowB >> 5) + ((highB & 0x3) << 3));
+                inst_cache[i].reg1 = (BYTE)((lowB & 0x1F));
+                inst_cache[i].imm = (highB2 << 8) + lowB2;
+                reg_usage[inst_cache[i].reg1]++;
+                reg_usage[inst_cache[i].reg2]++;
+                break;
+            case AM_VIa: // Mode6 form1
+                inst_cache[i].imm = (highB2 << 8) + lowB2;
+                inst_cache[i].reg1 = (BYTE)((lowB & 0x1F));
+                inst_cache[i].reg2 = (BYTE)((lowB >> 5) + ((highB & 0x3) << 3));
+                reg_usage[inst_cache[i].reg1]++;
+                reg_usage[inst_cache[i].reg2]++;
+                break;
+            case AM_VIb: // Mode6 form2
+                inst_cache[i].reg2 = (BYTE)((lowB >> 5) + ((highB & 0x3) << 3));
+                inst_cache[i].imm = (highB2 << 8) + lowB2; // Whats the order??? 2,3,1 or 1,3,2
+                inst_cache[i].reg1 = (BYTE)((lowB & 0x1F));
+                reg_usage[inst_cache[i].reg1]++;
+                reg_usage[inst_cache[i].reg2]++;
+                break;
+            case AM_VII: // Unhandled
+                break;
+            case AM_VIII: // Unhandled
+                break;
+            case AM_IX:
+                inst_cache[i].imm = (unsigned)((lowB & 0x1)); // Mode ID, Ignore for now
+
+                inst_cache[i].reg1 = 0xFF;
+                inst_cache[i].reg2 = 0xFF;
+                break;
+            case AM_BSTR: // Bit String Subopcodes
+                inst_cache[i].reg2 = (BYTE)((lowB >> 5) + ((highB & 0x3) << 3));
+                inst_cache[i].reg1 = (BYTE)((lowB & 0x1F));
+                reg_usage[inst_cache[i].reg1]++;
+                reg_usage[inst_cache[i].reg2]++;
+                break;
+            case AM_FPP: // Floating Point Subcode
+                inst_cache[i].reg2 = (BYTE)((lowB >> 5) + ((highB & 0x3) << 3));
+                inst_cache[i].reg1 = (BYTE)((lowB & 0x1F));
+                inst_cache[i].imm = (unsigned)(((highB2 >> 2)&0x3F));
+                reg_usage[inst_cache[i].reg1]++;
+                reg_usage[inst_cache[i].reg2]++;
+                break;
+            case AM_UDEF: // Invalid opcode.
+                inst_cache[i].reg1 = 0xFF;
+                inst_cache[i].reg2 = 0xFF;
+                break;
+            default: // Invalid opcode.
+                inst_cache[i].reg1 = 0xFF;
+                inst_cache[i].reg2 = 0xFF;
+                cur_PC += 2;
+                break;
+        }
+
+        cur_PC += am_size_table[optable[inst_cache[i].opcode].addr_mode];
+        block->cycles += opcycle[inst_cache[i].opcode];
+    }
+
+    return i;
+}
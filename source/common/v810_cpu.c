@@ -13,6 +13,8 @@
 #include "vb_set.h"
 #include "rom_db.h"
 #include "drc_core.h"
+#include "vb_sched.h"
+#include "utils.h"
 
 #define NEG(n) ((n) >> 31)
 #define POS(n) ((~(n)) >> 31)
@@ -28,6 +30,10 @@ const BYTE opcycle[0x50] = {
     0x01,0x01,0x01,0x01,0x01,0x01,0x01,0x01,0x01,0x01,0x01,0x01,0x01,0x01,0x01,0x01
 };
 
+// VIP timing state
+static unsigned int lastfb=0;
+static int rowcount,tmp1;
+
 int v810_init(char *rom_name) {
     char ram_name[32];
     unsigned int rom_size = 0;
@@ -40,7 +46,7 @@ int v810_init(char *rom_name) {
         rom_size = ftell(f);
         rewind(f);
 
-        V810_ROM1.pmemory = malloc(rom_size);
+        V810_ROM1.pmemory = AllocLowMemory(rom_size);
         fread(V810_ROM1.pmemory, 1, rom_size, f);
 
         fclose(f);
@@ -62,7 +68,7 @@ int v810_init(char *rom_name) {
     V810_DISPLAY_RAM.lowaddr  = 0x00000000;
     V810_DISPLAY_RAM.highaddr = 0x0003FFFF; //0x0005FFFF; //97FFF
     // Alocate space for it in memory
-    V810_DISPLAY_RAM.pmemory = (unsigned char *)malloc(((V810_DISPLAY_RAM.highaddr +1) - V810_DISPLAY_RAM.lowaddr) * sizeof(BYTE));
+    V810_DISPLAY_RAM.pmemory = AllocLowMemory((V810_DISPLAY_RAM.highaddr +1) - V810_DISPLAY_RAM.lowaddr);
     // Offset + Lowaddr = pmemory
     V810_DISPLAY_RAM.off = (unsigned)V810_DISPLAY_RAM.pmemory - V810_DISPLAY_RAM.lowaddr;
 
@@ -81,7 +87,7 @@ int v810_init(char *rom_name) {
     V810_SOUND_RAM.lowaddr  = 0x01000000;
     V810_SOUND_RAM.highaddr = 0x010005FF; //0x010002FF
     // Alocate space for it in memory
-    V810_SOUND_RAM.pmemory = (unsigned char *)malloc(((V810_SOUND_RAM.highaddr +1) - V810_SOUND_RAM.lowaddr) * sizeof(BYTE));
+    V810_SOUND_RAM.pmemory = AllocLowMemory((V810_SOUND_RAM.highaddr +1) - V810_SOUND_RAM.lowaddr);
     // Offset + Lowaddr = pmemory
     V810_SOUND_RAM.off = (unsigned)V810_SOUND_RAM.pmemory - V810_SOUND_RAM.lowaddr;
 
@@ -89,7 +95,7 @@ int v810_init(char *rom_name) {
     V810_VB_RAM.lowaddr  = 0x05000000;
     V810_VB_RAM.highaddr = 0x0500FFFF;
     // Alocate space for it in memory
-    V810_VB_RAM.pmemory = (unsigned char *)malloc(((V810_VB_RAM.highaddr +1) - V810_VB_RAM.lowaddr) * sizeof(BYTE));
+    V810_VB_RAM.pmemory = AllocLowMemory((V810_VB_RAM.highaddr +1) - V810_VB_RAM.lowaddr);
     // Offset + Lowaddr = pmemory
     V810_VB_RAM.off = (unsigned)V810_VB_RAM.pmemory - V810_VB_RAM.lowaddr;
 
@@ -110,7 +116,7 @@ int v810_init(char *rom_name) {
     V810_GAME_RAM.lowaddr  = 0x06000000;
     V810_GAME_RAM.highaddr = 0x06003FFF; //0x06007FFF; //(8K, not 64k!)
     // Alocate space for it in memory
-    V810_GAME_RAM.pmemory = (unsigned char *)calloc(((V810_GAME_RAM.highaddr +1) - V810_GAME_RAM.lowaddr), sizeof(BYTE));
+    V810_GAME_RAM.pmemory = AllocLowMemory((V810_GAME_RAM.highaddr +1) - V810_GAME_RAM.lowaddr);
     // Offset + Lowaddr = pmemory
     V810_GAME_RAM.off = (unsigned)V810_GAME_RAM.pmemory - V810_GAME_RAM.lowaddr;
 
@@ -129,6 +135,8 @@ int v810_init(char *rom_name) {
     V810_HCREG.rfuncw = &(hcreg_rword);
     V810_HCREG.wfuncw = &(hcreg_wword);
 
+    mem_initPages();
+
     mem_whword(0x0005F840, 0x0004); //XPSTTS
 
     tHReg.SCR	= 0x4C;
@@ -154,19 +162,23 @@ int v810_init(char *rom_name) {
 
 void v810_exit() {
     free(v810_state);
-    free(V810_ROM1.pmemory);
-    free(V810_DISPLAY_RAM.pmemory);
-    free(V810_SOUND_RAM.pmemory);
-    free(V810_VB_RAM.pmemory);
-    free(V810_GAME_RAM.pmemory);
+    FreeLowMemory(V810_ROM1.pmemory, (V810_ROM1.highaddr +1) - V810_ROM1.lowaddr);
+    FreeLowMemory(V810_DISPLAY_RAM.pmemory, (V810_DISPLAY_RAM.highaddr +1) - V810_DISPLAY_RAM.lowaddr);
+    FreeLowMemory(V810_SOUND_RAM.pmemory, (V810_SOUND_RAM.highaddr +1) - V810_SOUND_RAM.lowaddr);
+    FreeLowMemory(V810_VB_RAM.pmemory, (V810_VB_RAM.highaddr +1) - V810_VB_RAM.lowaddr);
+    FreeLowMemory(V810_GAME_RAM.pmemory, (V810_GAME_RAM.highaddr +1) - V810_GAME_RAM.lowaddr);
 }
 
 // Reinitialize the defaults in the CPU
 void v810_reset() {
     memset(v810_state, 0, sizeof(cpu_state));
 
-    v810_state->irq_handler = &drc_handleInterrupts;
+    // Events run mid-block can't be replayed by the lockstep checks
+    v810_state->irq_handler = tVBOpt.LOCKSTEP ? &drc_exitForEvents : &drc_handleInterrupts;
     v810_state->reloc_table = &drc_relocTable;
+    v810_state->ram_base = V810_VB_RAM.off;
+    v810_state->rom_base = V810_ROM1.off;
+    v810_state->rom_mask = V810_ROM1.highaddr;
 
     v810_state->P_REG[0]    =  0x00000000;
     v810_state->PC          =  0xFFFFFFF0;
@@ -174,16 +186,24 @@ void v810_reset() {
     v810_state->S_REG[PSW]  =  0x00008000;
     v810_state->S_REG[PIR]  =  0x00005346;
     v810_state->S_REG[TKCW] =  0x000000E0;
-}
 
-int serviceInt(unsigned int cycles, WORD PC) {
-    static unsigned int lasttime=0;
+    v810_interpReset();
+    sched_init();
+    v810_resetDisplay(v810_state->cycles);
+    v810_resetTimer(v810_state->cycles);
+}
 
-    //OK, this is a strange muck of code... basically it attempts to hit interrupts and
-    //handle the VIP regs at the correct time. The timing needs a LOT of work. Right now,
-    //the count values I'm using are the best values from my old clock cycle table. In
-    //other words, the values are so far off. PBBT!  FIXME
+// Schedules the timer's next tick from the given cycle, or drops it if the
+// timer is off
+void v810_resetTimer(unsigned int cycles) {
+    if (tHReg.TCR & 0x01)
+        sched_schedule(SCHED_TIMER, cycles + tHReg.tTRC + 1);
+    else
+        sched_cancel(SCHED_TIMER);
+}
 
+// Timer tick, scheduled every tTRC+1 cycles while the timer is enabled
+int serviceInt(unsigned int cycles, WORD PC) {
     //For whatever reason we dont need this code
     //actualy it totaly breaks the emu if you don't call it on
     //every cycle, fixme, what causes this to error out.
@@ -192,30 +212,59 @@ int serviceInt(unsigned int cycles, WORD PC) {
     //  v810_int(0);
     //}
 
-    if (tHReg.TCR & 0x01) { // Timer Enabled
-        if ((cycles-lasttime) > tHReg.tTRC) {
-            if (tHReg.tCount)
-                tHReg.tCount--;
-            tHReg.TLB = (tHReg.tCount&0xFF);
-            tHReg.THB = ((tHReg.tCount>>8)&0xFF);
-            lasttime=cycles;
-            if (tHReg.tCount == 0) {
-                tHReg.tCount = tHReg.tTHW; //reset counter
-                tHReg.TCR |= 0x02; //Zero Status
-                if (tHReg.TCR & 0x08) {
-                    v810_int(1, PC);
-                    return 1;
-                }
-            }
+    if (!(tHReg.TCR & 0x01)) // Timer Disabled
+        return 0;
+
+    v810_resetTimer(cycles);
+    if (tHReg.tCount)
+        tHReg.tCount--;
+    tHReg.TLB = (tHReg.tCount&0xFF);
+    tHReg.THB = ((tHReg.tCount>>8)&0xFF);
+    if (tHReg.tCount == 0) {
+        tHReg.tCount = tHReg.tTHW; //reset counter
+        tHReg.TCR |= 0x02; //Zero Status
+        if (tHReg.TCR & 0x08) {
+            v810_int(1, PC);
+            return 1;
         }
     }
 
     return 0;
 }
 
+// Schedules the next step of serviceDisplayInt after the one at the given cycle
+static void scheduleDisplayInt(unsigned int cycles) {
+    // Thresholds for rows 0x1C to 0x21
+    static const unsigned int row_time[6] = {
+        0x10000, 0x18000, 0x20000, 0x28000, 0x38000, 0x42000
+    };
+    unsigned int tfb = (cycles-lastfb);
+    unsigned int next = 0x0A00;
+
+    if (rowcount < 0x1C) {
+        if ((rowcount == 0) && (!tmp1))
+            next = 0x0210;
+        else if (!(tVIPREG.XPSTTS&0x8000))
+            next = 0x0500;
+        else if ((rowcount == 0x12) && (tfb <= 0x0670))
+            next = 0x0670;
+    } else if (rowcount <= 0x21) {
+        next = row_time[rowcount - 0x1C];
+    }
+
+    sched_schedule(SCHED_VIP, cycles + ((tfb > next) ? 1 : next - tfb + 1));
+}
+
+// Starts the VIP from the beginning of a frame
+void v810_resetDisplay(unsigned int cycles) {
+    rowcount = 0;
+    tmp1 = 0;
+    lastfb = cycles;
+    scheduleDisplayInt(cycles);
+}
+
 int serviceDisplayInt(unsigned int cycles, WORD PC) {
-    static unsigned int lastfb=0;
-    static int rowcount,tmp1,frames=0;
+    static int frames=0;
     int gamestart;
     unsigned int tfb = (cycles-lastfb);
     bool pending_int = 0;
@@ -239,7 +288,7 @@ int serviceDisplayInt(unsigned int cycles, WORD PC) {
             tVIPREG.INTPND |= (0x0010|gamestart);
 
             v810_state->ret = 1;
-            return 1;
+            pending_int = 1;
         } else if ((tfb > 0x0500) && (!(tVIPREG.XPSTTS&0x8000))) {
             tVIPREG.XPSTTS |= 0x8000;
         } else if (tfb > 0x0A00) {
@@ -305,8 +354,7 @@ int serviceDisplayInt(unsigned int cycles, WORD PC) {
         }
     }
 
-    if (!pending_int)
-        v810_state->PC = PC;
+    scheduleDisplayInt(cycles);
 
     return pending_int;
 }
@@ -326,6 +374,7 @@ void v810_int(WORD iNum, WORD PC) {
     v810_state->S_REG[EIPSW] = v810_state->S_REG[PSW];
 
     v810_state->PC = 0xFFFFFE00 | (iNum << 4);
+    v810_state->halted = 0;
 
     v810_state->S_REG[ECR] = 0xFE00 | (iNum << 4);
     v810_state->S_REG[PSW] = v810_state->S_REG[PSW] | PSW_EP;
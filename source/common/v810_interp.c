@@ -0,0 +1,574 @@
+////////////////////////////////////////////////////////////
+// Threaded interpreter for the V810. It shares cpu_state with the dynarec,
+// flags included, so both can run the same code one after the other.
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "vb_types.h"
+#include "v810_opt.h"
+#include "v810_cpu.h"
+#include "v810_mem.h"
+#include "v810_ins.h"
+#include "drc_core.h"
+#include "vb_sched.h"
+#include "vb_prof.h"
+
+// Decoded ROM instructions, indexed by PC. RAM code is decoded every time
+// since it can change under us.
+#define INTERP_CACHE_SIZE 0x4000
+
+typedef struct {
+    WORD PC; // 0 if empty, ROM PCs are never 0
+    WORD imm;
+    BYTE opcode;
+    BYTE reg1, reg2;
+    BYTE size;
+} interp_inst;
+
+static interp_inst interp_cache[INTERP_CACHE_SIZE];
+
+// v810_state->flags holds the flags the way the translated code keeps them
+// in the CPSR, with C set on V810 carry (borrow for subtractions)
+#define IFLAG_N (1U << 31)
+#define IFLAG_Z (1U << 30)
+#define IFLAG_C (1U << 29)
+#define IFLAG_V (1U << 28)
+#define IFLAGS_ALL (IFLAG_N | IFLAG_Z | IFLAG_C | IFLAG_V)
+
+void v810_interpReset() {
+    memset(interp_cache, 0, sizeof(interp_cache));
+}
+
+// Fills inst with the instruction at PC. Returns false if PC isn't in RAM or
+// ROM.
+static bool interp_decode(WORD PC, interp_inst* inst) {
+    BYTE* mem;
+    BYTE lowB, highB, lowB2, highB2;
+
+    if ((PC >> 24) == 0x05)
+        mem = (BYTE *)(V810_VB_RAM.off + (PC & V810_VB_RAM.highaddr));
+    else if ((PC >> 24) == 0x07)
+        mem = (BYTE *)(V810_ROM1.off + PC);
+    else
+        return false;
+    lowB = mem[0];
+    highB = mem[1];
+
+    inst->PC = PC;
+    inst->opcode = highB >> 2;
+    if ((highB & 0xE0) == 0x80) // Special opcode format for
+        inst->opcode = highB >> 1; // type III instructions.
+    inst->size = am_size_table[optable[inst->opcode].addr_mode];
+    inst->reg1 = lowB & 0x1F;
+    inst->reg2 = (lowB >> 5) + ((highB & 0x3) << 3);
+
+    if (inst->size == 4) {
+        lowB2 = mem[2];
+        highB2 = mem[3];
+        if (optable[inst->opcode].addr_mode == AM_IV)
+            inst->imm = sign_26(((highB & 0x3) << 24) + (lowB << 16) + (highB2 << 8) + lowB2);
+        else if (optable[inst->opcode].addr_mode == AM_FPP)
+            inst->imm = (highB2 >> 2) & 0x3F;
+        else
+            inst->imm = (highB2 << 8) + lowB2;
+    } else if (optable[inst->opcode].addr_mode == AM_III) {
+        inst->imm = sign_9(((highB & 0x1) << 8) + (lowB & 0xFE));
+    } else {
+        inst->imm = lowB & 0x1F;
+    }
+    // Undefined opcodes are skipped as 16-bit instructions
+    if (!inst->size)
+        inst->size = 2;
+
+    return true;
+}
+
+static interp_inst* interp_fetch(WORD PC, interp_inst* tmp) {
+    interp_inst* inst;
+
+    PC &= 0x07FFFFFE;
+    if ((PC >> 24) == 0x07) {
+        PC &= V810_ROM1.highaddr;
+        inst = &interp_cache[(PC >> 1) & (INTERP_CACHE_SIZE - 1)];
+        if (inst->PC != PC)
+            interp_decode(PC, inst);
+        return inst;
+    }
+    return interp_decode(PC, tmp) ? tmp : NULL;
+}
+
+// Tells if the V810 condition code is true for the flags
+static bool interp_cond(BYTE cond, WORD flags) {
+    bool n = (flags & IFLAG_N) != 0;
+    bool z = (flags & IFLAG_Z) != 0;
+    bool c = (flags & IFLAG_C) != 0;
+    bool v = (flags & IFLAG_V) != 0;
+    bool ret;
+
+    switch (cond & 0x7) {
+        case COND_V:  ret = v; break;
+        case COND_C:  ret = c; break;
+        case COND_Z:  ret = z; break;
+        case COND_NH: ret = c || z; break;
+        case COND_S:  ret = n; break;
+        case COND_T:  ret = true; break;
+        case COND_LT: ret = n != v; break;
+        default:      ret = (n != v) || z; break; // COND_LE
+    }
+    return (cond & 0x8) ? !ret : ret;
+}
+
+// Z and S for a result, the rest of the flags cleared
+#define ZS(res) ((((res) == 0) ? IFLAG_Z : 0) | ((res) & IFLAG_N))
+
+static WORD interp_addFlags(WORD a, WORD b, WORD res) {
+    return ZS(res) | ((res < a) ? IFLAG_C : 0) |
+        ((((~(a ^ b)) & (a ^ res)) >> 31) ? IFLAG_V : 0);
+}
+
+// For a - b
+static WORD interp_subFlags(WORD a, WORD b, WORD res) {
+    return ZS(res) | ((a < b) ? IFLAG_C : 0) |
+        (((((a ^ b)) & (a ^ res)) >> 31) ? IFLAG_V : 0);
+}
+
+// Floating point results set CY along with S
+static WORD interp_floatFlags(float res) {
+    return ((res == 0.0F) ? IFLAG_Z : 0) | ((res < 0.0F) ? (IFLAG_N | IFLAG_C) : 0);
+}
+
+static float interp_toFloat(WORD w) {
+    float f;
+    memcpy(&f, &w, 4);
+    return f;
+}
+
+static WORD interp_fromFloat(float f) {
+    WORD w;
+    memcpy(&w, &f, 4);
+    return w;
+}
+
+// Runs instructions from v810_state->PC until the next event is due. If
+// one_block is set, it stops after the first jump or taken branch instead, and
+// one_inst stops it after a single instruction. Returns nonzero on error.
+static int interp_exec(bool one_block, bool one_inst) {
+    static void* const labels[0x50] = {
+        &&op_mov, &&op_add, &&op_sub, &&op_cmp, &&op_shl, &&op_shr, &&op_jmp, &&op_sar,
+        &&op_mul, &&op_div, &&op_mulu, &&op_divu, &&op_or, &&op_and, &&op_xor, &&op_not,
+        &&op_mov_i, &&op_add_i, &&op_setf, &&op_cmp_i, &&op_shl_i, &&op_shr_i, &&op_cli, &&op_sar_i,
+        &&op_trap, &&op_reti, &&op_halt, &&op_undef, &&op_ldsr, &&op_stsr, &&op_sei, &&op_bstr,
+        &&op_undef, &&op_undef, &&op_undef, &&op_undef, &&op_undef, &&op_undef, &&op_undef, &&op_undef,
+        &&op_movea, &&op_addi, &&op_jr, &&op_jal, &&op_ori, &&op_andi, &&op_xori, &&op_movhi,
+        &&op_ld_b, &&op_ld_h, &&op_undef, &&op_ld_w, &&op_st_b, &&op_st_h, &&op_undef, &&op_st_w,
+        &&op_in_b, &&op_in_h, &&op_caxi, &&op_in_w, &&op_st_b, &&op_st_h, &&op_fpp, &&op_st_w,
+        &&op_bcond, &&op_bcond, &&op_bcond, &&op_bcond, &&op_bcond, &&op_bcond, &&op_bcond, &&op_bcond,
+        &&op_bcond, &&op_bcond, &&op_bcond, &&op_bcond, &&op_bcond, &&op_nop, &&op_bcond, &&op_bcond,
+    };
+    WORD* reg = v810_state->P_REG;
+    WORD PC = v810_state->PC;
+    WORD flags = v810_state->flags;
+    // Cycles run since v810_state->cycles, like r10 in the translated code
+    int run = 0;
+    // Where run has to stop. Any instruction takes at least one cycle.
+    const int step_limit = 1;
+    const int* limit = one_inst ? &step_limit : &v810_state->next_event;
+    interp_inst* inst;
+    interp_inst tmp;
+    WORD a, b, res, addr;
+    INT64 wide;
+    int err = 0;
+
+// Fetches and jumps to the next instruction, unless an event is due. The
+// next event is read every time since I/O writes can move it.
+#define DISPATCH() \
+    do { \
+        reg[0] = 0; \
+        if (run >= *limit) \
+            goto done; \
+        if (!(inst = interp_fetch(PC, &tmp))) { \
+            err = DRC_ERR_BAD_PC; \
+            goto done; \
+        } \
+        run += opcycle[inst->opcode]; \
+        goto *labels[inst->opcode]; \
+    } while (0)
+// Goes on to the next instruction in memory
+#define NEXT() \
+    do { \
+        PC += inst->size; \
+        DISPATCH(); \
+    } while (0)
+// Goes on to a new PC after a jump
+#define JUMP(target) \
+    do { \
+        PC = (target); \
+        if (one_block) { \
+            reg[0] = 0; \
+            goto done; \
+        } \
+        DISPATCH(); \
+    } while (0)
+#define SETFLAGS(mask, value) \
+    flags = (flags & ~(mask)) | (value)
+#define R1 reg[inst->reg1]
+#define R2 reg[inst->reg2]
+#define DISP16 ((WORD)(signed short)inst->imm)
+#define IMM5 ((WORD)sign_5(inst->imm))
+
+    DISPATCH();
+
+op_mov:
+    R2 = R1;
+    NEXT();
+op_add:
+    a = R2; b = R1; res = a + b;
+    SETFLAGS(IFLAGS_ALL, interp_addFlags(a, b, res));
+    R2 = res;
+    NEXT();
+op_sub:
+    a = R2; b = R1; res = a - b;
+    SETFLAGS(IFLAGS_ALL, interp_subFlags(a, b, res));
+    R2 = res;
+    NEXT();
+op_cmp:
+    a = R2; b = R1; res = a - b;
+    SETFLAGS(IFLAGS_ALL, interp_subFlags(a, b, res));
+    NEXT();
+op_shl:
+    b = R1 & 0x1F;
+    a = R2;
+shl:
+    res = a << b;
+    SETFLAGS(IFLAGS_ALL, ZS(res) | ((b && ((a >> (32 - b)) & 1)) ? IFLAG_C : 0));
+    R2 = res;
+    NEXT();
+op_shr:
+    b = R1 & 0x1F;
+    a = R2;
+shr:
+    res = a >> b;
+    SETFLAGS(IFLAGS_ALL, ZS(res) | ((b && ((a >> (b - 1)) & 1)) ? IFLAG_C : 0));
+    R2 = res;
+    NEXT();
+op_sar:
+    b = R1 & 0x1F;
+    a = R2;
+sar:
+    res = (WORD)((int)a >> b);
+    SETFLAGS(IFLAGS_ALL, ZS(res) | ((b && ((a >> (b - 1)) & 1)) ? IFLAG_C : 0));
+    R2 = res;
+    NEXT();
+op_jmp:
+    JUMP(R1 & 0xFFFFFFFE);
+op_mul:
+    wide = (INT64)(int)R2 * (int)R1;
+    res = (WORD)wide;
+    SETFLAGS(IFLAG_N | IFLAG_Z | IFLAG_V, ZS(res) | ((wide != (int)res) ? IFLAG_V : 0));
+    reg[30] = (WORD)(wide >> 32);
+    R2 = res;
+    NEXT();
+op_mulu:
+    wide = (INT64)((INT64U)R2 * R1);
+    res = (WORD)wide;
+    SETFLAGS(IFLAG_N | IFLAG_Z | IFLAG_V, ZS(res) | ((wide >> 32) ? IFLAG_V : 0));
+    reg[30] = (WORD)((INT64U)wide >> 32);
+    R2 = res;
+    NEXT();
+op_div:
+    a = R2; b = R1;
+    // Division by zero would be an exception, the dynarec ignores it too
+    if (b) {
+        if (a == 0x80000000 && b == 0xFFFFFFFF) {
+            res = a;
+            reg[30] = 0;
+        } else {
+            res = (WORD)((int)a / (int)b);
+            reg[30] = (WORD)((int)a % (int)b);
+        }
+        SETFLAGS(IFLAG_N | IFLAG_Z | IFLAG_V, ZS(res) |
+            ((a == 0x80000000 && b == 0xFFFFFFFF) ? IFLAG_V : 0));
+        R2 = res;
+    }
+    NEXT();
+op_divu:
+    a = R2; b = R1;
+    if (b) {
+        res = a / b;
+        reg[30] = a % b;
+        SETFLAGS(IFLAG_N | IFLAG_Z | IFLAG_V, ZS(res));
+        R2 = res;
+    }
+    NEXT();
+op_or:
+    res = R2 | R1;
+    SETFLAGS(IFLAG_N | IFLAG_Z | IFLAG_V, ZS(res));
+    R2 = res;
+    NEXT();
+op_and:
+    res = R2 & R1;
+    SETFLAGS(IFLAG_N | IFLAG_Z | IFLAG_V, ZS(res));
+    R2 = res;
+    NEXT();
+op_xor:
+    res = R2 ^ R1;
+    SETFLAGS(IFLAG_N | IFLAG_Z | IFLAG_V, ZS(res));
+    R2 = res;
+    NEXT();
+op_not:
+    res = ~R1;
+    SETFLAGS(IFLAG_N | IFLAG_Z | IFLAG_V, ZS(res));
+    R2 = res;
+    NEXT();
+
+op_mov_i:
+    R2 = IMM5;
+    NEXT();
+op_add_i:
+    a = R2; b = IMM5; res = a + b;
+    SETFLAGS(IFLAGS_ALL, interp_addFlags(a, b, res));
+    R2 = res;
+    NEXT();
+op_setf:
+    R2 = interp_cond(inst->imm & 0xF, flags);
+    NEXT();
+op_cmp_i:
+    a = R2; b = IMM5; res = a - b;
+    SETFLAGS(IFLAGS_ALL, interp_subFlags(a, b, res));
+    NEXT();
+op_shl_i:
+    b = inst->imm;
+    a = R2;
+    goto shl;
+op_shr_i:
+    b = inst->imm;
+    a = R2;
+    goto shr;
+op_sar_i:
+    b = inst->imm;
+    a = R2;
+    goto sar;
+op_cli:
+    v810_state->S_REG[PSW] &= ~PSW_ID;
+    NEXT();
+op_sei:
+    v810_state->S_REG[PSW] |= PSW_ID;
+    NEXT();
+op_trap:
+    // The exception returns to the next instruction
+    v810_state->PC = PC + inst->size;
+    v810_exp((inst->imm & 0x10) ? 0xB : 0xA, 0xFFA0 + inst->imm);
+    JUMP(v810_state->PC);
+op_reti:
+    if (v810_state->S_REG[PSW] & PSW_NP) {
+        PC = v810_state->S_REG[FEPC];
+        v810_state->S_REG[PSW] = v810_state->S_REG[FEPSW];
+    } else {
+        PC = v810_state->S_REG[EIPC];
+        v810_state->S_REG[PSW] = v810_state->S_REG[EIPSW];
+    }
+    JUMP(PC);
+op_halt:
+    // Sleep until an interrupt, see v810_interpRun
+    PC += inst->size;
+    v810_state->halted = 1;
+    reg[0] = 0;
+    goto done;
+op_ldsr:
+    v810_state->S_REG[inst->imm] = R2;
+    NEXT();
+op_stsr:
+    R2 = v810_state->S_REG[inst->imm];
+    NEXT();
+op_bstr:
+    // Same helpers as the dynarec, with the operands in r26-r30
+    if (inst->reg1 < 16)
+        ((void (*)(int, int))bssuboptable[inst->reg1].func)(0, 0);
+    NEXT();
+op_undef:
+    dprintf(0, "[INT]: %s (0x%x) not implemented @ 0x%x\n", optable[inst->opcode].opname, inst->opcode, PC);
+    NEXT();
+
+op_movea:
+    R2 = R1 + DISP16;
+    NEXT();
+op_addi:
+    a = R1; b = DISP16; res = a + b;
+    SETFLAGS(IFLAGS_ALL, interp_addFlags(a, b, res));
+    R2 = res;
+    NEXT();
+op_jr:
+    JUMP(PC + inst->imm);
+op_jal:
+    reg[31] = PC + 4;
+    JUMP(PC + inst->imm);
+op_ori:
+    res = R1 | inst->imm;
+    SETFLAGS(IFLAG_N | IFLAG_Z | IFLAG_V, ZS(res));
+    R2 = res;
+    NEXT();
+op_andi:
+    res = R1 & inst->imm;
+    SETFLAGS(IFLAG_N | IFLAG_Z | IFLAG_V, ZS(res));
+    R2 = res;
+    NEXT();
+op_xori:
+    res = R1 ^ inst->imm;
+    SETFLAGS(IFLAG_N | IFLAG_Z | IFLAG_V, ZS(res));
+    R2 = res;
+    NEXT();
+op_movhi:
+    R2 = R1 + (inst->imm << 16);
+    NEXT();
+
+op_ld_b:
+    R2 = (WORD)(signed char)mem_rbyte(R1 + DISP16);
+    NEXT();
+op_ld_h:
+    R2 = (WORD)(signed short)mem_rhword((R1 + DISP16) & ~1);
+    NEXT();
+op_ld_w:
+    R2 = mem_rword((R1 + DISP16) & ~3);
+    NEXT();
+op_in_b:
+    R2 = port_rbyte(R1 + DISP16);
+    NEXT();
+op_in_h:
+    R2 = port_rhword((R1 + DISP16) & ~1);
+    NEXT();
+op_in_w:
+    R2 = port_rword((R1 + DISP16) & ~3);
+    NEXT();
+// OUT is the same as ST on the VB
+op_st_b:
+    mem_wbyte(R1 + DISP16, (BYTE)R2);
+    NEXT();
+op_st_h:
+    mem_whword((R1 + DISP16) & ~1, (HWORD)R2);
+    NEXT();
+op_st_w:
+    mem_wword((R1 + DISP16) & ~3, R2);
+    NEXT();
+op_caxi:
+    addr = (R1 + DISP16) & ~3;
+    a = R2;
+    b = mem_rword(addr);
+    res = a - b;
+    SETFLAGS(IFLAGS_ALL, interp_subFlags(a, b, res));
+    mem_wword(addr, (a == b) ? reg[30] : b);
+    R2 = b;
+    NEXT();
+
+op_fpp:
+    switch (inst->imm) {
+        case V810_OP_CMPF_S:
+            SETFLAGS(IFLAGS_ALL, interp_floatFlags(interp_toFloat(R2) - interp_toFloat(R1)));
+            break;
+        case V810_OP_CVT_WS:
+            R2 = interp_fromFloat((float)(int)R1);
+            SETFLAGS(IFLAGS_ALL, interp_floatFlags(interp_toFloat(R2)));
+            break;
+        case V810_OP_CVT_SW:
+            R2 = (WORD)lroundf(interp_toFloat(R1));
+            SETFLAGS(IFLAG_N | IFLAG_Z | IFLAG_V, ZS(R2));
+            break;
+        case V810_OP_TRNC_SW:
+            R2 = (WORD)(int)truncf(interp_toFloat(R1));
+            SETFLAGS(IFLAG_N | IFLAG_Z | IFLAG_V, ZS(R2));
+            break;
+        case V810_OP_ADDF_S:
+            R2 = interp_fromFloat(interp_toFloat(R2) + interp_toFloat(R1));
+            SETFLAGS(IFLAGS_ALL, interp_floatFlags(interp_toFloat(R2)));
+            break;
+        case V810_OP_SUBF_S:
+            R2 = interp_fromFloat(interp_toFloat(R2) - interp_toFloat(R1));
+            SETFLAGS(IFLAGS_ALL, interp_floatFlags(interp_toFloat(R2)));
+            break;
+        case V810_OP_MULF_S:
+            R2 = interp_fromFloat(interp_toFloat(R2) * interp_toFloat(R1));
+            SETFLAGS(IFLAGS_ALL, interp_floatFlags(interp_toFloat(R2)));
+            break;
+        case V810_OP_DIVF_S:
+            R2 = interp_fromFloat(interp_toFloat(R2) / interp_toFloat(R1));
+            SETFLAGS(IFLAGS_ALL, interp_floatFlags(interp_toFloat(R2)));
+            break;
+        case V810_OP_XB:
+            ins_xb(inst->reg2, inst->reg1);
+            break;
+        case V810_OP_XH:
+            ins_xh(inst->reg2, inst->reg1);
+            break;
+        case V810_OP_REV:
+            ins_rev(inst->reg2, inst->reg1);
+            break;
+        case V810_OP_MPYHW:
+            ins_mpyhw(inst->reg2, inst->reg1);
+            break;
+        default:
+            dprintf(0, "[INT]: FPP 0x%x not implemented @ 0x%x\n", inst->imm, PC);
+            break;
+    }
+    NEXT();
+
+op_bcond:
+    if (interp_cond(inst->opcode & 0xF, flags))
+        JUMP(PC + inst->imm);
+    NEXT();
+op_nop:
+    NEXT();
+
+done:
+    v810_state->PC = PC;
+    v810_state->flags = flags;
+    v810_state->cycles += run;
+    return err;
+
+#undef DISPATCH
+#undef NEXT
+#undef JUMP
+#undef SETFLAGS
+#undef R1
+#undef R2
+#undef DISP16
+#undef IMM5
+}
+
+// Runs from v810_state->PC until the first jump or taken branch, or until the
+// next event is due. Lets drc_run get past code it can't translate.
+int v810_interpBlock() {
+    return interp_exec(true, false);
+}
+
+// Runs the instruction at v810_state->PC, whatever the next event is. Used to
+// replay translated code in lockstep (see drc_lockstepCheck).
+int v810_interpStep() {
+    return interp_exec(false, true);
+}
+
+// Run V810 code until the next frame interrupt, without the dynarec
+int v810_interpRun() {
+    int err;
+
+    while (true) {
+        sched_run(v810_state->cycles, v810_state->PC);
+        if (v810_state->ret)
+            break;
+
+        // Nothing runs while halted, so go straight to the next event
+        if (v810_state->halted) {
+            v810_state->cycles += v810_state->next_event;
+            continue;
+        }
+
+        PROF_START(PROF_EXECUTE);
+        err = interp_exec(false, false);
+        PROF_STOP(PROF_EXECUTE);
+        if (err)
+            return err;
+    }
+    v810_state->ret = 0;
+
+    return 0;
+}
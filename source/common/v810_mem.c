@@ -3,389 +3,349 @@
 #include "vb_dsp.h"
 #include "vb_set.h"
 #include "vb_sound.h"
+#include "vb_prof.h"
 #include "v810_mem.h"
+#include "drc_core.h"
 
 int is_sram = 0;
 
+uintptr_t mem_rpages[MEM_NUM_PAGES];
+uintptr_t mem_wpages[MEM_NUM_PAGES];
+
+static V810_REGFETCH mem_handlers[MEM_NUM_HANDLERS];
+
+// Host address of addr, for the pages that are read directly but written
+// through a handler
+#define MEM_HOST(addr) (mem_rpages[(addr) >> MEM_PAGE_BITS] + ((addr) & MEM_PAGE_MASK))
+
 // Memory read functions
 BYTE mem_rbyte(WORD addr) {
-    addr = addr & 0x07FFFFFF; // map to 24 bit address CFFFFFFF
-
-    switch((addr&0x7000000)) {// switch on address
-    case 0x7000000:
-        return ((BYTE *)(V810_ROM1.off + (addr & V810_ROM1.highaddr)))[0];
-        break;
-    case 0:
-        if((addr >= V810_DISPLAY_RAM.lowaddr)&&(addr <=V810_DISPLAY_RAM.highaddr)) {
-            return ((BYTE *)(V810_DISPLAY_RAM.off + addr))[0];
-        } else if((addr >= V810_VIPCREG.lowaddr)&&(addr <=V810_VIPCREG.highaddr)) {
-            return (*V810_VIPCREG.rfuncb)(addr);
-            // Mirror the Chr ram table to 078000-07FFFF
-        } else  if((addr >= 0x00078000)&&(addr <= 0x0007FFFF)) {
-            if(addr < 0x0007A000) //CHR 0-511
-                return ((BYTE *)(V810_DISPLAY_RAM.off + (addr-0x00078000 + 0x00006000)))[0];
-            else if(addr < 0x0007C000) //CHR 512-1023
-                return ((BYTE *)(V810_DISPLAY_RAM.off + (addr-0x0007A000 + 0x0000E000)))[0];
-            else if(addr < 0x0007E000) //CHR 1024-1535
-                return ((BYTE *)(V810_DISPLAY_RAM.off + (addr-0x0007C000 + 0x00016000)))[0];
-            else //CHR 1536-2047
-                return ((BYTE *)(V810_DISPLAY_RAM.off + (addr-0x0007E000 + 0x0001E000)))[0];
-        }
-        break;
-    case 0x1000000:
-        if((addr >= V810_SOUND_RAM.lowaddr)&&(addr <=V810_SOUND_RAM.highaddr)) {
-            //~ dtprintf(0,ferr,"\nRead  BYTE  [%08x]:%02x  //SoundRam",addr,((BYTE *)(V810_SOUND_RAM.off + addr))[0]);
-            return ((BYTE *)(V810_SOUND_RAM.off + addr))[0];
-        }
-        break;
-    case 0x5000000:
-        //~ dtprintf(0,ferr,"\nRead  BYTE  [%08x]:%02x  //VBRam",addr,((BYTE *)(V810_VB_RAM.off + (addr & V810_VB_RAM.highaddr)))[0]);
-        return ((BYTE *)(V810_VB_RAM.off + (addr & V810_VB_RAM.highaddr)))[0];
-        break;
-    case 0x6000000:
-        is_sram = 1;
-        //~ dtprintf(0,ferr,"\nRead  BYTE  PC:%08x [%08x]:%02x  //GameRam",PC,addr,((BYTE *)(V810_GAME_RAM.off + (addr & V810_GAME_RAM.highaddr)))[0]);
-        return ((BYTE *)(V810_GAME_RAM.off + (addr & V810_GAME_RAM.highaddr)))[0];
-        break;
-    case 0x2000000:
-        if((addr >= V810_HCREG.lowaddr)&&(addr <=V810_HCREG.highaddr)) {
-            return (*V810_HCREG.rfuncb)(addr);
-        }
-        break;
-    default:
-        //~ dtprintf(0,ferr,"\nRead  BYTE  [%08x]:%02x",addr,0);
-        return(0);
-        break;
-    }// End switch on address
-    return(0); //Stops a silly compiler error
+    uintptr_t page;
+
+    addr = addr & 0x07FFFFFF; // map to 27 bit address
+    page = mem_rpages[addr >> MEM_PAGE_BITS];
+    if (page >= MEM_NUM_HANDLERS)
+        return ((BYTE *)page)[addr & MEM_PAGE_MASK];
+    return (*mem_handlers[page].rfuncb)(addr);
 }
 
 HWORD mem_rhword(WORD addr) {
-    addr = addr & 0x07FFFFFE; // map to 24 bit address, mask first bit
-
-    //~ if(dbg_watchpt_en)
-    //~ dbg_watchpt(addr, 16, 0, 0);
-
-    switch((addr&0x7000000)) {
-    case 0x7000000:
-        return ((HWORD *)(V810_ROM1.off + (addr & V810_ROM1.highaddr)))[0]; // does this work?
-        break;
-    case 0:
-        if((addr >= V810_DISPLAY_RAM.lowaddr)&&(addr <=V810_DISPLAY_RAM.highaddr)) {
-            return ((HWORD *)(V810_DISPLAY_RAM.off + addr))[0];
-        } else if((addr >= V810_VIPCREG.lowaddr)&&(addr <=V810_VIPCREG.highaddr)) {
-            return (*V810_VIPCREG.rfunch)(addr);
-            // Mirror the Chr ram table to 078000-07FFFF
-        } else  if((addr >= 0x00078000)&&(addr <= 0x0007FFFF)) {
-            if(addr < 0x0007A000) //CHR 0-511
-                return ((HWORD *)(V810_DISPLAY_RAM.off + (addr-0x00078000 + 0x00006000)))[0];
-            else if(addr < 0x0007C000) //CHR 512-1023
-                return ((HWORD *)(V810_DISPLAY_RAM.off + (addr-0x0007A000 + 0x0000E000)))[0];
-            else if(addr < 0x0007E000) //CHR 1024-1535
-                return ((HWORD *)(V810_DISPLAY_RAM.off + (addr-0x0007C000 + 0x00016000)))[0];
-            else //CHR 1536-2047
-                return ((HWORD *)(V810_DISPLAY_RAM.off + (addr-0x0007E000 + 0x0001E000)))[0];
-        }
-        break;
-    case 0x1000000:
-        if((addr >= V810_SOUND_RAM.lowaddr)&&(addr <=V810_SOUND_RAM.highaddr)) {
-            //~ dtprintf(0,ferr,"\nRead  HWORD [%08x]:%04x  //SoundRam",addr,((HWORD *)(V810_SOUND_RAM.off + addr))[0]);
-            return ((HWORD *)(V810_SOUND_RAM.off + addr))[0];
-        }
-        break;
-    case 0x5000000:
-        //~ dtprintf(0,ferr,"\nRead  HWORD [%08x]:%04x  //VBRam",addr,((HWORD *)(V810_VB_RAM.off + (addr & V810_VB_RAM.highaddr)))[0]);
-        return ((HWORD *)(V810_VB_RAM.off + (addr & V810_VB_RAM.highaddr)))[0];
-        break;
-    case 0x6000000:
-        is_sram = 1;
-        //~ dtprintf(0,ferr,"\nRead  HWORD PC:%08x [%08x]:%04x  //GameRam",PC,addr,((HWORD *)(V810_GAME_RAM.off + (addr & V810_GAME_RAM.highaddr)))[0]);
-        return ((HWORD *)(V810_GAME_RAM.off + (addr & V810_GAME_RAM.highaddr)))[0];
-        break;
-    case 0x2000000:
-        if((addr >= V810_HCREG.lowaddr)&&(addr <=V810_HCREG.highaddr)) {
-            return (*V810_HCREG.rfunch)(addr);
-        }
-        break;
-    default:
-        //~ dtprintf(0,ferr,"\nRead  HWORD [%08x]:%04x",addr,0);
-        return(0);
-        break;
-    }
-    return(0); //Stops a silly compiler error
+    uintptr_t page;
+
+    addr = addr & 0x07FFFFFE; // map to 27 bit address, mask first bit
+    page = mem_rpages[addr >> MEM_PAGE_BITS];
+    if (page >= MEM_NUM_HANDLERS)
+        return ((HWORD *)(page + (addr & MEM_PAGE_MASK)))[0];
+    return (*mem_handlers[page].rfunch)(addr);
 }
 
 WORD mem_rword(WORD addr) {
-    addr = addr & 0x07FFFFFC; // map to 24 bit address, mask first 2 bytes to zero
-
-    //~ if(dbg_watchpt_en)
-    //~ dbg_watchpt(addr, 32, 0, 0);
-
-    switch((addr&0x7000000)) {
-    case 0x7000000:
-        return ((WORD *)(V810_ROM1.off + (addr & V810_ROM1.highaddr)))[0];
-        break;
-    case 0:
-        if((addr >= V810_DISPLAY_RAM.lowaddr)&&(addr <=V810_DISPLAY_RAM.highaddr)) {
-            return ((WORD *)(V810_DISPLAY_RAM.off + addr))[0];
-        } else if((addr >= V810_VIPCREG.lowaddr)&&(addr <=V810_VIPCREG.highaddr)) {
-            return (*V810_VIPCREG.rfuncw)(addr);
-            // Mirror the Chr ram table to 078000-07FFFF
-        } else  if((addr >= 0x00078000)&&(addr <= 0x0007FFFF)) {
-            if(addr < 0x0007A000) //CHR 0-511
-                return ((WORD *)(V810_DISPLAY_RAM.off + (addr-0x00078000 + 0x00006000)))[0];
-            else if(addr < 0x0007C000) //CHR 512-1023
-                return ((WORD *)(V810_DISPLAY_RAM.off + (addr-0x0007A000 + 0x0000E000)))[0];
-            else if(addr < 0x0007E000) //CHR 1024-1535
-                return ((WORD *)(V810_DISPLAY_RAM.off + (addr-0x0007C000 + 0x00016000)))[0];
-            else //CHR 1536-2047
-                return ((WORD *)(V810_DISPLAY_RAM.off + (addr-0x0007E000 + 0x0001E000)))[0];
-        }
-        break;
-    case 0x1000000:
-        if((addr >= V810_SOUND_RAM.lowaddr)&&(addr <=V810_SOUND_RAM.highaddr)) {
-            //~ dtprintf(0,ferr,"\nRead  WORD  [%08x]:%08x  //SoundRam",addr,((WORD *)(V810_SOUND_RAM.off + addr))[0]);
-            return ((WORD *)(V810_SOUND_RAM.off + addr))[0];
-        }
-        break;
-    case 0x5000000:
-        //~ dtprintf(0,ferr,"\nRead  WORD  [%08x]:%08x  //VBRam",addr,((WORD *)(V810_VB_RAM.off + (addr & V810_VB_RAM.highaddr)))[0]);
-        return ((WORD *)(V810_VB_RAM.off + (addr & V810_VB_RAM.highaddr)))[0];
-        break;
-    case 0x6000000:
-        is_sram = 1;
-        //~ dtprintf(0,ferr,"\nRead  WORD  PC:%08x [%08x]:%08x  //GameRam",PC,addr,((WORD *)(V810_GAME_RAM.off + (addr & V810_GAME_RAM.highaddr)))[0]);
-        return ((WORD *)(V810_GAME_RAM.off + (addr & V810_GAME_RAM.highaddr)))[0];
-        break;
-    case 0x2000000:
-        if((addr >= V810_HCREG.lowaddr)&&(addr <=V810_HCREG.highaddr)) {
-            return (*V810_HCREG.rfuncw)(addr);
-        }
-        break;
-    default:
-        //~ dtprintf(0,ferr,"\nRead  WORD  [%08x]:%08x",addr,0);
-        return(0);
-        break;
-    }
-    return(0); //Stops a silly compiler error
+    uintptr_t page;
+
+    addr = addr & 0x07FFFFFC; // map to 27 bit address, mask first 2 bits
+    page = mem_rpages[addr >> MEM_PAGE_BITS];
+    if (page >= MEM_NUM_HANDLERS)
+        return ((WORD *)(page + (addr & MEM_PAGE_MASK)))[0];
+    return (*mem_handlers[page].rfuncw)(addr);
 }
 
 /////////////////////////////////////////////////////////////////////////////
 //Memory Write Func
 void mem_wbyte(WORD addr, BYTE data) {
-    int i =0;
-    addr = addr & 0x07FFFFFF; // map to 24 bit address
-
-    //~ if(dbg_watchpt_en)
-    //~ dbg_watchpt(addr, 8, 1, data);
-
-    switch((addr&0x7000000)) {
-    case 0:
-        if((addr >= V810_DISPLAY_RAM.lowaddr)&&(addr <=V810_DISPLAY_RAM.highaddr)) {
-            ((BYTE *)(V810_DISPLAY_RAM.off + addr))[0] = data;
-
-            if(addr < BGMAP_OFFSET) {
-                //Kill it if writes to Char Table
-                if(((addr>=0x00006000)&&(addr<0x00008000)) |
-                        ((addr>=0x0000E000)&&(addr<0x00010000)) |
-                        ((addr>=0x00016000)&&(addr<0x00018000)) |
-                        ((addr>=0x0001E000)&&(addr<0x00020000))) {
-                    for(i=0;i<14;i++) tDSPCACHE.BGCacheInvalid[i]=1;
-                    tDSPCACHE.ObjDataCacheInvalid=1;
-                } else { //Direct Mem Writes, darn thoes fragmented memorys!!!
-                    //tDSPCACHE.DDSPDataWrite=1;
-                }
-            }else if((addr >=OBJ_OFFSET)&&(addr < (OBJ_OFFSET+(OBJ_SIZE*1024)))) { //Writes to Obj Table
-                tDSPCACHE.ObjDataCacheInvalid=1;
-            } else if((addr >=BGMAP_OFFSET)&&(addr < (BGMAP_OFFSET+(14*BGMAP_SIZE)))) { //Writes to BGMap Table
-                tDSPCACHE.BGCacheInvalid[((addr-BGMAP_OFFSET)/BGMAP_SIZE)]=1;
-            }
-        } else if((addr >= V810_VIPCREG.lowaddr)&&(addr <=V810_VIPCREG.highaddr)) {
-            (*V810_VIPCREG.wfuncb)(addr,data);
-            // Mirror the Chr ram table to 078000-07FFFF
-        } else  if((addr >= 0x00078000)&&(addr <= 0x0007FFFF)) {
-            if(addr < 0x0007A000) //CHR 0-511
-                ((BYTE *)(V810_DISPLAY_RAM.off + ((addr-0x00078000) + 0x00006000)))[0] = data;
-            else if(addr < 0x0007C000) //CHR 512-1023
-                ((BYTE *)(V810_DISPLAY_RAM.off + ((addr-0x0007A000) + 0x0000E000)))[0] = data;
-            else if(addr < 0x0007E000) //CHR 1024-1535
-                ((BYTE *)(V810_DISPLAY_RAM.off + ((addr-0x0007C000) + 0x00016000)))[0] = data;
-            else //CHR 1536-2047
-                ((BYTE *)(V810_DISPLAY_RAM.off + ((addr-0x0007E000) + 0x0001E000)))[0] = data;
-            //Invalidate, writes to Char table
-            for(i=0;i<14;i++) tDSPCACHE.BGCacheInvalid[i]=1;
-            tDSPCACHE.ObjDataCacheInvalid=1;
-        }
-        break;
-    case 0x1000000:
-        if((addr >= V810_SOUND_RAM.lowaddr)&&(addr <=V810_SOUND_RAM.highaddr)) {
-            //~ dtprintf(0,ferr,"\nWrite BYTE  [%08x]:%02x  //SoundRam",addr,data);
-            ((BYTE *)(V810_SOUND_RAM.off + addr))[0] = data;
-            sound_update(addr);
-        }
-        break;
-    case 0x5000000:
-        //~ dtprintf(0,ferr,"\nWrite BYTE  [%08x]:%02x  //VBRam",addr,data);
-        ((BYTE *)(V810_VB_RAM.off + (addr & V810_VB_RAM.highaddr)))[0] = data;
-        break;
-    case 0x6000000:
-        is_sram = 1;
-        //~ dtprintf(0,ferr,"\nWrite BYTE  PC:%08x [%08x]:%02x  //GameRam",PC,addr,data);
-        ((BYTE *)(V810_GAME_RAM.off + (addr & V810_GAME_RAM.highaddr)))[0] = data;
-        break;
-    case 0x2000000:
-        if((addr >= V810_HCREG.lowaddr)&&(addr <=V810_HCREG.highaddr)) {
-            (*V810_HCREG.wfuncb)(addr,data);
-        }
-        break;
-    default:
-        //~ dtprintf(0,ferr,"\nWrite BYTE  [%08x]:%02x",addr,data);
-        break;
-    }
+    uintptr_t page;
+
+    addr = addr & 0x07FFFFFF;
+    page = mem_wpages[addr >> MEM_PAGE_BITS];
+    if (page >= MEM_NUM_HANDLERS)
+        ((BYTE *)page)[addr & MEM_PAGE_MASK] = data;
+    else
+        (*mem_handlers[page].wfuncb)(addr, data);
 }
 
 void mem_whword(WORD addr, HWORD data) {
-    int i = 0;
-    addr = addr & 0x07FFFFFE; // map to 24 bit address, mask first bit
-
-    //~ if(dbg_watchpt_en)
-    //~ dbg_watchpt(addr, 16, 1, data);
-
-    switch((addr&0x7000000)) {
-    case 0:
-        if((addr >= V810_DISPLAY_RAM.lowaddr)&&(addr <=V810_DISPLAY_RAM.highaddr)) {
-            ((HWORD *)(V810_DISPLAY_RAM.off + addr))[0] = data;
-            if(addr < BGMAP_OFFSET) { //Kill it if writes to Char Table
-                //Kill it if writes to Char Table
-                if(((addr>=0x00006000)&&(addr<0x00008000)) |
-                        ((addr>=0x0000E000)&&(addr<0x00010000)) |
-                        ((addr>=0x00016000)&&(addr<0x00018000)) |
-                        ((addr>=0x0001E000)&&(addr<0x00020000))) {
-                    for(i=0;i<14;i++) tDSPCACHE.BGCacheInvalid[i]=1;
-                    tDSPCACHE.ObjDataCacheInvalid=1;
-                } else { //Direct Mem Writes, darn thoes fragmented memorys!!!
-                    //tDSPCACHE.DDSPDataWrite=1;
-                }
-            }else if((addr >=OBJ_OFFSET)&&(addr < (OBJ_OFFSET+(OBJ_SIZE*1024)))) { //Writes to Obj Table
-                tDSPCACHE.ObjDataCacheInvalid=1;
-            } else if((addr >=BGMAP_OFFSET)&&(addr < (BGMAP_OFFSET+(14*BGMAP_SIZE)))) { //Writes to BGMap Table
-                tDSPCACHE.BGCacheInvalid[((addr-BGMAP_OFFSET)/BGMAP_SIZE)]=1;
-            }
-        } else if((addr >= V810_VIPCREG.lowaddr)&&(addr <=V810_VIPCREG.highaddr)) {
-            (*V810_VIPCREG.wfunch)(addr,data);
-            // Mirror the Chr ram table to 078000-07FFFF
-        } else  if((addr >= 0x00078000)&&(addr <= 0x0007FFFF)) {
-            if(addr < 0x0007A000) //CHR 0-511
-                ((HWORD *)(V810_DISPLAY_RAM.off + ((addr-0x00078000) + 0x00006000)))[0] = data;
-            else if(addr < 0x0007C000) //CHR 512-1023
-                ((HWORD *)(V810_DISPLAY_RAM.off + ((addr-0x0007A000) + 0x0000E000)))[0] = data;
-            else if(addr < 0x0007E000) //CHR 1024-1535
-                ((HWORD *)(V810_DISPLAY_RAM.off + ((addr-0x0007C000) + 0x00016000)))[0] = data;
-            else //CHR 1536-2047
-                ((HWORD *)(V810_DISPLAY_RAM.off + ((addr-0x0007E000) + 0x0001E000)))[0] = data;
-            //Invalidate, writes to Char table
-            for(i=0;i<14;i++) tDSPCACHE.BGCacheInvalid[i]=1;
-            tDSPCACHE.ObjDataCacheInvalid=1;
-        }
-        break;
-    case 0x1000000:
-        if((addr >= V810_SOUND_RAM.lowaddr)&&(addr <=V810_SOUND_RAM.highaddr)) {
-            //~ dtprintf(0,ferr,"\nWrite HWORD [%08x]:%04x  //SoundRam",addr,data);
-            ((HWORD *)(V810_SOUND_RAM.off + addr))[0] = data;
-            sound_update(addr);
-        }
-        break;
-    case 0x5000000:
-        //~ dtprintf(0,ferr,"\nWrite HWORD [%08x]:%04x  //VBRam",addr,data);
-        ((HWORD *)(V810_VB_RAM.off + (addr & V810_VB_RAM.highaddr)))[0] = data;
-        break;
-    case 0x6000000:
-        is_sram = 1;
-        //~ dtprintf(0,ferr,"\nWrite HWORD PC:%08x [%08x]:%04x  //GameRam",PC,addr,data);
-        ((HWORD *)(V810_GAME_RAM.off + (addr & V810_GAME_RAM.highaddr)))[0] = data;
-        break;
-    case 0x2000000:
-        if((addr >= V810_HCREG.lowaddr)&&(addr <=V810_HCREG.highaddr)) {
-            (*V810_HCREG.wfunch)(addr,data);
-        }
-        break;
-    default:
-        //~ dtprintf(0,ferr,"\nWrite HWORD [%08x]:%04x",addr,data);
-        break;
-    }
+    uintptr_t page;
+
+    addr = addr & 0x07FFFFFE;
+    page = mem_wpages[addr >> MEM_PAGE_BITS];
+    if (page >= MEM_NUM_HANDLERS)
+        ((HWORD *)(page + (addr & MEM_PAGE_MASK)))[0] = data;
+    else
+        (*mem_handlers[page].wfunch)(addr, data);
 }
 
 void mem_wword(WORD addr, WORD data) {
-    int i = 0;
-    addr = addr & 0x07FFFFFC; // map to 24 bit address, mask first 2 bytes to zero
-
-    //~ if(dbg_watchpt_en)
-    //~ dbg_watchpt(addr, 32, 1, data);
-
-    switch((addr&0x7000000)) {
-    case 0:
-        if((addr >= V810_DISPLAY_RAM.lowaddr)&&(addr <=V810_DISPLAY_RAM.highaddr)) {
-            ((WORD *)(V810_DISPLAY_RAM.off + addr))[0] = data;
-            if(addr < BGMAP_OFFSET) { //Kill it if writes to Char Table
-                //Kill it if writes to Char Table
-                if(((addr>=0x00006000)&&(addr<0x00008000)) |
-                        ((addr>=0x0000E000)&&(addr<0x00010000)) |
-                        ((addr>=0x00016000)&&(addr<0x00018000)) |
-                        ((addr>=0x0001E000)&&(addr<0x00020000))) {
-                    for(i=0;i<14;i++) tDSPCACHE.BGCacheInvalid[i]=1;
-                    tDSPCACHE.ObjDataCacheInvalid=1;
-                } else { //Direct Mem Writes, darn thoes fragmented memorys!!!
-                    //tDSPCACHE.DDSPDataWrite=1;
-                }
-            }else if((addr >=OBJ_OFFSET)&&(addr < (OBJ_OFFSET+(OBJ_SIZE*1024)))) { //Writes to Obj Table
-                tDSPCACHE.ObjDataCacheInvalid=1;
-            } else if((addr >=BGMAP_OFFSET)&&(addr < (BGMAP_OFFSET+(14*BGMAP_SIZE)))) { //Writes to BGMap Table
-                tDSPCACHE.BGCacheInvalid[((addr-BGMAP_OFFSET)/BGMAP_SIZE)]=1;
-            }
-        } else if((addr >= V810_VIPCREG.lowaddr)&&(addr <=V810_VIPCREG.highaddr)) {
-            (*V810_VIPCREG.wfuncw)(addr,data);
-            // Mirror the Chr ram table to 078000-07FFFF
-        } else  if((addr >= 0x00078000)&&(addr <= 0x0007FFFF)) {
-            if(addr < 0x0007A000)  //CHR 0-511
-                ((WORD *)(V810_DISPLAY_RAM.off + ((addr-0x00078000) + 0x00006000)))[0] = data;
-            else if(addr < 0x0007C000) //CHR 512-1023
-                ((WORD *)(V810_DISPLAY_RAM.off + ((addr-0x0007A000) + 0x0000E000)))[0] = data;
-            else if(addr < 0x0007E000) //CHR 1024-1535
-                ((WORD *)(V810_DISPLAY_RAM.off + ((addr-0x0007C000) + 0x00016000)))[0] = data;
-            else      //CHR 1536-2047
-                ((WORD *)(V810_DISPLAY_RAM.off + ((addr-0x0007E000) + 0x0001E000)))[0] = data;
-            //Invalidate, writes to Char table
-            for(i=0;i<14;i++) tDSPCACHE.BGCacheInvalid[i]=1;
-            tDSPCACHE.ObjDataCacheInvalid=1;
-        }
-        break;
-    case 0x1000000:
-        if((addr >= V810_SOUND_RAM.lowaddr)&&(addr <=V810_SOUND_RAM.highaddr)) {
-            //~ dtprintf(0,ferr,"\nWrite WORD  [%08x]:%08x  //SoundRam",addr,data);
-            ((WORD *)(V810_SOUND_RAM.off + addr))[0] = data;
-            sound_update(addr);
-        }
-        break;
-    case 0x5000000:
-        //~ dtprintf(0,ferr,"\nWrite WORD  [%08x]:%08x  //VBRam",addr,data);
-        ((WORD *)(V810_VB_RAM.off + (addr & V810_VB_RAM.highaddr)))[0] = data;
-        break;
-    case 0x6000000:
-        is_sram = 1;
-        //~ dtprintf(0,ferr,"\nWrite WORD  PC:%08x [%08x]:%08x  //GameRam",PC,addr,data);
-        ((WORD *)(V810_GAME_RAM.off + (addr & V810_GAME_RAM.highaddr)))[0] = data;
-        break;
-    case 0x2000000:
-        if((addr >= V810_HCREG.lowaddr)&&(addr <=V810_HCREG.highaddr)) {
-            (*V810_HCREG.wfuncw)(addr,data);
-        }
-        break;
-    default:
-        //~ dtprintf(0,ferr,"\nWrite WORD  [%08x]:%08x",addr,data);
-        break;
+    uintptr_t page;
+
+    addr = addr & 0x07FFFFFC;
+    page = mem_wpages[addr >> MEM_PAGE_BITS];
+    if (page >= MEM_NUM_HANDLERS)
+        ((WORD *)(page + (addr & MEM_PAGE_MASK)))[0] = data;
+    else
+        (*mem_handlers[page].wfuncw)(addr, data);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Page handlers
+
+// Nothing there, reads as 0
+static BYTE  unmapped_rbyte(WORD addr)  { return 0; }
+static HWORD unmapped_rhword(WORD addr) { return 0; }
+static WORD  unmapped_rword(WORD addr)  { return 0; }
+static void unmapped_wbyte(WORD addr, BYTE data)   { }
+static void unmapped_whword(WORD addr, HWORD data) { }
+static void unmapped_wword(WORD addr, WORD data)   { }
+
+// ROMs whose size isn't a multiple of the page size can't be mirrored a page
+// at a time
+static BYTE  rom_rbyte(WORD addr)  { return ((BYTE *)(V810_ROM1.off + (addr & V810_ROM1.highaddr)))[0]; }
+static HWORD rom_rhword(WORD addr) { return ((HWORD *)(V810_ROM1.off + (addr & V810_ROM1.highaddr)))[0]; }
+static WORD  rom_rword(WORD addr)  { return ((WORD *)(V810_ROM1.off + (addr & V810_ROM1.highaddr)))[0]; }
+
+// Sound RAM doesn't fill its page
+static BYTE sound_rbyte(WORD addr) {
+    if (addr > V810_SOUND_RAM.highaddr)
+        return 0;
+    return ((BYTE *)(V810_SOUND_RAM.off + addr))[0];
+}
+
+static HWORD sound_rhword(WORD addr) {
+    if (addr > V810_SOUND_RAM.highaddr)
+        return 0;
+    return ((HWORD *)(V810_SOUND_RAM.off + addr))[0];
+}
+
+static WORD sound_rword(WORD addr) {
+    if (addr > V810_SOUND_RAM.highaddr)
+        return 0;
+    return ((WORD *)(V810_SOUND_RAM.off + addr))[0];
+}
+
+static void sound_wbyte(WORD addr, BYTE data) {
+    if (addr > V810_SOUND_RAM.highaddr)
+        return;
+    ((BYTE *)(V810_SOUND_RAM.off + addr))[0] = data;
+    PROF_START(PROF_SOUND);
+    sound_update(addr);
+    PROF_STOP(PROF_SOUND);
+}
+
+static void sound_whword(WORD addr, HWORD data) {
+    if (addr > V810_SOUND_RAM.highaddr)
+        return;
+    ((HWORD *)(V810_SOUND_RAM.off + addr))[0] = data;
+    PROF_START(PROF_SOUND);
+    sound_update(addr);
+    PROF_STOP(PROF_SOUND);
+}
+
+static void sound_wword(WORD addr, WORD data) {
+    if (addr > V810_SOUND_RAM.highaddr)
+        return;
+    ((WORD *)(V810_SOUND_RAM.off + addr))[0] = data;
+    PROF_START(PROF_SOUND);
+    sound_update(addr);
+    PROF_STOP(PROF_SOUND);
+}
+
+// Writes to the character tables, or to their mirror at 0x78000, repaint the
+// BG map cells showing the character and invalidate the objects
+static void chr_invalidate(WORD addr) {
+    if (addr >= 0x00078000)
+        invalidateChr((addr - 0x00078000) / CHR_SIZE);
+    else
+        invalidateChr(((addr >> 15) << 9) | ((addr & 0x1FFF) / CHR_SIZE));
+    tDSPCACHE.ObjDataCacheInvalid = 1;
+}
+
+static void chr_wbyte(WORD addr, BYTE data) {
+    ((BYTE *)MEM_HOST(addr))[0] = data;
+    chr_invalidate(addr);
+}
+
+static void chr_whword(WORD addr, HWORD data) {
+    ((HWORD *)MEM_HOST(addr))[0] = data;
+    chr_invalidate(addr);
+}
+
+static void chr_wword(WORD addr, WORD data) {
+    ((WORD *)MEM_HOST(addr))[0] = data;
+    chr_invalidate(addr);
+}
+
+static void bgmap_wbyte(WORD addr, BYTE data) {
+    ((BYTE *)MEM_HOST(addr))[0] = data;
+    invalidateBGCell(addr);
+}
+
+static void bgmap_whword(WORD addr, HWORD data) {
+    ((HWORD *)MEM_HOST(addr))[0] = data;
+    invalidateBGCell(addr);
+}
+
+// Two cells at once
+static void bgmap_wword(WORD addr, WORD data) {
+    ((WORD *)MEM_HOST(addr))[0] = data;
+    invalidateBGCell(addr);
+    invalidateBGCell(addr + 2);
+}
+
+static void obj_wbyte(WORD addr, BYTE data) {
+    ((BYTE *)MEM_HOST(addr))[0] = data;
+    tDSPCACHE.ObjDataCacheInvalid = 1;
+}
+
+static void obj_whword(WORD addr, HWORD data) {
+    ((HWORD *)MEM_HOST(addr))[0] = data;
+    tDSPCACHE.ObjDataCacheInvalid = 1;
+}
+
+static void obj_wword(WORD addr, WORD data) {
+    ((WORD *)MEM_HOST(addr))[0] = data;
+    tDSPCACHE.ObjDataCacheInvalid = 1;
+}
+
+// Stores to VB RAM drop any code translated from it
+static void vbram_wbyte(WORD addr, BYTE data) {
+    ((BYTE *)MEM_HOST(addr))[0] = data;
+    if (v810_state->ram_code_pages[(addr >> 8) & 0xFF])
+        drc_invalidateRam(addr, addr + 1);
+}
+
+static void vbram_whword(WORD addr, HWORD data) {
+    ((HWORD *)MEM_HOST(addr))[0] = data;
+    if (v810_state->ram_code_pages[(addr >> 8) & 0xFF])
+        drc_invalidateRam(addr, addr + 1);
+}
+
+static void vbram_wword(WORD addr, WORD data) {
+    ((WORD *)MEM_HOST(addr))[0] = data;
+    if (v810_state->ram_code_pages[(addr >> 8) & 0xFF])
+        drc_invalidateRam(addr, addr + 1);
+}
+
+// Game RAM goes through these until the game touches it, which is when it
+// needs saving. Then it gets mapped directly.
+static void mem_mapGameRam() {
+    WORD addr;
+
+    is_sram = 1;
+    for (addr = V810_GAME_RAM.lowaddr; addr < 0x07000000; addr += MEM_PAGE_SIZE) {
+        mem_rpages[addr >> MEM_PAGE_BITS] = (uintptr_t)(V810_GAME_RAM.pmemory + (addr & (V810_GAME_RAM.highaddr - V810_GAME_RAM.lowaddr)));
+        mem_wpages[addr >> MEM_PAGE_BITS] = mem_rpages[addr >> MEM_PAGE_BITS];
     }
 }
 
+static BYTE gameram_rbyte(WORD addr) {
+    mem_mapGameRam();
+    return mem_rbyte(addr);
+}
+
+static HWORD gameram_rhword(WORD addr) {
+    mem_mapGameRam();
+    return mem_rhword(addr);
+}
+
+static WORD gameram_rword(WORD addr) {
+    mem_mapGameRam();
+    return mem_rword(addr);
+}
+
+static void gameram_wbyte(WORD addr, BYTE data) {
+    mem_mapGameRam();
+    mem_wbyte(addr, data);
+}
+
+static void gameram_whword(WORD addr, HWORD data) {
+    mem_mapGameRam();
+    mem_whword(addr, data);
+}
+
+static void gameram_wword(WORD addr, WORD data) {
+    mem_mapGameRam();
+    mem_wword(addr, data);
+}
+
+// Sets pages [start, end) to handler, or to the memory at host (mirrored
+// every mask + 1 bytes) if it's not NULL
+static void mem_mapPages(uintptr_t* pages, WORD start, WORD end, BYTE* host, WORD mask, int handler) {
+    WORD addr;
+
+    for (addr = start; addr < end; addr += MEM_PAGE_SIZE)
+        pages[addr >> MEM_PAGE_BITS] = host ? (uintptr_t)(host + ((addr - start) & mask)) : handler;
+}
+
+// Builds the page tables, once the memory is allocated and the register
+// handlers are set up
+void mem_initPages() {
+    WORD rom_size = (V810_ROM1.highaddr + 1) - V810_ROM1.lowaddr;
+    BYTE* display = V810_DISPLAY_RAM.pmemory;
+    int i;
+
+    mem_handlers[MEM_UNMAPPED] = (V810_REGFETCH) {0, 0,
+        &unmapped_rbyte, &unmapped_wbyte, &unmapped_rhword, &unmapped_whword, &unmapped_rword, &unmapped_wword};
+    // Only read through a handler
+    mem_handlers[MEM_ROM] = (V810_REGFETCH) {V810_ROM1.lowaddr, 0x07FFFFFF,
+        &rom_rbyte, &unmapped_wbyte, &rom_rhword, &unmapped_whword, &rom_rword, &unmapped_wword};
+    mem_handlers[MEM_VIPCREG] = V810_VIPCREG;
+    mem_handlers[MEM_HCREG] = V810_HCREG;
+    mem_handlers[MEM_SOUND_RAM] = (V810_REGFETCH) {V810_SOUND_RAM.lowaddr, V810_SOUND_RAM.highaddr,
+        &sound_rbyte, &sound_wbyte, &sound_rhword, &sound_whword, &sound_rword, &sound_wword};
+    // Only written through a handler, reads are direct
+    mem_handlers[MEM_CHR] = (V810_REGFETCH) {0, 0, NULL, &chr_wbyte, NULL, &chr_whword, NULL, &chr_wword};
+    mem_handlers[MEM_BGMAP] = (V810_REGFETCH) {BGMAP_OFFSET, BGMAP_OFFSET + 14*BGMAP_SIZE - 1,
+        NULL, &bgmap_wbyte, NULL, &bgmap_whword, NULL, &bgmap_wword};
+    mem_handlers[MEM_OBJ] = (V810_REGFETCH) {OBJ_OFFSET, OBJ_OFFSET + OBJ_SIZE*1024 - 1,
+        NULL, &obj_wbyte, NULL, &obj_whword, NULL, &obj_wword};
+    mem_handlers[MEM_VB_RAM] = (V810_REGFETCH) {V810_VB_RAM.lowaddr, 0x05FFFFFF,
+        NULL, &vbram_wbyte, NULL, &vbram_whword, NULL, &vbram_wword};
+    mem_handlers[MEM_GAME_RAM] = (V810_REGFETCH) {V810_GAME_RAM.lowaddr, 0x06FFFFFF,
+        &gameram_rbyte, &gameram_wbyte, &gameram_rhword, &gameram_whword, &gameram_rword, &gameram_wword};
+
+    mem_mapPages(mem_rpages, 0, 0x08000000, NULL, 0, MEM_UNMAPPED);
+    mem_mapPages(mem_wpages, 0, 0x08000000, NULL, 0, MEM_UNMAPPED);
+
+    // Display RAM. Only the frame buffers and what's between the BG maps and
+    // the objects are written directly, the rest invalidates DSP caches.
+    mem_mapPages(mem_rpages, V810_DISPLAY_RAM.lowaddr, V810_DISPLAY_RAM.highaddr + 1, display, 0xFFFFFFFF, 0);
+    mem_mapPages(mem_wpages, V810_DISPLAY_RAM.lowaddr, V810_DISPLAY_RAM.highaddr + 1, display, 0xFFFFFFFF, 0);
+    for (i = 0; i < 4; i++)
+        mem_mapPages(mem_wpages, 0x00006000 + i*0x8000, 0x00008000 + i*0x8000, NULL, 0, MEM_CHR);
+    mem_mapPages(mem_wpages, BGMAP_OFFSET, BGMAP_OFFSET + 14*BGMAP_SIZE, NULL, 0, MEM_BGMAP);
+    mem_mapPages(mem_wpages, OBJ_OFFSET, OBJ_OFFSET + OBJ_SIZE*1024, NULL, 0, MEM_OBJ);
+
+    mem_mapPages(mem_rpages, V810_VIPCREG.lowaddr, V810_VIPCREG.highaddr + 1, NULL, 0, MEM_VIPCREG);
+    mem_mapPages(mem_wpages, V810_VIPCREG.lowaddr, V810_VIPCREG.highaddr + 1, NULL, 0, MEM_VIPCREG);
+
+    // Mirror of the character tables at 0x78000-0x7FFFF
+    for (i = 0; i < 4; i++) {
+        mem_mapPages(mem_rpages, 0x00078000 + i*0x2000, 0x0007A000 + i*0x2000, display + 0x00006000 + i*0x8000, 0xFFFFFFFF, 0);
+        mem_mapPages(mem_wpages, 0x00078000 + i*0x2000, 0x0007A000 + i*0x2000, NULL, 0, MEM_CHR);
+    }
+
+    mem_mapPages(mem_rpages, V810_SOUND_RAM.lowaddr, V810_SOUND_RAM.highaddr + 1, NULL, 0, MEM_SOUND_RAM);
+    mem_mapPages(mem_wpages, V810_SOUND_RAM.lowaddr, V810_SOUND_RAM.highaddr + 1, NULL, 0, MEM_SOUND_RAM);
+
+    mem_mapPages(mem_rpages, V810_HCREG.lowaddr, V810_HCREG.highaddr + 1, NULL, 0, MEM_HCREG);
+    mem_mapPages(mem_wpages, V810_HCREG.lowaddr, V810_HCREG.highaddr + 1, NULL, 0, MEM_HCREG);
+
+    // VB RAM is mirrored over the whole 0x05000000 range
+    mem_mapPages(mem_rpages, V810_VB_RAM.lowaddr, 0x06000000, V810_VB_RAM.pmemory, V810_VB_RAM.highaddr - V810_VB_RAM.lowaddr, 0);
+    mem_mapPages(mem_wpages, V810_VB_RAM.lowaddr, 0x06000000, NULL, 0, MEM_VB_RAM);
+
+    if (is_sram) {
+        mem_mapGameRam();
+    } else {
+        mem_mapPages(mem_rpages, V810_GAME_RAM.lowaddr, 0x07000000, NULL, 0, MEM_GAME_RAM);
+        mem_mapPages(mem_wpages, V810_GAME_RAM.lowaddr, 0x07000000, NULL, 0, MEM_GAME_RAM);
+    }
+
+    // Writes to ROM are ignored
+    if (rom_size % MEM_PAGE_SIZE)
+        mem_mapPages(mem_rpages, V810_ROM1.lowaddr, 0x08000000, NULL, 0, MEM_ROM);
+    else
+        mem_mapPages(mem_rpages, V810_ROM1.lowaddr, 0x08000000, V810_ROM1.pmemory, rom_size - 1, 0);
+}
+
 //////////////////////////////////////////////////////////////////////////////
 // Hardware Controll Reg....
 BYTE hcreg_rbyte(WORD addr) {
@@ -444,6 +404,9 @@ BYTE hcreg_rbyte(WORD addr) {
 }
 
 void hcreg_wbyte(WORD addr, BYTE data) {
+    BYTE old_tcr;
+    WORD old_trc;
+
     addr = (addr & 0x0200003C);
     switch(addr) {
     case 0x02000000:    //CCR
@@ -482,6 +445,8 @@ void hcreg_wbyte(WORD addr, BYTE data) {
     case 0x02000020:    //TCR
         //~ dtprintf(3,ferr,"\nWrite  BYTE HCREG TCR [%08x]:%02x ",addr,data);
         if ((tHReg.TCR & 1) && ((data & 0x05) == 0x04)) break; //Cannot disable timer and clear ZStat at the same time!
+        old_tcr = tHReg.TCR;
+        old_trc = tHReg.tTRC;
 
         if (data & 0x01) {
             tHReg.TLB = (tHReg.tTHW&0xFF);
@@ -501,6 +466,11 @@ void hcreg_wbyte(WORD addr, BYTE data) {
         if ((data & 0x04) && (!(tHReg.TCR & 0x01))) { //cannot clear ZStat if timer is enabled...
             tHReg.TCR &= 0xFD; // Clear the ZStat Flag...
         }
+        // Restart the countdown if the timer was just turned on or off or got
+        // a new resolution. The translated code only updates the cycle count
+        // between blocks, so this is counted from the start of the block.
+        if (((old_tcr ^ tHReg.TCR) & 0x01) || old_trc != tHReg.tTRC)
+            v810_resetTimer(v810_state->cycles);
         break;
     case 0x02000024:    //WCR
         //~ dtprintf(3,ferr,"\nWrite  BYTE HCREG WCR [%08x]:%02x ",addr,data);
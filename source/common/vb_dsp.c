@@ -14,7 +14,9 @@
 #include "v810_mem.h"
 #include "vb_set.h"
 #include "vb_dsp.h"
+#include "vb_blit.h"
 #include "vb_sound.h"
+#include "vb_prof.h"
 #include "drc_core.h"
 #include "allegro_compat.h"
 
@@ -234,55 +236,14 @@ void affine_blit(BITMAP *source[], BITMAP *dest, int source_x, int source_y, int
 
 void fchr2sprite(HWORD num, BITMAP *sprt, bool hflp, bool vflp,BYTE pal[]) {
     int i;
+    blit_chr chr;
 
     // Strip the first 2 bits to decode what chr table to use, use the remaning bits to index into the table...
     WORD offset = ChrOff[(num>>9)&0x03] + (CHR_SIZE * (num & 0x01FF)) + V810_DISPLAY_RAM.off;
 
-    if (!hflp && !vflp){
-        for (i = 0; i < 8; i++) {// We want words not bytes
-            sprt->line[i][0] = pal[((((HWORD *)(offset))[i] >>  0) & 3)]; //replace "<<4) & 0x3f);" with cPal[#]
-            sprt->line[i][1] = pal[((((HWORD *)(offset))[i] >>  2) & 3)];
-            sprt->line[i][2] = pal[((((HWORD *)(offset))[i] >>  4) & 3)];
-            sprt->line[i][3] = pal[((((HWORD *)(offset))[i] >>  6) & 3)];
-            sprt->line[i][4] = pal[((((HWORD *)(offset))[i] >>  8) & 3)];
-            sprt->line[i][5] = pal[((((HWORD *)(offset))[i] >> 10) & 3)];
-            sprt->line[i][6] = pal[((((HWORD *)(offset))[i] >> 12) & 3)];
-            sprt->line[i][7] = pal[((((HWORD *)(offset))[i] >> 14) & 3)];
-        }
-    } else if (hflp && vflp){
-        for (i = 0; i < 8; i++) {// We want words not bytes
-            sprt->line[7-i][7] = pal[((((HWORD *)(offset))[i] >>  0) & 3)];
-            sprt->line[7-i][6] = pal[((((HWORD *)(offset))[i] >>  2) & 3)];
-            sprt->line[7-i][5] = pal[((((HWORD *)(offset))[i] >>  4) & 3)];
-            sprt->line[7-i][4] = pal[((((HWORD *)(offset))[i] >>  6) & 3)];
-            sprt->line[7-i][3] = pal[((((HWORD *)(offset))[i] >>  8) & 3)];
-            sprt->line[7-i][2] = pal[((((HWORD *)(offset))[i] >> 10) & 3)];
-            sprt->line[7-i][1] = pal[((((HWORD *)(offset))[i] >> 12) & 3)];
-            sprt->line[7-i][0] = pal[((((HWORD *)(offset))[i] >> 14) & 3)];
-        }
-    } else if(hflp) {
-        for(i = 0; i < 8; i++) {// We want words not bytes
-            sprt->line[i][7] = pal[((((HWORD *)(offset))[i] >>  0) & 3)];
-            sprt->line[i][6] = pal[((((HWORD *)(offset))[i] >>  2) & 3)];
-            sprt->line[i][5] = pal[((((HWORD *)(offset))[i] >>  4) & 3)];
-            sprt->line[i][4] = pal[((((HWORD *)(offset))[i] >>  6) & 3)];
-            sprt->line[i][3] = pal[((((HWORD *)(offset))[i] >>  8) & 3)];
-            sprt->line[i][2] = pal[((((HWORD *)(offset))[i] >> 10) & 3)];
-            sprt->line[i][1] = pal[((((HWORD *)(offset))[i] >> 12) & 3)];
-            sprt->line[i][0] = pal[((((HWORD *)(offset))[i] >> 14) & 3)];
-        }
-    } else if (vflp) {
-        for (i = 0; i < 8; i++) {// We want words not bytes
-            sprt->line[7-i][0] = pal[((((HWORD *)(offset))[i] >>  0) & 3)];
-            sprt->line[7-i][1] = pal[((((HWORD *)(offset))[i] >>  2) & 3)];
-            sprt->line[7-i][2] = pal[((((HWORD *)(offset))[i] >>  4) & 3)];
-            sprt->line[7-i][3] = pal[((((HWORD *)(offset))[i] >>  6) & 3)];
-            sprt->line[7-i][4] = pal[((((HWORD *)(offset))[i] >>  8) & 3)];
-            sprt->line[7-i][5] = pal[((((HWORD *)(offset))[i] >> 10) & 3)];
-            sprt->line[7-i][6] = pal[((((HWORD *)(offset))[i] >> 12) & 3)];
-            sprt->line[7-i][7] = pal[((((HWORD *)(offset))[i] >> 14) & 3)];
-        }
-    }
+    blit_prepareChr(&chr, pal, hflp);
+    for (i = 0; i < 8; i++) // We want words not bytes
+        blit_chrRow(&chr, ((HWORD *)(offset))[vflp ? 7-i : i], sprt->line[i]);
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////
@@ -305,68 +266,19 @@ void vRenderCharacter(HWORD p_hwCharacterNumber,// The number of the character t
                       BYTE p_rgbPalette[])
 {// vRenderCharacter
     int l_nRowCounter;
+    blit_chr l_chr;
 
     WORD l_wDataOffset = ChrOff[(p_hwCharacterNumber>>9)&0x03] + (CHR_SIZE * (p_hwCharacterNumber & 0x01FF)) + V810_DISPLAY_RAM.off;
-    //VB_WORD offset = ChrOff[(num>>9)&0x03] + (CHR_SIZE * (num & 0x01FF)) + V810_DISPLAY_RAM.off;
     HWORD * l_phwLineData = ((HWORD *)(l_wDataOffset));
-    HWORD l_hwCurrentData; // We use this to store the current data.
 
     p_pbSpriteData += ((p_wStartingX) + (p_wStartingY*p_wBitmapWidth));
 
-    int vinc = 1;
-    int hinc = 1;
-
-    if(p_fFlipVertically) {
-        vinc = -1;
-        l_phwLineData+=7;
-    }
-    if(p_fFlipHorizontally) {
-        hinc = -1;
-        p_pbSpriteData+=7;
+    // The horizontal flip is done by the row kernel
+    blit_prepareChr(&l_chr, p_rgbPalette, p_fFlipHorizontally);
+    for (l_nRowCounter = 0; l_nRowCounter < 8; l_nRowCounter++) {
+        blit_chrRow(&l_chr, l_phwLineData[p_fFlipVertically ? 7-l_nRowCounter : l_nRowCounter], p_pbSpriteData);
+        p_pbSpriteData += p_wBitmapWidth; // Skip to start of next.
     }
-
-    l_nRowCounter=7;
-
-    do {
-        l_hwCurrentData = *l_phwLineData;
-        *p_pbSpriteData= p_rgbPalette[(l_hwCurrentData & 3)];
-        p_pbSpriteData+=hinc;
-        l_hwCurrentData>>=2;
-
-        *p_pbSpriteData= p_rgbPalette[(l_hwCurrentData & 3)];
-        p_pbSpriteData+=hinc;
-        l_hwCurrentData>>=2;
-
-        *p_pbSpriteData= p_rgbPalette[(l_hwCurrentData & 3)];
-        p_pbSpriteData+=hinc;
-        l_hwCurrentData>>=2;
-
-        *p_pbSpriteData= p_rgbPalette[(l_hwCurrentData & 3)];
-        p_pbSpriteData+=hinc;
-        l_hwCurrentData>>=2;
-
-        *p_pbSpriteData= p_rgbPalette[(l_hwCurrentData & 3)];
-        p_pbSpriteData+=hinc;
-        l_hwCurrentData>>=2;
-
-        *p_pbSpriteData= p_rgbPalette[(l_hwCurrentData & 3)];
-        p_pbSpriteData+=hinc;
-        l_hwCurrentData>>=2;
-
-        *p_pbSpriteData= p_rgbPalette[(l_hwCurrentData & 3)];
-        p_pbSpriteData+=hinc;
-        l_hwCurrentData>>=2;
-
-        *p_pbSpriteData= p_rgbPalette[(l_hwCurrentData & 3)];
-        p_pbSpriteData+=hinc;
-
-        if(p_fFlipHorizontally)
-            p_pbSpriteData+=16;
-
-        p_pbSpriteData+=(p_wBitmapWidth-8); // Skip to start of next.
-
-        l_phwLineData += vinc;
-    } while (l_nRowCounter--);
 } // End vRenderCharacter
 
 ////////////////////////////////////////////////////////////////////////////////////////
@@ -391,149 +303,19 @@ void vRenderCharacterTransparent(HWORD p_hwCharacterNumber,// The number of the
                                  BYTE p_rgbPalette[])
 { // vRenderCharacterTransparent
     int l_nRowCounter;
+    blit_chr l_chr;
 
     WORD l_wDataOffset = ChrOff[(p_hwCharacterNumber>>9)&0x03] + (CHR_SIZE * (p_hwCharacterNumber & 0x01FF)) + V810_DISPLAY_RAM.off;
-    //WORD offset = ChrOff[(num>>9)&0x03] + (CHR_SIZE * (num & 0x01FF)) + V810_DISPLAY_RAM.off;
     HWORD * l_phwLineData = ((HWORD *)(l_wDataOffset));
-    HWORD l_hwCurrentData; // We use this to store the current data.
 
     p_pbSpriteData += ((p_wStartingX) + (p_wStartingY*p_wBitmapWidth));
 
-    l_nRowCounter = 0;
-
-    if (!p_fFlipHorizontally && !p_fFlipVertically) { // Normal Character
-        for (l_nRowCounter = 0; l_nRowCounter < 8; l_nRowCounter++) { // For Each Line
-            l_hwCurrentData = *l_phwLineData;
-            if (p_rgbPalette[(l_hwCurrentData &3)]) *p_pbSpriteData= p_rgbPalette[(l_hwCurrentData & 3)];
-            p_pbSpriteData++;
-            l_hwCurrentData>>=2;
-
-            if (p_rgbPalette[(l_hwCurrentData &3)]) *p_pbSpriteData= p_rgbPalette[(l_hwCurrentData & 3)];
-            p_pbSpriteData++;
-            l_hwCurrentData>>=2;
-
-            if (p_rgbPalette[(l_hwCurrentData &3)]) *p_pbSpriteData= p_rgbPalette[(l_hwCurrentData & 3)];
-            p_pbSpriteData++;
-            l_hwCurrentData>>=2;
-
-            if (p_rgbPalette[(l_hwCurrentData &3)]) *p_pbSpriteData= p_rgbPalette[(l_hwCurrentData & 3)];
-            p_pbSpriteData++;
-            l_hwCurrentData>>=2;
-
-            if (p_rgbPalette[(l_hwCurrentData &3)]) *p_pbSpriteData= p_rgbPalette[(l_hwCurrentData & 3)];
-            p_pbSpriteData++;
-            l_hwCurrentData>>=2;
-
-            if (p_rgbPalette[(l_hwCurrentData &3)]) *p_pbSpriteData= p_rgbPalette[(l_hwCurrentData & 3)];
-            p_pbSpriteData++;
-            l_hwCurrentData>>=2;
-
-            if (p_rgbPalette[(l_hwCurrentData &3)]) *p_pbSpriteData= p_rgbPalette[(l_hwCurrentData & 3)];
-            p_pbSpriteData++;
-            l_hwCurrentData>>=2;
-
-            if (p_rgbPalette[(l_hwCurrentData &3)]) *p_pbSpriteData= p_rgbPalette[(l_hwCurrentData & 3)];
-            p_pbSpriteData++;
-            p_pbSpriteData += (p_wBitmapWidth-8); // Skip to start of next.
-            l_phwLineData++;
-        }// End for Each Line
-    } else if (p_fFlipHorizontally && p_fFlipVertically) {// Flip both
-        l_phwLineData += 7;
-        for (l_nRowCounter = 0; l_nRowCounter < 8; l_nRowCounter++) {// For Each Line
-            l_hwCurrentData = *l_phwLineData;
-            if (p_rgbPalette[((l_hwCurrentData >>  14) & 3)]) *p_pbSpriteData= p_rgbPalette[((l_hwCurrentData >>  14) & 3)];
-            p_pbSpriteData++;
-
-            if (p_rgbPalette[((l_hwCurrentData >>  12) & 3)]) *p_pbSpriteData= p_rgbPalette[((l_hwCurrentData >>  12) & 3)];
-            p_pbSpriteData++;
-
-            if (p_rgbPalette[((l_hwCurrentData >>  10) & 3)]) *p_pbSpriteData= p_rgbPalette[((l_hwCurrentData >>  10) & 3)];
-            p_pbSpriteData++;
-
-            if (p_rgbPalette[((l_hwCurrentData >>   8) & 3)]) *p_pbSpriteData= p_rgbPalette[((l_hwCurrentData >>  8) & 3)];
-            p_pbSpriteData++;
-
-            if (p_rgbPalette[((l_hwCurrentData >>   6) & 3)]) *p_pbSpriteData= p_rgbPalette[((l_hwCurrentData >>  6) & 3)];
-            p_pbSpriteData++;
-
-            if (p_rgbPalette[((l_hwCurrentData >>   4) & 3)]) *p_pbSpriteData= p_rgbPalette[((l_hwCurrentData >>  4) & 3)];
-            p_pbSpriteData++;
-
-            if (p_rgbPalette[((l_hwCurrentData >>   2) & 3)])  *p_pbSpriteData= p_rgbPalette[((l_hwCurrentData >>  2) & 3)];
-            p_pbSpriteData++;
-
-            if (p_rgbPalette[((l_hwCurrentData >>   0) & 3)]) *p_pbSpriteData= p_rgbPalette[((l_hwCurrentData >>  0) & 3)];
-            p_pbSpriteData++;
-            p_pbSpriteData += (p_wBitmapWidth-8); // Skip to start of next.
-            l_phwLineData--;
-        }// End For Each Line
-    } else if (p_fFlipHorizontally) {// Flip Horizontal
-        for (l_nRowCounter = 0; l_nRowCounter < 8; l_nRowCounter++) {// For Each Line
-            l_hwCurrentData = *l_phwLineData;
-            if (p_rgbPalette[((l_hwCurrentData >>  14) & 3)]) *p_pbSpriteData= p_rgbPalette[((l_hwCurrentData >>  14) & 3)];
-            p_pbSpriteData++;
-
-            if (p_rgbPalette[((l_hwCurrentData >>  12) & 3)]) *p_pbSpriteData= p_rgbPalette[((l_hwCurrentData >>  12) & 3)];
-            p_pbSpriteData++;
-
-            if (p_rgbPalette[((l_hwCurrentData >>  10) & 3)]) *p_pbSpriteData= p_rgbPalette[((l_hwCurrentData >>  10) & 3)];
-            p_pbSpriteData++;
-
-            if (p_rgbPalette[((l_hwCurrentData >>   8) & 3)]) *p_pbSpriteData= p_rgbPalette[((l_hwCurrentData >>  8) & 3)];
-            p_pbSpriteData++;
-
-            if (p_rgbPalette[((l_hwCurrentData >>   6) & 3)]) *p_pbSpriteData= p_rgbPalette[((l_hwCurrentData >>  6) & 3)];
-            p_pbSpriteData++;
-
-            if (p_rgbPalette[((l_hwCurrentData >>   4) & 3)]) *p_pbSpriteData= p_rgbPalette[((l_hwCurrentData >>  4) & 3)];
-            p_pbSpriteData++;
-
-            if (p_rgbPalette[((l_hwCurrentData >>  2) & 3)]) *p_pbSpriteData= p_rgbPalette[((l_hwCurrentData >>  2) & 3)];
-            p_pbSpriteData++;
-
-            if (p_rgbPalette[((l_hwCurrentData >>   0) & 3)]) *p_pbSpriteData= p_rgbPalette[((l_hwCurrentData >>  0) & 3)];
-            p_pbSpriteData++;
-            p_pbSpriteData += (p_wBitmapWidth-8); // Skip to start of next.
-            l_phwLineData++;
-        }// End For Each Line
-    } else if (p_fFlipVertically) {// Vertically flipped
-        l_phwLineData+=7;
-        for (l_nRowCounter = 0; l_nRowCounter < 8; l_nRowCounter++) {// For Each Line
-            l_hwCurrentData = *l_phwLineData;
-            if (p_rgbPalette[(l_hwCurrentData & 3)]) *p_pbSpriteData= p_rgbPalette[(l_hwCurrentData & 3)];
-            p_pbSpriteData++;
-            l_hwCurrentData>>=2;
-
-            if (p_rgbPalette[(l_hwCurrentData & 3)]) *p_pbSpriteData= p_rgbPalette[(l_hwCurrentData & 3)];
-            p_pbSpriteData++;
-            l_hwCurrentData>>=2;
-
-            if (p_rgbPalette[(l_hwCurrentData & 3)]) *p_pbSpriteData= p_rgbPalette[(l_hwCurrentData & 3)];
-            p_pbSpriteData++;
-            l_hwCurrentData>>=2;
-
-            if (p_rgbPalette[(l_hwCurrentData & 3)]) *p_pbSpriteData= p_rgbPalette[(l_hwCurrentData & 3)];
-            p_pbSpriteData++;
-            l_hwCurrentData>>=2;
-
-            if (p_rgbPalette[(l_hwCurrentData & 3)]) *p_pbSpriteData= p_rgbPalette[(l_hwCurrentData & 3)];
-            p_pbSpriteData++;
-            l_hwCurrentData>>=2;
-
-            if (p_rgbPalette[(l_hwCurrentData & 3)]) *p_pbSpriteData= p_rgbPalette[(l_hwCurrentData & 3)];
-            p_pbSpriteData++;
-            l_hwCurrentData>>=2;
-
-            if (p_rgbPalette[(l_hwCurrentData & 3)]) *p_pbSpriteData= p_rgbPalette[(l_hwCurrentData & 3)];
-            p_pbSpriteData++;
-            l_hwCurrentData>>=2;
-
-            if (p_rgbPalette[(l_hwCurrentData & 3)]) *p_pbSpriteData= p_rgbPalette[(l_hwCurrentData & 3)];
-            p_pbSpriteData++;
-            p_pbSpriteData += (p_wBitmapWidth-8); // Skip to start of next.
-            l_phwLineData--;
-        } // End for Each Line
-    } // End vertical flip
+    // The horizontal flip is done by the row kernel
+    blit_prepareChr(&l_chr, p_rgbPalette, p_fFlipHorizontally);
+    for (l_nRowCounter = 0; l_nRowCounter < 8; l_nRowCounter++) {
+        blit_chrRowMasked(&l_chr, l_phwLineData[p_fFlipVertically ? 7-l_nRowCounter : l_nRowCounter], p_pbSpriteData);
+        p_pbSpriteData += p_wBitmapWidth; // Skip to start of next.
+    }
 } // End vRenderCharacterTransparent
 
 ////////////////////////////////////////////////////////////////////
@@ -573,36 +355,134 @@ void updateBGMPalette() {
     }
 }
 
+////////////////////////////////////////////////////////////////////
+// Reverse index from Chrs to the BGMap cells showing them, so a write to a
+// Chr only repaints those cells. Cells are numbered map*4096 + cell, and each
+// one is in the list of the Chr it was last painted with.
+#define BG_NUM_CELLS (14*(BGMAP_SIZE>>1))
+#define BG_NO_CELL 0xFFFF
+
+static HWORD chr_first_cell[2048];
+static HWORD bg_cell_next[BG_NUM_CELLS];
+static HWORD bg_cell_prev[BG_NUM_CELLS];
+static HWORD bg_cell_chr[BG_NUM_CELLS]; // BG_NO_CELL if it's in no list
+
+// Moves a cell to the list of the Chr it's now showing
+static void linkBGCell(HWORD cell, HWORD chr) {
+    HWORD old = bg_cell_chr[cell];
+
+    if (old == chr)
+        return;
+    if (old != BG_NO_CELL) {
+        if (bg_cell_prev[cell] != BG_NO_CELL)
+            bg_cell_next[bg_cell_prev[cell]] = bg_cell_next[cell];
+        else
+            chr_first_cell[old] = bg_cell_next[cell];
+        if (bg_cell_next[cell] != BG_NO_CELL)
+            bg_cell_prev[bg_cell_next[cell]] = bg_cell_prev[cell];
+    }
+
+    bg_cell_chr[cell] = chr;
+    bg_cell_prev[cell] = BG_NO_CELL;
+    bg_cell_next[cell] = chr_first_cell[chr];
+    if (chr_first_cell[chr] != BG_NO_CELL)
+        bg_cell_prev[chr_first_cell[chr]] = cell;
+    chr_first_cell[chr] = cell;
+}
+
+static void resetBGCells() {
+    memset(chr_first_cell, 0xFF, sizeof(chr_first_cell));
+    memset(bg_cell_chr, 0xFF, sizeof(bg_cell_chr));
+    memset(tDSPCACHE.CharDirtyBits, 0, sizeof(tDSPCACHE.CharDirtyBits));
+    memset(tDSPCACHE.BGCellDirtyBits, 0, sizeof(tDSPCACHE.BGCellDirtyBits));
+    memset(tDSPCACHE.BGCellDirty, 0, sizeof(tDSPCACHE.BGCellDirty));
+    tDSPCACHE.CharDirty = 0;
+}
+
+// Paints cell i of BGMap num
+static void renderBGCell(HWORD num, int i, BITMAP *wPlane) {
+    // only 14 posible bg's, this is 16 but whos counting?
+    WORD offset = BGMAP_OFFSET + (BGMAP_SIZE*(num & 0xF))+V810_DISPLAY_RAM.off;
+    HWORD thword = ((HWORD *)(offset))[i];
+
+    linkBGCell(num*(BGMAP_SIZE>>1) + i, thword & 0x7FF);
+    vRenderCharacter(thword & 0x7FF, *wPlane->line, ((i&63)<<3), ((i>>6)<<3),
+                     wPlane->w, (thword >> 13) & 0x1, (thword >> 12) & 0x1, tDSPCACHE.BgmPAL[(thword >> 14) & 0x3]);
+}
+
+void invalidateChr(HWORD num) {
+    tDSPCACHE.CharDirtyBits[num >> 5] |= 1U << (num & 31);
+    tDSPCACHE.CharDirty = 1;
+}
+
+void invalidateBGCell(WORD addr) {
+    int num = (addr - BGMAP_OFFSET) / BGMAP_SIZE;
+    int i = (addr & (BGMAP_SIZE-1)) >> 1;
+
+    tDSPCACHE.BGCellDirtyBits[num][i >> 5] |= 1U << (i & 31);
+    tDSPCACHE.BGCellDirty[num] = 1;
+}
+
+// Marks the cells showing the Chrs that changed, in every BGMap
+static void flushDirtyChars() {
+    int i, j;
+    WORD bits;
+    HWORD cell;
+
+    if (!tDSPCACHE.CharDirty)
+        return;
+    for (i = 0; i < 2048/32; i++) {
+        bits = tDSPCACHE.CharDirtyBits[i];
+        tDSPCACHE.CharDirtyBits[i] = 0;
+        for (j = i*32; bits; j++, bits >>= 1) {
+            if (!(bits & 1))
+                continue;
+            for (cell = chr_first_cell[j]; cell != BG_NO_CELL; cell = bg_cell_next[cell]) {
+                tDSPCACHE.BGCellDirtyBits[cell >> 12][(cell & 0xFFF) >> 5] |= 1U << (cell & 31);
+                tDSPCACHE.BGCellDirty[cell >> 12] = 1;
+            }
+        }
+    }
+    tDSPCACHE.CharDirty = 0;
+}
+
 // Converts a BG Map Buffer to a World Picture, With Chrs in place.
 void BGMap2World(HWORD num, BITMAP *wPlane) {
     int i;
-    // Temporary workaround for the 3dsx crash
-    VB_BGMAP* BGMap_Buff = linearAlloc(4096*sizeof(VB_BGMAP));
-    HWORD thword;
 
     //setup palette
     updateBGMPalette();
+    // Before the cells get repainted, so pending Chr writes don't mark them
+    flushDirtyChars();
 
-    // only 14 posible bg's, this is 16 but whos counting?
-    WORD offset = BGMAP_OFFSET + (BGMAP_SIZE*(num & 0xF))+V810_DISPLAY_RAM.off;
+    // For each character in the map
+    for(i=0;i<(BGMAP_SIZE >> 1);i++)
+        renderBGCell(num, i, wPlane);
 
-    //Grab the BGMap info...
-    i = (BGMAP_SIZE>>1)-1;
-    do {
-        // Make sure we only grab num's from 0-4095...
-        thword = ((HWORD *)(offset))[i];
-        BGMap_Buff[i].BCA   = thword & 0x7FF;
-        BGMap_Buff[i].VFLP  = (thword >> 12) & 0x1;
-        BGMap_Buff[i].HFLP  = (thword >> 13) & 0x1;
-        BGMap_Buff[i].BPLTS = (thword >> 14) & 0x3;
-    } while(i--);
+    // Everything is up to date now
+    memset(tDSPCACHE.BGCellDirtyBits[num], 0, sizeof(tDSPCACHE.BGCellDirtyBits[num]));
+    tDSPCACHE.BGCellDirty[num] = 0;
+}
 
-    // For each character in the map
-    for(i=0;i<(BGMAP_SIZE >> 1);i++) {
-        vRenderCharacter(BGMap_Buff[i].BCA, *wPlane->line, ((i&63)<<3), ((i>>6)<<3),
-                         wPlane->w, BGMap_Buff[i].HFLP, BGMap_Buff[i].VFLP, tDSPCACHE.BgmPAL[(BGMap_Buff[i].BPLTS&0x3)]);
+// Repaints the cells of a BG Map that changed, or show a Chr that did
+void updateBGMap(HWORD num, BITMAP *wPlane) {
+    int i, j;
+    WORD bits;
+
+    flushDirtyChars();
+    if (!tDSPCACHE.BGCellDirty[num])
+        return;
+
+    updateBGMPalette();
+    for (i = 0; i < (BGMAP_SIZE>>1)/32; i++) {
+        bits = tDSPCACHE.BGCellDirtyBits[num][i];
+        tDSPCACHE.BGCellDirtyBits[num][i] = 0;
+        for (j = i*32; bits; j++, bits >>= 1) {
+            if (bits & 1)
+                renderBGCell(num, j, wPlane);
+        }
     }
-    linearFree(BGMap_Buff);
+    tDSPCACHE.BGCellDirty[num] = 0;
 }
 
 ////////////////////////////////////////////////////////////////////
@@ -783,12 +663,11 @@ void getAffine(int y, int pBase, AFFINE_MAP* AFN_MP) {
     AFN_MP[0].u1    = (int) sign_16((((HWORD *)(offset+V810_DISPLAY_RAM.off+10))[0])&0xFFFF);
     AFN_MP[0].u2    = (int) sign_16((((HWORD *)(offset+V810_DISPLAY_RAM.off+12))[0])&0xFFFF);
     AFN_MP[0].u3    = (int) sign_16((((HWORD *)(offset+V810_DISPLAY_RAM.off+14))[0])&0xFFFF);
-    //convert to float, avoiding divide by zero errors
-    //*****Fixme, convert this to fixed point math
-    AFN_MP[0].pb_y  = (float)(t_int[0]/8.0);
-    AFN_MP[0].pd_y  = (float)(t_int[1]/8.0);
-    AFN_MP[0].pa    = (float)(t_int[2]/512.0);
-    AFN_MP[0].pc    = (float)(t_int[3]/512.0);
+    //kept in the fixed point formats of the table
+    AFN_MP[0].pb_y  = t_int[0];
+    AFN_MP[0].pd_y  = t_int[1];
+    AFN_MP[0].pa    = t_int[2];
+    AFN_MP[0].pc    = t_int[3];
 }
 
 //Return H-Bias offset for current line
@@ -825,7 +704,88 @@ void getOverChar(int index, BITMAP *wPlane) {
 
 }
 
-#define ROUND_F(x) ((x)>=0?(int)((x)+0.5):(int)((x)-0.5))
+// Draws len pixels of a line of a normal or H-Bias world, starting at BG map
+// coordinates bgm_x, bgm_y. The span is cut where it crosses into another BG
+// map or the overplane, and each piece is copied in one go.
+static void drawBGMapSpan(BYTE *dst, int len, int bgm_x, int bgm_y, VB_WORLD *WBuff,
+                          int bgm_base, int nx, int ny, BITMAP *ovrChr) {
+    int x_mask = (nx<<9)-1;
+    int y_mask = (ny<<9)-1;
+    int bgm, n, i;
+    int tPix;
+
+    while(len>0) {
+        if(WBuff->OVER && ((bgm_x & ~x_mask)||(bgm_y & ~y_mask))) {
+            //overplane until the span gets back into the BG maps, if it does
+            n = len;
+            if(!(bgm_y & ~y_mask) && bgm_x<0 && -bgm_x<len)
+                n = -bgm_x;
+            for(i=0;i<n;i++) {
+                tPix = ovrChr->line[bgm_y&7][(bgm_x+i)&7];
+                if(tPix)
+                    dst[i] = tPix;
+            }
+        } else {
+            //up to the edge of the BGMap
+            n = 512-(bgm_x&511);
+            if(n>len)
+                n = len;
+
+            //find BGMap to cut out of, if past last BGMap, drop it.
+            bgm = bgm_base+((bgm_x&x_mask)>>9)+((bgm_y&y_mask)>>9)*nx;
+            if(bgm<14)
+                blit_maskedSpan(dst, tDSPCACHE.BGCacheBMP[bgm]->line[bgm_y&511]+(bgm_x&511), n);
+        }
+        dst += n;
+        bgm_x += n;
+        len -= n;
+    }
+}
+
+// Draws len pixels of a line of an affine world. u and v are the BG map
+// coordinates of the first pixel, and dx and dy what they move by for each
+// pixel, all with 9 fraction bits. The coordinates of the whole span are
+// worked out first, in a loop the compiler can vectorize, and then fetched.
+static void drawAffineSpan(BYTE *dst, int len, int u, int v, int dx, int dy, VB_WORLD *WBuff,
+                           int bgm_base, int nx, int ny, BITMAP *ovrChr) {
+    int x_mask = (nx<<9)-1;
+    int y_mask = (ny<<9)-1;
+    int span_x[384], span_y[384];
+    int bgm_x, bgm_y, bgm, i;
+    int tPix;
+
+    //round to the nearest pixel, halves away from zero
+    for(i=0;i<len;i++) {
+        bgm_x = u + i*dx;
+        bgm_y = v + i*dy;
+        span_x[i] = (bgm_x + 256 + (bgm_x>>31)) >> 9;
+        span_y[i] = (bgm_y + 256 + (bgm_y>>31)) >> 9;
+    }
+
+    for(i=0;i<len;i++) {
+        bgm_x = span_x[i];
+        bgm_y = span_y[i];
+
+        //time for over_plane char?
+        if(WBuff->OVER && ((bgm_x & ~x_mask)||(bgm_y & ~y_mask))) {
+            tPix = ovrChr->line[bgm_y&7][bgm_x&7];
+        } else {
+            //mask x and y
+            bgm_x &= x_mask;
+            bgm_y &= y_mask;
+
+            //find BGMap to cut out of, if past last BGMap, drop it.
+            bgm = bgm_base+(bgm_x>>9)+(bgm_y>>9)*nx;
+            if(bgm>=14) continue;
+
+            tPix = tDSPCACHE.BGCacheBMP[bgm]->line[bgm_y&511][bgm_x&511];
+        }
+
+        //dont draw if transparent
+        if(tPix)
+            dst[i] = tPix;
+    }
+}
 
 void drawNormalBGMap(VB_WORLD *WBuff, BITMAP *wPlane, 
                      int img_n, int GPX, int MPX) {
@@ -833,13 +793,14 @@ void drawNormalBGMap(VB_WORLD *WBuff, BITMAP *wPlane,
     int w,h;
     int bgc_x, bgc_y;
     int bgm_x, bgm_y;
-    int bgm, bgm_base;
+    int bgm_base;
     int curscr,max;
     int ny, nx;
-    int tPix;
     int h_off = 0;
     AFFINE_MAP tAFN_MP;
     BITMAP *ovrChr = NULL;
+    int run, num_runs, visible;
+    int run_start[4], run_end[4];
 
     bgm_base = WBuff->BGMAP_BASE;
 
@@ -864,6 +825,9 @@ void drawNormalBGMap(VB_WORLD *WBuff, BITMAP *wPlane,
         if(tDSPCACHE.BGCacheInvalid[curscr]==1) {
             BGMap2World(curscr, tDSPCACHE.BGCacheBMP[curscr]);
             tDSPCACHE.BGCacheInvalid[curscr]=0;
+        } else {
+            // Only the cells that changed
+            updateBGMap(curscr, tDSPCACHE.BGCacheBMP[curscr]);
         }
     }
 
@@ -885,9 +849,31 @@ void drawNormalBGMap(VB_WORLD *WBuff, BITMAP *wPlane,
     if(w<-1024) w=-1024;
     if(w>1023)  w=1023;
 
-    //for every pixel on the display
-    for(scr_y=0;scr_y<224;scr_y++) {
+    //Which columns of the screen are inside the world is the same for every
+    //line, so it's worked out once: each run is a span where bgc_x counts up
+    //without wrapping around.
+    num_runs = 0;
+    for(scr_x=0;scr_x<384;scr_x++) {
+        bgc_x = (scr_x - (WBuff->GX+GPX)) & 0x3FF;
+
+        //handle negative widths
+        if(w<0)
+            visible = bgc_x>=(w & 0x03FF);
+        else
+            visible = bgc_x<=w;
+        if(!visible)
+            continue;
+
+        if(num_runs && run_end[num_runs-1]==scr_x && bgc_x) {
+            run_end[num_runs-1]++;
+        } else {
+            run_start[num_runs] = scr_x;
+            run_end[num_runs++] = scr_x+1;
+        }
+    }
 
+    //for every line of the display, a span at a time
+    for(scr_y=0;scr_y<224 && num_runs;scr_y++) {
         //Handle GY
         //GY does not wrap in the positive
         if(scr_y < WBuff->GY) continue;
@@ -896,9 +882,7 @@ void drawNormalBGMap(VB_WORLD *WBuff, BITMAP *wPlane,
         //don't draw outside of the box
         if(bgc_y>h) continue;
 
-        if(WBuff->BGM==1) {  //H-Bias
-            h_off = getHBiasOffset(bgc_y,WBuff->PARAM_BASE,img_n);
-        } else if(WBuff->BGM==2) {  //Affine mode, grab affine struct
+        if(WBuff->BGM==2) {  //Affine mode, grab affine struct
             //grab the afine entry
             getAffine(bgc_y, WBuff->PARAM_BASE, &tAFN_MP);
 
@@ -907,76 +891,34 @@ void drawNormalBGMap(VB_WORLD *WBuff, BITMAP *wPlane,
                 continue;
 
             //take care of paralax
-            //MPX = 0;
             if(img_n==2)
                 MPX = tAFN_MP.paralax;
             else //if(img_n==1) //-Pat (fixes alignment when running 2D)
                 MPX = -tAFN_MP.paralax;
-        }
-
-        for(scr_x=0;scr_x<384;scr_x++) {
 
-            //Handle GX
-            //mask to 1024 pixles
-            bgc_x = (scr_x - (WBuff->GX+GPX)) & 0x3FF; //tAFN_MP.paralax
-
-            //handle negative widths
-            if(w<0) {
-                if(bgc_x<(w & 0x03FF)) continue;
-            } else {
-                if(bgc_x>w) continue;
-            }
-
-            if(WBuff->BGM==2) {  //Affine mode
-                //*****FixMe, convert this to fixed point math
-                //bgm_x  = ROUND_F(tAFN_MP.pb_y+((bgc_x+MPX)*tAFN_MP.pa));
-                //bgm_y  = ROUND_F(tAFN_MP.pd_y+((bgc_x+MPX)*tAFN_MP.pc));
+            for(run=0;run<num_runs;run++) {
+                bgc_x = (run_start[run] - (WBuff->GX+GPX)) & 0x3FF;
                 //-Pat (Affine MP Parallax handled funny - Dev Manual 27.2)
-                if (MPX>=0)
-                {
-                    bgm_x  = ROUND_F(tAFN_MP.pb_y+((bgc_x+MPX)*tAFN_MP.pa));
-                    bgm_y  = ROUND_F(tAFN_MP.pd_y+((bgc_x+MPX)*tAFN_MP.pc));
-                }
-                else
-                {
-                    bgm_x  = ROUND_F(tAFN_MP.pb_y+((bgc_x)*tAFN_MP.pa));
-                    bgm_y  = ROUND_F(tAFN_MP.pd_y+((bgc_x)*tAFN_MP.pc));
-                }
-            } else {
-                //Handle MX/MY
-                bgm_x = WBuff->MX + bgc_x + MPX + h_off;
-                bgm_y = WBuff->MY + bgc_y;
-            }
-
-            //time for over_plane char?
-            if(WBuff->OVER && ((bgm_x & ~((nx<<9)-1))||(bgm_y & ~((ny<<9)-1)))) {
-                bgm_x &= 7;
-                bgm_y &= 7;
-
-                tPix = ovrChr->line[bgm_y][bgm_x];
-            } else {
-                //mask x and y
-                bgm_x &= ((nx<<9)-1);
-                bgm_y &= ((ny<<9)-1);
-
-                //find BGMap to cut out of
-                bgm = bgm_base+(bgm_x>>9)+(bgm_y>>9)*nx;
-
-                //if past last BGMap, drop it.
-                if(bgm>=14) continue;
-
-                bgm_x &=511;
-                bgm_y &=511;
-
-                //draw our pixel
-                tPix = tDSPCACHE.BGCacheBMP[bgm]->line[bgm_y][bgm_x];
+                if(MPX>=0)
+                    bgc_x += MPX;
+                //from 13.3 to the 9 fraction bits of pa and pc
+                drawAffineSpan(&wPlane->line[scr_y+7][run_start[run]+7], run_end[run]-run_start[run],
+                               tAFN_MP.pb_y*64 + bgc_x*tAFN_MP.pa, tAFN_MP.pd_y*64 + bgc_x*tAFN_MP.pc,
+                               tAFN_MP.pa, tAFN_MP.pc, WBuff, bgm_base, nx, ny, ovrChr);
             }
+            continue;
+        }
 
-            //dont draw if transparent
-            if(!tPix) continue;
+        if(WBuff->BGM==1)  //H-Bias
+            h_off = getHBiasOffset(bgc_y,WBuff->PARAM_BASE,img_n);
 
-            //and place on dest bitmap
-            wPlane->line[scr_y+7][scr_x+7] = tPix;
+        //Handle MX/MY
+        bgm_y = WBuff->MY + bgc_y;
+        for(run=0;run<num_runs;run++) {
+            bgc_x = (run_start[run] - (WBuff->GX+GPX)) & 0x3FF;
+            bgm_x = WBuff->MX + bgc_x + MPX + h_off;
+            drawBGMapSpan(&wPlane->line[scr_y+7][run_start[run]+7], run_end[run]-run_start[run],
+                          bgm_x, bgm_y, WBuff, bgm_base, nx, ny, ovrChr);
         }
     }
 
@@ -1032,6 +974,7 @@ bool V810_DSP_Init() {
     for(i = 0; i < 14; i++) {
         tDSPCACHE.BGCacheBMP[i] = create_bitmap(512, 512); // Create our temp Bitmap...
     }
+    resetBGCells();
     world_bmp = create_bitmap(512+8,512+8); // Make them a bit bigger for the Obj's
     world_bmp2 = create_bitmap(384+8, 224+8);
     dsp_bmp = create_bitmap(384*2, 224*2);
@@ -1135,10 +1078,14 @@ void V810_Dsp_Frame(int dNum) {
             getWorld(i,WORLD_Buff);
             if (WORLD_Buff[i].END)
                 break; // Here? or farther down...
+            PROF_START(PROF_WORLD);
             World2Display(i, WORLD_Buff, world_bmp,0);
+            PROF_STOP(PROF_WORLD);
         }
 
+        PROF_START(PROF_DSP2WORLD);
         DSP2World(dNum, world_bmp);
+        PROF_STOP(PROF_DSP2WORLD);
     } else { // 3D Mode...
         clear_to_color(world_bmp,(tVIPREG.BKCOL&0x3)+1);  // zero the memory bitmap
         clear_to_color(world_bmp2,(tVIPREG.BKCOL&0x3)+1); // zero the memory bitmap
@@ -1146,18 +1093,26 @@ void V810_Dsp_Frame(int dNum) {
             getWorld(i,WORLD_Buff);
             if (WORLD_Buff[i].END)
                 break; // Here? or farther down...
+            PROF_START(PROF_WORLD);
             tObj = CurObj; // Save Curent Obj
             World2Display(i, WORLD_Buff, world_bmp,1+tVBOpt.DSPSWAP);
             CurObj = tObj; // Reset it
             World2Display(i, WORLD_Buff, world_bmp2,2-tVBOpt.DSPSWAP);
+            PROF_STOP(PROF_WORLD);
         }
 
+        PROF_START(PROF_DSP2WORLD);
         DSP2World((dNum&1), world_bmp);
         DSP2World((dNum&1)+2, world_bmp2);
+        PROF_STOP(PROF_DSP2WORLD);
 
+        PROF_START(PROF_BLIT);
         screen_blit(world_bmp2, 7, 7, GFX_RIGHT);
+        PROF_STOP(PROF_BLIT);
     }
+    PROF_START(PROF_BLIT);
     screen_blit(world_bmp, 7, 7, GFX_LEFT);
+    PROF_STOP(PROF_BLIT);
 
     isDsp = 0; // Secret flag...
 }
@@ -39,7 +39,6 @@ menu_item_t file_menu_items[] = {
 };
 
 menu_item_t options_menu_items[] = {
-    {"Max cycles", options_maxcycles, NULL, 0, NULL},
     {"Frameskip", options_frameskip, NULL, 0, NULL},
     {"Toggle debug", options_debug, NULL, 0, NULL},
     {"Toggle sound", options_sound, NULL, 0, NULL},
@@ -206,27 +205,6 @@ int file_exit(void) {
     return D_EXIT;
 }
 
-int options_maxcycles(void) {
-#ifdef _3DS
-    char buf[5] = "";
-    SwkbdState swkbd;
-    SwkbdButton button;
-
-    sprintf(buf, "%d", tVBOpt.MAXCYCLES);
-
-    swkbdInit(&swkbd, SWKBD_TYPE_NUMPAD, 1, 4);
-    swkbdSetInitialText(&swkbd, buf);
-    swkbdSetHintText(&swkbd, "The max number of cycles before checking for interrupts");
-    if (swkbdInputText(&swkbd, buf, sizeof(buf)) != SWKBD_BUTTON_CONFIRM)
-        return D_OK;
-
-    tVBOpt.MAXCYCLES = atoi(buf);
-    
-    saveFileOptions();
-#endif
-    return D_OK;
-}
-
 int options_frameskip(void) {
 #ifdef _3DS
     char buf[2] = "";
@@ -441,12 +419,15 @@ int emulation_lstate(void) {
     fread(&tHReg.tTHW, 2, 1, state_file); //not publicly visible
     fread(&tHReg.tCount, 2, 1, state_file); //not publicly visible
     fread(&tHReg.tTRC, 4, 1, state_file); //not publicly visible
+    v810_resetTimer(v810_state->cycles);
 
     //Load the RAM
     fread(V810_DISPLAY_RAM.pmemory, 1, V810_DISPLAY_RAM.highaddr - V810_DISPLAY_RAM.lowaddr, state_file);
     fread(V810_SOUND_RAM.pmemory, 1, V810_SOUND_RAM.highaddr - V810_SOUND_RAM.lowaddr, state_file);
     fread(V810_VB_RAM.pmemory, 1, V810_VB_RAM.highaddr - V810_VB_RAM.lowaddr, state_file);
     fread(V810_GAME_RAM.pmemory, 1, V810_GAME_RAM.highaddr - V810_GAME_RAM.lowaddr, state_file);
+    // Any code translated from the old RAM contents is stale
+    drc_invalidateRam(V810_VB_RAM.lowaddr, V810_VB_RAM.highaddr + 1);
 
     fclose(state_file);
 
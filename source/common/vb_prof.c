@@ -0,0 +1,100 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "vb_types.h"
+#include "vb_prof.h"
+
+#ifdef VB_PROFILE
+
+u64 prof_start_ticks[PROF_NUM_PROBES];
+u64 prof_frame_ticks[PROF_NUM_PROBES];
+
+static const char* const prof_names[PROF_NUM_PROBES] = {
+    "translate",
+    "execute",
+    "interrupts",
+    "world",
+    "dsp2world",
+    "blit",
+    "sound",
+    "frame",
+};
+
+static prof_stats prof_probes[PROF_NUM_PROBES];
+static unsigned int prof_frame = 0;
+static FILE* prof_csv = NULL;
+
+void prof_init(const char* csv_filename) {
+    int i;
+
+    prof_reset();
+    if (csv_filename && (prof_csv = fopen(csv_filename, "w"))) {
+        fprintf(prof_csv, "frame");
+        for (i = 0; i < PROF_NUM_PROBES; i++)
+            fprintf(prof_csv, ",%s_us", prof_names[i]);
+        fprintf(prof_csv, "\n");
+    }
+}
+
+void prof_exit() {
+    if (prof_csv)
+        fclose(prof_csv);
+    prof_csv = NULL;
+}
+
+void prof_reset() {
+    memset(prof_probes, 0, sizeof(prof_probes));
+    memset(prof_frame_ticks, 0, sizeof(prof_frame_ticks));
+    prof_frame = 0;
+    // The first frame starts now
+    prof_start_ticks[PROF_FRAME] = GetTicks();
+}
+
+static void prof_add(prof_stats* stats, unsigned int us) {
+    int bucket = 0;
+
+    while (bucket < PROF_NUM_BUCKETS - 1 && us >= (1U << bucket))
+        bucket++;
+    stats->buckets[bucket]++;
+
+    if (!stats->frames || us < stats->min_us)
+        stats->min_us = us;
+    if (us > stats->max_us)
+        stats->max_us = us;
+    stats->last_us = us;
+    stats->total_us += us;
+    stats->frames++;
+}
+
+void prof_endFrame() {
+    u64 now = GetTicks();
+    u64 per_us = GetTicksPerSec() / 1000000;
+    unsigned int us;
+    int i;
+
+    prof_frame_ticks[PROF_FRAME] = now - prof_start_ticks[PROF_FRAME];
+    prof_start_ticks[PROF_FRAME] = now;
+
+    if (prof_csv)
+        fprintf(prof_csv, "%u", prof_frame);
+    for (i = 0; i < PROF_NUM_PROBES; i++) {
+        us = prof_frame_ticks[i] / per_us;
+        prof_add(&prof_probes[i], us);
+        if (prof_csv)
+            fprintf(prof_csv, ",%u", us);
+        prof_frame_ticks[i] = 0;
+    }
+    if (prof_csv)
+        fprintf(prof_csv, "\n");
+    prof_frame++;
+}
+
+const prof_stats* prof_getStats(int probe) {
+    return &prof_probes[probe];
+}
+
+const char* prof_getName(int probe) {
+    return prof_names[probe];
+}
+
+#endif
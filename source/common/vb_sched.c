@@ -0,0 +1,130 @@
+#include <stdio.h>
+
+#include "vb_types.h"
+#include "vb_sched.h"
+#include "vb_prof.h"
+#include "v810_cpu.h"
+
+typedef struct {
+    WORD cycles;
+    int event;
+} sched_entry;
+
+static const sched_handler sched_handlers[SCHED_NUM_EVENTS] = {
+    serviceDisplayInt,
+    serviceInt,
+};
+
+// Binary min-heap ordered by due cycle, and where each event is in it (-1 if
+// it isn't pending)
+static sched_entry heap[SCHED_NUM_EVENTS];
+static int heap_pos[SCHED_NUM_EVENTS];
+static int heap_size = 0;
+
+// The cycle counter wraps around, so compare the difference
+static bool sched_before(WORD a, WORD b) {
+    return (int)(a - b) < 0;
+}
+
+static void sched_swap(int a, int b) {
+    sched_entry tmp = heap[a];
+    heap[a] = heap[b];
+    heap[b] = tmp;
+    heap_pos[heap[a].event] = a;
+    heap_pos[heap[b].event] = b;
+}
+
+static void sched_siftUp(int pos) {
+    while (pos > 0 && sched_before(heap[pos].cycles, heap[(pos - 1)/2].cycles)) {
+        sched_swap(pos, (pos - 1)/2);
+        pos = (pos - 1)/2;
+    }
+}
+
+static void sched_siftDown(int pos) {
+    int child;
+
+    while ((child = 2*pos + 1) < heap_size) {
+        if (child + 1 < heap_size && sched_before(heap[child + 1].cycles, heap[child].cycles))
+            child++;
+        if (!sched_before(heap[child].cycles, heap[pos].cycles))
+            break;
+        sched_swap(pos, child);
+        pos = child;
+    }
+}
+
+// Lets the translated code know how far it can run before the next event
+static void sched_update() {
+    if (!v810_state)
+        return;
+    if (heap_size)
+        v810_state->next_event = (int)(heap[0].cycles - v810_state->cycles);
+    else
+        v810_state->next_event = 0x7FFFFFFF;
+}
+
+void sched_init() {
+    int i;
+
+    heap_size = 0;
+    for (i = 0; i < SCHED_NUM_EVENTS; i++)
+        heap_pos[i] = -1;
+    sched_update();
+}
+
+void sched_schedule(int event, WORD cycles) {
+    int pos = heap_pos[event];
+
+    if (pos < 0) {
+        pos = heap_size++;
+        heap[pos].event = event;
+        heap_pos[event] = pos;
+    }
+    heap[pos].cycles = cycles;
+    sched_siftUp(pos);
+    sched_siftDown(heap_pos[event]);
+    sched_update();
+}
+
+void sched_cancel(int event) {
+    int pos = heap_pos[event];
+    int moved;
+
+    if (pos < 0)
+        return;
+    heap_pos[event] = -1;
+    if (pos < --heap_size) {
+        // Fill the hole with the last entry
+        heap[pos] = heap[heap_size];
+        moved = heap[pos].event;
+        heap_pos[moved] = pos;
+        sched_siftUp(pos);
+        sched_siftDown(heap_pos[moved]);
+    }
+    sched_update();
+}
+
+bool sched_pending(int event) {
+    return heap_pos[event] >= 0;
+}
+
+int sched_run(WORD cycles, WORD PC) {
+    sched_entry due;
+    int ret = 0;
+
+    // Timed here since translated code calls it from the middle of blocks too
+    PROF_START(PROF_INTERRUPTS);
+    // Raising an interrupt points PC to its handler instead
+    v810_state->PC = PC;
+
+    while (heap_size && !sched_before(cycles, heap[0].cycles)) {
+        due = heap[0];
+        sched_cancel(due.event);
+        ret |= sched_handlers[due.event](due.cycles, PC);
+    }
+    sched_update();
+    PROF_STOP(PROF_INTERRUPTS);
+
+    return ret;
+}
@@ -14,7 +14,6 @@ int     vbkey[15];
 
 void setDefaults(void) {
     // Set up the Defaults
-    tVBOpt.MAXCYCLES = 512;
     tVBOpt.FRMSKIP  = 0;
     tVBOpt.DSPMODE  = DM_NORMAL;
     tVBOpt.DSPSWAP  = 0;
@@ -30,6 +29,10 @@ void setDefaults(void) {
     tVBOpt.SOUND    = 0;
     tVBOpt.DSP2X    = 0;
     tVBOpt.DYNAREC  = 1;
+    tVBOpt.DRCTHREAD = 0;
+    tVBOpt.INTERP   = 0;
+    tVBOpt.LOCKSTEP = 0;
+    tVBOpt.FASTMEM  = 0;
 
     // Default keys
 #ifdef _3DS
@@ -60,9 +63,7 @@ static int handler(void* user, const char* section, const char* name,
     VB_OPT* pconfig = (VB_OPT*)user;
 
     #define MATCH(s, n) strcmp(section, s) == 0 && strcmp(name, n) == 0
-    if (MATCH("vbopt", "maxcycles")) {
-        pconfig->MAXCYCLES = atoi(value);
-    } else if (MATCH("vbopt", "frmskip")) {
+    if (MATCH("vbopt", "frmskip")) {
         pconfig->FRMSKIP = atoi(value);
     } else if (MATCH("vbopt", "dspmode")) {
         pconfig->DSPMODE = atoi(value);
@@ -92,6 +93,14 @@ static int handler(void* user, const char* section, const char* name,
         pconfig->SOUND = atoi(value);
     } else if (MATCH("vbopt", "dynarec")) {
         pconfig->DYNAREC = atoi(value);
+    } else if (MATCH("vbopt", "drcthread")) {
+        pconfig->DRCTHREAD = atoi(value);
+    } else if (MATCH("vbopt", "interpreter")) {
+        pconfig->INTERP = atoi(value);
+    } else if (MATCH("vbopt", "lockstep")) {
+        pconfig->LOCKSTEP = atoi(value);
+    } else if (MATCH("vbopt", "fastmem")) {
+        pconfig->FASTMEM = atoi(value);
     } else if (MATCH("keys", "lup")) {
         vbkey[VB_KCFG_LUP] = atoi(value);
     } else if (MATCH("keys", "ldown")) {
@@ -136,7 +145,6 @@ int saveFileOptions(void) {
         return 1;
 
     fprintf(f, "[vbopt]\n");
-    fprintf(f, "maxcycles=%d\n", tVBOpt.MAXCYCLES);
     fprintf(f, "frmskip=%d\n", tVBOpt.FRMSKIP);
     fprintf(f, "dspmode=%d\n", tVBOpt.DSPMODE);
     fprintf(f, "dspswap=%d\n", tVBOpt.DSPSWAP);
@@ -151,7 +159,11 @@ int saveFileOptions(void) {
     fprintf(f, "disasm=%d\n", tVBOpt.DISASM);
     fprintf(f, "sound=%d\n", tVBOpt.SOUND);
     fprintf(f, "dsp2x=%d\n\n", tVBOpt.DSP2X);
-    fprintf(f, "dynarec=%d\n\n", tVBOpt.DYNAREC);
+    fprintf(f, "dynarec=%d\n", tVBOpt.DYNAREC);
+    fprintf(f, "drcthread=%d\n", tVBOpt.DRCTHREAD);
+    fprintf(f, "interpreter=%d\n", tVBOpt.INTERP);
+    fprintf(f, "lockstep=%d\n", tVBOpt.LOCKSTEP);
+    fprintf(f, "fastmem=%d\n\n", tVBOpt.FASTMEM);
 
     fprintf(f, "[keys]\n");
     fprintf(f, "lup=%d\n", vbkey[VB_KCFG_LUP]);
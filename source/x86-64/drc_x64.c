@@ -0,0 +1,842 @@
+/*
+ * V810 dynamic recompiler for x86-64
+ *
+ * Uses the same block scanning and analysis passes as the ARM backend (see
+ * drc_scan.c). The V810 registers stay in v810_state, and whatever isn't
+ * translated here (TRAP, the bit string and floating point instructions and
+ * CAXI) is left to the interpreter.
+ *
+ * This file is distributed under the MIT License, see drc_core.c.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <malloc.h>
+
+#include "utils.h"
+#include "drc_core.h"
+#include "drc_x64.h"
+#include "x64_emit.h"
+#include "x64_fastmem.h"
+#include "v810_cpu.h"
+#include "v810_mem.h"
+#include "v810_opt.h"
+#include "vb_gui.h"
+#include "vb_sched.h"
+#include "vb_prof.h"
+#include "vb_set.h"
+#include "vb_types.h"
+
+// Values returned by the translated code
+#define X64_EXIT_NORMAL 0
+#define X64_EXIT_INTERP 1 // The instruction at v810_state->PC has to be interpreted
+
+// Upper bound of bytes emitted for a single V810 instruction
+#define X64_MAX_INST_SIZE 128
+
+#define X64_STATE(field) ((int)offsetof(cpu_state, field))
+#define X64_REG(r) (X64_STATE(P_REG) + (r)*4)
+#define X64_SREG(r) (X64_STATE(S_REG) + (r)*4)
+
+// Same layout as the ARM CPSR, see v810_interp.c
+#define X64_FLAG_N (1U << 31)
+#define X64_FLAG_Z (1U << 30)
+#define X64_FLAG_C (1U << 29)
+#define X64_FLAG_V (1U << 28)
+#define X64_FLAGS_ALL (X64_FLAG_N | X64_FLAG_Z | X64_FLAG_C | X64_FLAG_V)
+
+WORD* cache_start;
+WORD* cache_pos;
+BYTE* x64_ptr;
+
+// Translated code for every halfword of ROM and VB RAM, NULL if there's none
+static BYTE** x64_rom_map;
+static BYTE** x64_ram_map;
+
+// Generated by drc_init. x64_enter saves the callee-saved registers it uses
+// and jumps to the code, and x64_exit adds r13d to v810_state->cycles and
+// returns eax back to drc_run.
+static int (*x64_enter)(cpu_state* state, BYTE* code);
+static BYTE* x64_exit;
+// Where the translated blocks start, right after the two stubs
+static BYTE* x64_code_start;
+
+static v810_instruction inst_cache[MAX_INST];
+static BYTE* inst_code[MAX_INST];
+static bool inst_target[MAX_INST];
+
+// Branches to a later instruction of the block, patched once it's translated
+static struct {
+    BYTE* disp;
+    int target;
+} x64_fixups[MAX_INST];
+static int x64_num_fixups;
+
+// Cycles of the instructions translated since r13d was last updated
+static int x64_pending_cycles;
+
+// Blocks translated since drc_init and since the cache was last cleared
+static unsigned int x64_num_translated;
+static unsigned int x64_num_blocks;
+
+// Needed by v810_reset, only the ARM code uses them
+int drc_handleInterrupts(WORD cpsr, WORD* PC) {
+    return 0;
+}
+
+int drc_exitForEvents(WORD cpsr, WORD* PC) {
+    return 0;
+}
+
+void drc_relocTable(void) {
+}
+
+BYTE** x64_getEntrySlot(WORD PC) {
+    if ((PC >> 24) == 0x05)
+        return &x64_ram_map[(PC & (V810_VB_RAM.highaddr - V810_VB_RAM.lowaddr)) >> 1];
+    if ((PC >> 24) == 0x07)
+        return &x64_rom_map[((PC & V810_ROM1.highaddr) - V810_ROM1.lowaddr) >> 1];
+    return NULL;
+}
+
+// Drops all the translated code
+static void x64_clearCache() {
+    memset(x64_rom_map, 0, ((V810_ROM1.highaddr - V810_ROM1.lowaddr) / 2 + 1) * sizeof(BYTE*));
+    memset(x64_ram_map, 0, ((V810_VB_RAM.highaddr - V810_VB_RAM.lowaddr) / 2 + 1) * sizeof(BYTE*));
+    memset(v810_state->ram_code_pages, 0, sizeof(v810_state->ram_code_pages));
+    x64_fastmemUnprotectCode();
+    x64_ptr = x64_code_start;
+    cache_pos = (WORD*)x64_ptr;
+    x64_num_blocks = 0;
+    dprintf(3, "[DRC]: cache cleared\n");
+}
+
+// Adds the cycles counted so far to r13d
+static void x64_flushCycles() {
+    if (x64_pending_cycles) {
+        x64_aluImm(X64_ADD, X64_R13, x64_pending_cycles);
+        x64_pending_cycles = 0;
+    }
+}
+
+// Leaves the translated code, with v810_state->PC set to PC
+static void x64_exitTo(WORD PC, int code) {
+    x64_flushCycles();
+    x64_storeImm(X64_STATE(PC), PC);
+    if (code)
+        x64_movImm(X64_EAX, code);
+    else
+        x64_alu(X64_XOR, X64_EAX, X64_EAX);
+    x64_jmp(x64_exit);
+}
+
+// Sets N and Z for the result in eax and clears V. It has to be stored
+// already, since lahf overwrites ah.
+static void x64_setLogicFlags() {
+    x64_load(X64_EDX, X64_STATE(flags));
+    x64_aluImm(X64_AND, X64_EDX, X64_FLAG_C);
+    x64_test(X64_EAX, X64_EAX);
+    x64_lahf();
+    x64_movzxAh(X64_ECX);
+    x64_aluImm(X64_AND, X64_ECX, 0xC0);
+    x64_shiftImm(X64_SHL, X64_ECX, 24);
+    x64_alu(X64_OR, X64_EDX, X64_ECX);
+    x64_store(X64_STATE(flags), X64_EDX);
+}
+
+// Sets all the flags after an add, sub or cmp. CF is the carry or the borrow
+// just like the V810 CY.
+static void x64_setArithFlags() {
+    x64_lahf();
+    x64_setcc(X64_CC_O, X64_EAX);
+    x64_movzxAh(X64_ECX);
+    x64_movx(X64_MOVZX8, X64_EDX, X64_EAX);
+    x64_shiftImm(X64_SHL, X64_EDX, 28);
+    x64_mov(X64_EAX, X64_ECX);
+    x64_aluImm(X64_AND, X64_EAX, 1);
+    x64_shiftImm(X64_SHL, X64_EAX, 29);
+    x64_alu(X64_OR, X64_EDX, X64_EAX);
+    x64_aluImm(X64_AND, X64_ECX, 0xC0);
+    x64_shiftImm(X64_SHL, X64_ECX, 24);
+    x64_alu(X64_OR, X64_EDX, X64_ECX);
+    x64_store(X64_STATE(flags), X64_EDX);
+}
+
+// Tests a V810 condition on the flags. Returns the x86 condition code that is
+// true when it is. cond can't be COND_T or its opposite.
+static BYTE x64_emitCond(BYTE cond) {
+    BYTE cc = X64_CC_B;
+
+    x64_load(X64_EAX, X64_STATE(flags));
+    switch (cond & 0x7) {
+        case COND_V:
+            x64_bt(X64_EAX, 28);
+            break;
+        case COND_C:
+            x64_bt(X64_EAX, 29);
+            break;
+        case COND_Z:
+            x64_bt(X64_EAX, 30);
+            break;
+        case COND_NH:
+            x64_testImm(X64_EAX, X64_FLAG_C | X64_FLAG_Z);
+            cc = X64_CC_NE;
+            break;
+        case COND_S:
+            x64_bt(X64_EAX, 31);
+            break;
+        case COND_LT:
+            // N != V, with V moved up to N
+            x64_mov(X64_ECX, X64_EAX);
+            x64_shiftImm(X64_SHL, X64_ECX, 3);
+            x64_alu(X64_XOR, X64_EAX, X64_ECX);
+            x64_bt(X64_EAX, 31);
+            break;
+        default: // COND_LE
+            x64_mov(X64_ECX, X64_EAX);
+            x64_shiftImm(X64_SHL, X64_ECX, 3);
+            x64_alu(X64_XOR, X64_ECX, X64_EAX);
+            x64_aluImm(X64_AND, X64_ECX, X64_FLAG_N);
+            x64_aluImm(X64_AND, X64_EAX, X64_FLAG_Z);
+            x64_alu(X64_OR, X64_EAX, X64_ECX);
+            cc = X64_CC_NE;
+            break;
+    }
+    return (cond & 0x8) ? cc ^ 1 : cc;
+}
+
+// Register and immediate shifts that set flags. The carry is the last bit
+// shifted out, which x86 doesn't set for a zero shift, so it's done here.
+static void x64_shift(WORD op_reg2, WORD amount) {
+    BYTE op = op_reg2 & 0xFF;
+    BYTE reg2 = op_reg2 >> 8;
+    WORD a = v810_state->P_REG[reg2];
+    WORD res;
+    bool carry;
+
+    amount &= 0x1F;
+    if (op == V810_OP_SHL || op == V810_OP_SHL_I) {
+        res = a << amount;
+        carry = amount && ((a >> (32 - amount)) & 1);
+    } else {
+        if (op == V810_OP_SHR || op == V810_OP_SHR_I)
+            res = a >> amount;
+        else
+            res = (WORD)((int)a >> amount);
+        carry = amount && ((a >> (amount - 1)) & 1);
+    }
+
+    v810_state->flags = (v810_state->flags & ~X64_FLAGS_ALL) | (res & X64_FLAG_N) |
+        (res ? 0 : X64_FLAG_Z) | (carry ? X64_FLAG_C : 0);
+    if (reg2)
+        v810_state->P_REG[reg2] = res;
+}
+
+// MUL, MULU, DIV and DIVU, with the upper half or the remainder in r30
+static void x64_mulDiv(WORD op_regs) {
+    BYTE op = op_regs & 0xFF;
+    BYTE reg1 = (op_regs >> 8) & 0xFF;
+    BYTE reg2 = op_regs >> 16;
+    WORD a = v810_state->P_REG[reg2];
+    WORD b = v810_state->P_REG[reg1];
+    WORD res, hi;
+    bool overflow = false;
+    INT64 wide;
+
+    switch (op) {
+        case V810_OP_MUL:
+            wide = (INT64)(int)a * (int)b;
+            res = (WORD)wide;
+            hi = (WORD)(wide >> 32);
+            overflow = wide != (int)res;
+            break;
+        case V810_OP_MULU:
+            wide = (INT64)((INT64U)a * b);
+            res = (WORD)wide;
+            hi = (WORD)((INT64U)wide >> 32);
+            overflow = hi != 0;
+            break;
+        case V810_OP_DIV:
+            // Division by zero would be an exception, which isn't emulated
+            if (!b)
+                return;
+            if (a == 0x80000000 && b == 0xFFFFFFFF) {
+                res = a;
+                hi = 0;
+                overflow = true;
+            } else {
+                res = (WORD)((int)a / (int)b);
+                hi = (WORD)((int)a % (int)b);
+            }
+            break;
+        default: // V810_OP_DIVU
+            if (!b)
+                return;
+            res = a / b;
+            hi = a % b;
+            break;
+    }
+
+    v810_state->flags = (v810_state->flags & ~(X64_FLAG_N | X64_FLAG_Z | X64_FLAG_V)) |
+        (res & X64_FLAG_N) | (res ? 0 : X64_FLAG_Z) | (overflow ? X64_FLAG_V : 0);
+    v810_state->P_REG[30] = hi;
+    v810_state->P_REG[reg2] = res;
+    v810_state->P_REG[0] = 0;
+}
+
+static void x64_reti() {
+    if (v810_state->S_REG[PSW] & PSW_NP) {
+        v810_state->PC = v810_state->S_REG[FEPC];
+        v810_state->S_REG[PSW] = v810_state->S_REG[FEPSW];
+    } else {
+        v810_state->PC = v810_state->S_REG[EIPC];
+        v810_state->S_REG[PSW] = v810_state->S_REG[EIPSW];
+    }
+}
+
+// Computes the address of a load or store in edi. With fastmem it's also
+// masked to the 27 bits the view covers.
+static void x64_emitAddress(v810_instruction* inst, WORD align_mask) {
+    x64_load(X64_EDI, X64_REG(inst->reg1));
+    x64_aluImm(X64_ADD, X64_EDI, (WORD)(signed short)inst->imm);
+    if (x64_fastmem_base)
+        x64_aluImm(X64_AND, X64_EDI, (X64_FASTMEM_SIZE - 1) & ~align_mask);
+    else if (align_mask)
+        x64_aluImm(X64_AND, X64_EDI, ~align_mask);
+}
+
+// Loads into reg2, ext is how the result in eax gets extended (0 for words)
+static void x64_emitLoad(v810_instruction* inst, void* func, WORD align_mask, BYTE ext) {
+    x64_emitAddress(inst, align_mask);
+    if (x64_fastmem_base) {
+        x64_loadFast(ext, X64_EAX);
+    } else {
+        x64_call(func);
+        if (ext)
+            x64_movx(ext, X64_EAX, X64_EAX);
+    }
+    if (inst->reg2)
+        x64_store(X64_REG(inst->reg2), X64_EAX);
+}
+
+static void x64_emitStore(v810_instruction* inst, void* func, WORD align_mask) {
+    x64_emitAddress(inst, align_mask);
+    x64_load(X64_ESI, X64_REG(inst->reg2));
+    if (x64_fastmem_base)
+        x64_storeFast(align_mask + 1, X64_ESI);
+    else
+        x64_call(func);
+}
+
+// Branches to a V810 address. Targets within the block are jumped to
+// directly while no event is due, anything else goes back to drc_run.
+static void x64_emitJump(WORD target_PC, unsigned int num_inst) {
+    int target = drc_findInst(inst_cache, num_inst, target_PC);
+    BYTE* disp;
+
+    x64_flushCycles();
+    if (target >= 0) {
+        x64_aluLoad(X64_CMP, X64_R13, X64_STATE(next_event));
+        disp = x64_jcc(X64_CC_L, inst_code[target]);
+        if (!inst_code[target]) {
+            x64_fixups[x64_num_fixups].disp = disp;
+            x64_fixups[x64_num_fixups].target = target;
+            x64_num_fixups++;
+        }
+    }
+    x64_exitTo(target_PC, X64_EXIT_NORMAL);
+}
+
+// Translates the instruction at inst_cache[i]
+static void x64_emitInst(unsigned int i, unsigned int num_inst) {
+    v810_instruction* inst = &inst_cache[i];
+    BYTE cond, cc;
+    BYTE* skip;
+    bool flags = inst->live_flags != 0;
+
+    x64_pending_cycles += opcycle[inst->opcode];
+
+    switch (inst->opcode) {
+        case V810_OP_MOV:
+            if (inst->reg2) {
+                x64_load(X64_EAX, X64_REG(inst->reg1));
+                x64_store(X64_REG(inst->reg2), X64_EAX);
+            }
+            break;
+        case V810_OP_MOV_I:
+            if (inst->reg2)
+                x64_storeImm(X64_REG(inst->reg2), (WORD)sign_5(inst->imm));
+            break;
+        case V810_OP_MOVEA:
+        case V810_OP_MOVHI:
+            if (inst->reg2) {
+                x64_load(X64_EAX, X64_REG(inst->reg1));
+                x64_aluImm(X64_ADD, X64_EAX, inst->opcode == V810_OP_MOVHI ?
+                           inst->imm << 16 : (WORD)(signed short)inst->imm);
+                x64_store(X64_REG(inst->reg2), X64_EAX);
+            }
+            break;
+
+        case V810_OP_ADD:
+        case V810_OP_SUB:
+        case V810_OP_CMP:
+            x64_load(X64_EAX, X64_REG(inst->reg2));
+            x64_aluLoad(inst->opcode == V810_OP_ADD ? X64_ADD : X64_SUB, X64_EAX, X64_REG(inst->reg1));
+            if (inst->opcode != V810_OP_CMP && inst->reg2)
+                x64_store(X64_REG(inst->reg2), X64_EAX);
+            if (flags)
+                x64_setArithFlags();
+            break;
+        case V810_OP_ADD_I:
+        case V810_OP_CMP_I:
+            x64_load(X64_EAX, X64_REG(inst->reg2));
+            x64_aluImm(inst->opcode == V810_OP_ADD_I ? X64_ADD : X64_SUB, X64_EAX, (WORD)sign_5(inst->imm));
+            if (inst->opcode == V810_OP_ADD_I && inst->reg2)
+                x64_store(X64_REG(inst->reg2), X64_EAX);
+            if (flags)
+                x64_setArithFlags();
+            break;
+        case V810_OP_ADDI:
+            x64_load(X64_EAX, X64_REG(inst->reg1));
+            x64_aluImm(X64_ADD, X64_EAX, (WORD)(signed short)inst->imm);
+            if (inst->reg2)
+                x64_store(X64_REG(inst->reg2), X64_EAX);
+            if (flags)
+                x64_setArithFlags();
+            break;
+
+        case V810_OP_OR:
+        case V810_OP_AND:
+        case V810_OP_XOR:
+            x64_load(X64_EAX, X64_REG(inst->reg2));
+            x64_aluLoad(inst->opcode == V810_OP_OR ? X64_OR : (inst->opcode == V810_OP_AND ? X64_AND : X64_XOR),
+                        X64_EAX, X64_REG(inst->reg1));
+            if (inst->reg2)
+                x64_store(X64_REG(inst->reg2), X64_EAX);
+            if (flags)
+                x64_setLogicFlags();
+            break;
+        case V810_OP_ORI:
+        case V810_OP_ANDI:
+        case V810_OP_XORI:
+            x64_load(X64_EAX, X64_REG(inst->reg1));
+            x64_aluImm(inst->opcode == V810_OP_ORI ? X64_OR : (inst->opcode == V810_OP_ANDI ? X64_AND : X64_XOR),
+                       X64_EAX, inst->imm);
+            if (inst->reg2)
+                x64_store(X64_REG(inst->reg2), X64_EAX);
+            if (flags)
+                x64_setLogicFlags();
+            break;
+        case V810_OP_NOT:
+            x64_load(X64_EAX, X64_REG(inst->reg1));
+            x64_not(X64_EAX);
+            if (inst->reg2)
+                x64_store(X64_REG(inst->reg2), X64_EAX);
+            if (flags)
+                x64_setLogicFlags();
+            break;
+
+        case V810_OP_SHL:
+        case V810_OP_SHR:
+        case V810_OP_SAR:
+        case V810_OP_SHL_I:
+        case V810_OP_SHR_I:
+        case V810_OP_SAR_I:
+            if (inst->opcode < V810_OP_MOV_I)
+                x64_load(X64_ECX, X64_REG(inst->reg1));
+            else
+                x64_movImm(X64_ECX, inst->imm);
+            if (flags) {
+                x64_movImm(X64_EDI, inst->opcode | (inst->reg2 << 8));
+                x64_mov(X64_ESI, X64_ECX);
+                x64_call(x64_shift);
+            } else if (inst->reg2) {
+                // x86 masks the shift amount to 5 bits too
+                x64_load(X64_EAX, X64_REG(inst->reg2));
+                switch (inst->opcode & 0xF) {
+                    case V810_OP_SHL: x64_shiftCl(X64_SHL, X64_EAX); break;
+                    case V810_OP_SHR: x64_shiftCl(X64_SHR, X64_EAX); break;
+                    default:          x64_shiftCl(X64_SAR, X64_EAX); break;
+                }
+                x64_store(X64_REG(inst->reg2), X64_EAX);
+            }
+            break;
+
+        case V810_OP_MUL:
+        case V810_OP_MULU:
+        case V810_OP_DIV:
+        case V810_OP_DIVU:
+            x64_movImm(X64_EDI, inst->opcode | (inst->reg1 << 8) | (inst->reg2 << 16));
+            x64_call(x64_mulDiv);
+            break;
+
+        case V810_OP_SETF:
+            if (!inst->reg2)
+                break;
+            cond = inst->imm & 0xF;
+            if ((cond & 0x7) == COND_T) {
+                x64_storeImm(X64_REG(inst->reg2), !(cond & 0x8));
+                break;
+            }
+            cc = x64_emitCond(cond);
+            x64_setcc(cc, X64_EAX);
+            x64_movx(X64_MOVZX8, X64_EAX, X64_EAX);
+            x64_store(X64_REG(inst->reg2), X64_EAX);
+            break;
+
+        case V810_OP_LD_B:
+            x64_emitLoad(inst, mem_rbyte, 0, X64_MOVSX8);
+            break;
+        case V810_OP_LD_H:
+            x64_emitLoad(inst, mem_rhword, 1, X64_MOVSX16);
+            break;
+        case V810_OP_LD_W:
+            x64_emitLoad(inst, mem_rword, 3, 0);
+            break;
+        case V810_OP_IN_B:
+            x64_emitLoad(inst, port_rbyte, 0, X64_MOVZX8);
+            break;
+        case V810_OP_IN_H:
+            x64_emitLoad(inst, port_rhword, 1, X64_MOVZX16);
+            break;
+        case V810_OP_IN_W:
+            x64_emitLoad(inst, port_rword, 3, 0);
+            break;
+        // OUT is the same as ST on the VB
+        case V810_OP_ST_B:
+        case V810_OP_OUT_B:
+            x64_emitStore(inst, mem_wbyte, 0);
+            break;
+        case V810_OP_ST_H:
+        case V810_OP_OUT_H:
+            x64_emitStore(inst, mem_whword, 1);
+            break;
+        case V810_OP_ST_W:
+        case V810_OP_OUT_W:
+            x64_emitStore(inst, mem_wword, 3);
+            break;
+
+        case V810_OP_LDSR:
+            x64_load(X64_EAX, X64_REG(inst->reg2));
+            x64_store(X64_SREG(inst->imm), X64_EAX);
+            break;
+        case V810_OP_STSR:
+            if (inst->reg2) {
+                x64_load(X64_EAX, X64_SREG(inst->imm));
+                x64_store(X64_REG(inst->reg2), X64_EAX);
+            }
+            break;
+        case V810_OP_CLI:
+            x64_aluStateImm(X64_AND, X64_SREG(PSW), ~PSW_ID);
+            break;
+        case V810_OP_SEI:
+            x64_aluStateImm(X64_OR, X64_SREG(PSW), PSW_ID);
+            break;
+
+        case V810_OP_JMP:
+            x64_flushCycles();
+            x64_load(X64_EAX, X64_REG(inst->reg1));
+            x64_aluImm(X64_AND, X64_EAX, 0xFFFFFFFE);
+            x64_store(X64_STATE(PC), X64_EAX);
+            x64_alu(X64_XOR, X64_EAX, X64_EAX);
+            x64_jmp(x64_exit);
+            break;
+        case V810_OP_JAL:
+            x64_storeImm(X64_REG(31), inst->PC + 4);
+            // Fall through
+        case V810_OP_JR:
+            x64_emitJump(inst->PC + inst->branch_offset, num_inst);
+            break;
+        case V810_OP_RETI:
+            x64_flushCycles();
+            x64_call(x64_reti);
+            x64_alu(X64_XOR, X64_EAX, X64_EAX);
+            x64_jmp(x64_exit);
+            break;
+        case V810_OP_HALT:
+            // drc_run sleeps until the next interrupt
+            x64_storeImm8(X64_STATE(halted), 1);
+            x64_exitTo(inst->PC + 2, X64_EXIT_NORMAL);
+            break;
+
+        case V810_OP_NOP:
+            break;
+        case V810_OP_BV: case V810_OP_BL: case V810_OP_BE: case V810_OP_BNH:
+        case V810_OP_BN: case V810_OP_BR: case V810_OP_BLT: case V810_OP_BLE:
+        case V810_OP_BNV: case V810_OP_BNL: case V810_OP_BNE: case V810_OP_BH:
+        case V810_OP_BP: case V810_OP_BGE: case V810_OP_BGT:
+            cond = inst->opcode & 0xF;
+            if (cond == COND_T) {
+                x64_emitJump(inst->PC + inst->branch_offset, num_inst);
+                break;
+            }
+            x64_flushCycles();
+            cc = x64_emitCond(cond);
+            skip = x64_jcc(cc ^ 1, NULL);
+            x64_emitJump(inst->PC + inst->branch_offset, num_inst);
+            x64_patch(skip, x64_ptr);
+            break;
+
+        default:
+            // The interpreter counts the cycles for this one
+            x64_pending_cycles -= opcycle[inst->opcode];
+            x64_exitTo(inst->PC, X64_EXIT_INTERP);
+            break;
+    }
+}
+
+// Translates the block starting at entry_PC and adds its entrypoints to the
+// maps
+int x64_translateBlock(WORD entry_PC) {
+    exec_block block;
+    WORD start_PC = entry_PC, end_PC;
+    unsigned int num_inst, i;
+    v810_instruction* last;
+    BYTE** slot;
+    int target;
+
+    memset(&block, 0, sizeof(block));
+    drc_scanBlockBounds(&start_PC, &end_PC);
+    num_inst = drc_decodeInstructions(&block, inst_cache, start_PC, end_PC);
+    if (!num_inst)
+        return DRC_ERR_BAD_PC;
+    drc_findLiveFlags(inst_cache, num_inst);
+    // The liveness pass counts DIV and DIVU as overwriting all the flags,
+    // since the ARM helpers clobber them. x64_mulDiv leaves them alone on a
+    // division by zero, so blocks with one keep every flag up to date.
+    for (i = 0; i < num_inst; i++) {
+        if (inst_cache[i].opcode == V810_OP_DIV || inst_cache[i].opcode == V810_OP_DIVU) {
+            for (i = 0; i < num_inst; i++)
+                inst_cache[i].live_flags = DRC_FLAGS_ALL;
+            break;
+        }
+    }
+
+    if ((BYTE*)cache_start + CACHE_SIZE - x64_ptr < (num_inst + 1)*X64_MAX_INST_SIZE)
+        x64_clearCache();
+
+    memset(inst_target, 0, num_inst*sizeof(bool));
+    for (i = 0; i < num_inst; i++) {
+        inst_code[i] = NULL;
+        if ((inst_cache[i].opcode >= V810_OP_BV && inst_cache[i].opcode <= V810_OP_BGT) ||
+                inst_cache[i].opcode == V810_OP_JR || inst_cache[i].opcode == V810_OP_JAL) {
+            target = drc_findInst(inst_cache, num_inst, inst_cache[i].PC + inst_cache[i].branch_offset);
+            if (target >= 0)
+                inst_target[target] = true;
+        }
+    }
+    // drc_scanBlockBounds can move the start back, and drc_run needs an
+    // entrypoint right where it's about to enter
+    if ((entry_PC >> 24) == 0x05)
+        target = drc_findInst(inst_cache, num_inst, entry_PC & V810_VB_RAM.highaddr);
+    else
+        target = drc_findInst(inst_cache, num_inst, entry_PC & V810_ROM1.highaddr);
+    if (target >= 0)
+        inst_target[target] = true;
+
+    x64_num_fixups = 0;
+    x64_pending_cycles = 0;
+    for (i = 0; i < num_inst; i++) {
+        if (inst_target[i])
+            x64_flushCycles();
+        // Only instructions with nothing pending can be entered directly
+        if (!x64_pending_cycles)
+            inst_code[i] = x64_ptr;
+        x64_emitInst(i, num_inst);
+    }
+    last = &inst_cache[num_inst - 1];
+    x64_exitTo(last->PC + am_size_table[optable[last->opcode].addr_mode], X64_EXIT_NORMAL);
+
+    for (i = 0; i < (unsigned int)x64_num_fixups; i++)
+        x64_patch(x64_fixups[i].disp, inst_code[x64_fixups[i].target]);
+
+    for (i = 0; i < num_inst; i++) {
+        if (inst_code[i] && (slot = x64_getEntrySlot(inst_cache[i].PC)))
+            *slot = inst_code[i];
+        // Stores to this code have to drop it (see drc_invalidateRam)
+        if ((inst_cache[i].PC >> 24) == 0x05)
+            v810_state->ram_code_pages[(inst_cache[i].PC >> 8) & 0xFF] = 1;
+    }
+    if ((last->PC >> 24) == 0x05) {
+        v810_state->ram_code_pages[((last->PC + 3) >> 8) & 0xFF] = 1;
+        x64_fastmemProtectCode(inst_cache[0].PC, last->PC + 4);
+    }
+
+    dprintf(3, "[DRC]: x86-64 block 0x%x-0x%x, %d bytes\n", start_PC, end_PC,
+            (int)(x64_ptr - (BYTE*)cache_pos));
+    cache_pos = (WORD*)x64_ptr;
+    x64_num_translated++;
+    x64_num_blocks++;
+    return 0;
+}
+
+// Drops the code translated from VB RAM. Blocks can span several pages, so
+// everything in RAM goes, which is cheap since it's rarely used.
+void drc_invalidateRam(WORD start, WORD end) {
+    memset(x64_ram_map, 0, ((V810_VB_RAM.highaddr - V810_VB_RAM.lowaddr) / 2 + 1) * sizeof(BYTE*));
+    memset(v810_state->ram_code_pages, 0, sizeof(v810_state->ram_code_pages));
+    x64_fastmemUnprotectCode();
+    dprintf(3, "[DRC]: invalidated RAM code 0x%x->0x%x\n", start, end);
+}
+
+// Generates x64_enter and x64_exit
+static void x64_emitStubs() {
+    x64_ptr = (BYTE*)cache_start;
+
+    x64_enter = (int (*)(cpu_state*, BYTE*))x64_ptr;
+    // Three pushes leave the stack 16 byte aligned for the helpers
+    x64_push(X64_EBX);
+    x64_push(X64_R13);
+    x64_push(X64_R14);
+    x64_byte(0x48); x64_mov(X64_EBX, X64_EDI);                      // mov rbx, rdi
+    x64_alu(X64_XOR, X64_R13, X64_R13);
+    if (x64_fastmem_base) {
+        x64_byte(0x49); x64_byte(0xB8 | (X64_R14 & 7));             // mov r14, imm64
+        memcpy(x64_ptr, &x64_fastmem_base, 8);
+        x64_ptr += 8;
+    }
+    x64_byte(0xFF); x64_modrmReg(4, X64_ESI);                       // jmp rsi
+
+    x64_exit = x64_ptr;
+    x64_aluStore(X64_ADD, X64_STATE(cycles), X64_R13);
+    x64_pop(X64_R14);
+    x64_pop(X64_R13);
+    x64_pop(X64_EBX);
+    x64_byte(0xC3);                                                 // ret
+
+    x64_code_start = x64_ptr;
+}
+
+void drc_init() {
+    x64_rom_map = calloc(sizeof(BYTE*), (V810_ROM1.highaddr - V810_ROM1.lowaddr) / 2 + 1);
+    x64_ram_map = calloc(sizeof(BYTE*), (V810_VB_RAM.highaddr - V810_VB_RAM.lowaddr) / 2 + 1);
+
+    cache_start = memalign(0x1000, CACHE_SIZE);
+    ReprotectMemory(cache_start, CACHE_SIZE/0x1000, 0x7);
+    x64_fastmemInit((BYTE*)cache_start, (BYTE*)cache_start + CACHE_SIZE);
+    x64_emitStubs();
+    cache_pos = (WORD*)x64_ptr;
+
+    dprintf(0, "[DRC]: cache_start = %p\n", cache_start);
+    if (tVBOpt.LOCKSTEP)
+        drc_lockstepInit();
+}
+
+void drc_exit() {
+    if (tVBOpt.LOCKSTEP)
+        drc_lockstepExit();
+    x64_fastmemExit();
+    free(cache_start);
+    free(x64_rom_map);
+    free(x64_ram_map);
+}
+
+// Run V810 code until the next frame interrupt
+int drc_run() {
+    BYTE** slot;
+    BYTE* entrypoint;
+    WORD entry_PC;
+    int err;
+
+    while (true) {
+        // Service whatever came due during the last block, until the frame
+        // is done
+        sched_run(v810_state->cycles, v810_state->PC);
+        if (v810_state->ret)
+            break;
+
+        // Nothing runs while halted, so go straight to the next event
+        if (v810_state->halted) {
+            v810_state->cycles += v810_state->next_event;
+            continue;
+        }
+
+        v810_state->PC &= V810_ROM1.highaddr;
+        entry_PC = v810_state->PC;
+        if (!(slot = x64_getEntrySlot(v810_state->PC)))
+            return DRC_ERR_BAD_PC;
+
+        entrypoint = *slot;
+        if (!entrypoint && tVBOpt.DYNAREC) {
+            PROF_START(PROF_TRANSLATE);
+            err = x64_translateBlock(v810_state->PC);
+            PROF_STOP(PROF_TRANSLATE);
+            if (err)
+                return err;
+            entrypoint = *slot;
+        }
+        // Not cached and we can't translate it, so interpret it instead
+        if (!entrypoint) {
+            PROF_START(PROF_EXECUTE);
+            err = v810_interpBlock();
+            PROF_STOP(PROF_EXECUTE);
+            if (err)
+                return err;
+            continue;
+        }
+
+        if (tVBOpt.LOCKSTEP)
+            drc_lockstepBegin();
+        PROF_START(PROF_EXECUTE);
+        err = 0;
+        if (x64_enter(v810_state, entrypoint) == X64_EXIT_INTERP)
+            err = v810_interpBlock();
+        PROF_STOP(PROF_EXECUTE);
+        if (err)
+            return err;
+        if (tVBOpt.LOCKSTEP && (err = drc_lockstepCheck(entry_PC)))
+            return err;
+
+        v810_state->PC &= V810_ROM1.highaddr;
+        if (v810_state->PC < V810_VB_RAM.lowaddr || v810_state->PC > V810_ROM1.highaddr)
+            return DRC_ERR_BAD_PC;
+    }
+    v810_state->ret = 0;
+
+    return 0;
+}
+
+// The translated code isn't saved to disk here, so there's nothing the AOT
+// translator could write out
+int drc_precompile(const WORD* roots, int num_roots) {
+    return -1;
+}
+
+void drc_getStats(drc_stats* stats) {
+    stats->translated = x64_num_translated;
+    stats->blocks = x64_num_blocks;
+    stats->cache_used = x64_ptr - x64_code_start;
+    stats->cache_size = CACHE_SIZE;
+}
+
+// Dumps the translation cache onto a file
+void drc_dumpCache(char* filename) {
+    FILE* f = fopen(filename, "w");
+    fwrite(cache_start, CACHE_SIZE, 1, f);
+    fclose(f);
+}
+
+void drc_dumpDebugInfo() {
+    int i;
+    FILE* f = fopen("debug_info.txt", "w");
+
+    fprintf(f, "PC: 0x%08x\n", v810_state->PC);
+    for (i = 0; i < 32; i++)
+        fprintf(f, "r%d: 0x%08x\n", i, v810_state->P_REG[i]);
+
+    for (i = 0; i < 32; i++)
+        fprintf(f, "s%d: 0x%08x\n", i, v810_state->S_REG[i]);
+
+    fprintf(f, "Cycles: %d\n", v810_state->cycles);
+    fprintf(f, "Cache start: %p\n", cache_start);
+    fprintf(f, "Cache pos: %p\n", cache_pos);
+
+    if (tVBOpt.DEBUG) {
+        debug_dumpdrccache();
+        debug_dumpvbram();
+    }
+
+    fclose(f);
+}
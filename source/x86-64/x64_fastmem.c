@@ -0,0 +1,276 @@
+/*
+ * Host view of the V810 address space for the x86-64 dynarec
+ *
+ * With tVBOpt.FASTMEM set, a 128 MiB region of host memory stands for the
+ * whole 27-bit V810 address space, so the translated code can do its loads
+ * and stores with a single mov from r14 + address. Display RAM, VB RAM, game
+ * RAM and ROM are moved into a memfd, mapped back where they were (so
+ * everything else keeps its pointers) and mapped again into the view at their
+ * V810 addresses, mirrors included. What's mapped and how follows the page
+ * tables of v810_mem.c: pages read directly are readable, pages also written
+ * directly are writable, and everything else is left inaccessible.
+ *
+ * Accesses to the rest fault, and the SIGSEGV handler does them through the
+ * mem_r* and mem_w* functions and skips the instruction. That's how I/O, the
+ * DSP cache invalidation and sound_update keep working. VB RAM is the
+ * exception: it's writable, except for the pages with translated code, and
+ * only mapped once since catching stores to code in every mirror would cost
+ * too much.
+ *
+ * This file is distributed under the MIT License, see drc_core.c.
+ */
+
+#define _GNU_SOURCE
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+#include "utils.h"
+#include "x64_fastmem.h"
+#include "x64_emit.h"
+#include "v810_cpu.h"
+#include "v810_mem.h"
+#include "vb_set.h"
+#include "vb_types.h"
+
+#define FASTMEM_NUM_REGIONS 4
+
+BYTE* x64_fastmem_base = NULL;
+
+static V810_MEMORYFETCH* const fastmem_regions[FASTMEM_NUM_REGIONS] = {
+    &V810_DISPLAY_RAM,
+    &V810_VB_RAM,
+    &V810_GAME_RAM,
+    &V810_ROM1,
+};
+
+static int fastmem_fd = -1;
+// Where each region starts in the memfd
+static WORD fastmem_offsets[FASTMEM_NUM_REGIONS];
+// Faults anywhere else aren't ours
+static BYTE* fastmem_code_start;
+static BYTE* fastmem_code_end;
+static struct sigaction fastmem_old_action;
+
+static WORD x64_fastmemRegionSize(int region) {
+    WORD size = (fastmem_regions[region]->highaddr + 1) - fastmem_regions[region]->lowaddr;
+
+    return (size + MEM_PAGE_MASK) & ~MEM_PAGE_MASK;
+}
+
+// Offset in the memfd of the memory at host, -1 if it isn't in it
+static long x64_fastmemOffset(uintptr_t host) {
+    uintptr_t start;
+    int i;
+
+    for (i = 0; i < FASTMEM_NUM_REGIONS; i++) {
+        start = (uintptr_t)fastmem_regions[i]->pmemory;
+        if (host >= start && host < start + x64_fastmemRegionSize(i))
+            return fastmem_offsets[i] + (host - start);
+    }
+    return -1;
+}
+
+// Maps pages [start, end) of the view as described by the page tables
+static void x64_fastmemMap(WORD start, WORD end) {
+    WORD addr, run_start = start;
+    long offset, run_offset = -1;
+    int prot, run_prot = PROT_NONE;
+
+    for (addr = start; addr <= end; addr += MEM_PAGE_SIZE) {
+        offset = -1;
+        prot = PROT_NONE;
+        if (addr == end) {
+            // Flushes the last run
+        } else if ((addr >> 24) == 0x05) {
+            if (addr <= V810_VB_RAM.highaddr) {
+                offset = x64_fastmemOffset((uintptr_t)V810_VB_RAM.pmemory + (addr - V810_VB_RAM.lowaddr));
+                prot = PROT_READ | PROT_WRITE;
+            }
+        } else if (mem_rpages[addr >> MEM_PAGE_BITS] >= MEM_NUM_HANDLERS) {
+            offset = x64_fastmemOffset(mem_rpages[addr >> MEM_PAGE_BITS]);
+            prot = PROT_READ;
+            if (mem_wpages[addr >> MEM_PAGE_BITS] == mem_rpages[addr >> MEM_PAGE_BITS])
+                prot |= PROT_WRITE;
+        }
+        if (offset < 0)
+            prot = PROT_NONE;
+
+        // Pages that follow each other in the memfd go in one mapping
+        if (addr > run_start && (addr == end || prot != run_prot ||
+                (offset < 0) != (run_offset < 0) ||
+                (offset >= 0 && offset != run_offset + (long)(addr - run_start)))) {
+            if (run_offset >= 0)
+                mmap(x64_fastmem_base + run_start, addr - run_start, run_prot,
+                     MAP_SHARED | MAP_FIXED, fastmem_fd, run_offset);
+            else
+                mmap(x64_fastmem_base + run_start, addr - run_start, PROT_NONE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0);
+            run_start = addr;
+        }
+        if (addr == run_start) {
+            run_offset = offset;
+            run_prot = prot;
+        }
+    }
+}
+
+// Does the access at ip, which faulted at V810 address addr. Only the forms
+// emitted by x64_loadFast and x64_storeFast get here: an optional 0x66, REX.B,
+// the opcode (0x0F and another byte for movzx and movsx), and the ModRM and SIB
+// bytes for [r14 + rdi].
+static BYTE* x64_fastmemEmulate(BYTE* ip, WORD addr, greg_t* regs) {
+    bool hword = false;
+    BYTE op;
+
+    if (*ip == 0x66) {
+        hword = true;
+        ip++;
+    }
+    ip++;
+    op = *ip++;
+    if (op == 0x0F)
+        op = *ip++;
+
+    switch (op) {
+        case X64_MOVZX8:
+            regs[REG_RAX] = mem_rbyte(addr);
+            break;
+        case X64_MOVSX8:
+            regs[REG_RAX] = (WORD)(signed char)mem_rbyte(addr);
+            break;
+        case X64_MOVZX16:
+            regs[REG_RAX] = mem_rhword(addr);
+            break;
+        case X64_MOVSX16:
+            regs[REG_RAX] = (WORD)(signed short)mem_rhword(addr);
+            break;
+        case 0x8B:
+            regs[REG_RAX] = mem_rword(addr);
+            break;
+        case 0x88:
+            mem_wbyte(addr, (BYTE)regs[REG_RSI]);
+            break;
+        default: // 0x89
+            if (hword)
+                mem_whword(addr, (HWORD)regs[REG_RSI]);
+            else
+                mem_wword(addr, (WORD)regs[REG_RSI]);
+            break;
+    }
+    return ip + 2;
+}
+
+static void x64_fastmemFault(int sig, siginfo_t* info, void* context) {
+    greg_t* regs = ((ucontext_t*)context)->uc_mcontext.gregs;
+    BYTE* ip = (BYTE*)regs[REG_RIP];
+    uintptr_t fault = (uintptr_t)info->si_addr;
+    uintptr_t rpage, wpage;
+    WORD addr;
+
+    if (fault < (uintptr_t)x64_fastmem_base || fault >= (uintptr_t)x64_fastmem_base + X64_FASTMEM_SIZE ||
+            ip < fastmem_code_start || ip >= fastmem_code_end) {
+        // A real crash, let it happen again without us
+        sigaction(SIGSEGV, &fastmem_old_action, NULL);
+        return;
+    }
+
+    addr = fault - (uintptr_t)x64_fastmem_base;
+    rpage = mem_rpages[addr >> MEM_PAGE_BITS];
+    wpage = mem_wpages[addr >> MEM_PAGE_BITS];
+    regs[REG_RIP] = (greg_t)x64_fastmemEmulate(ip, addr, regs);
+
+    // Game RAM gets mapped directly once it's used (see mem_mapGameRam)
+    if (mem_rpages[addr >> MEM_PAGE_BITS] != rpage || mem_wpages[addr >> MEM_PAGE_BITS] != wpage)
+        x64_fastmemMap(addr & 0x07000000, (addr & 0x07000000) + 0x01000000);
+}
+
+void x64_fastmemInit(BYTE* code_start, BYTE* code_end) {
+    struct sigaction action;
+    WORD size = 0;
+    BYTE* mem;
+    int i;
+
+    if (!tVBOpt.FASTMEM)
+        return;
+
+    for (i = 0; i < FASTMEM_NUM_REGIONS; i++) {
+        fastmem_offsets[i] = size;
+        size += x64_fastmemRegionSize(i);
+    }
+    if ((fastmem_fd = memfd_create("vb_memory", 0)) < 0 || ftruncate(fastmem_fd, size) < 0) {
+        dprintf(0, "[DRC]: couldn't create the fastmem memfd, fastmem is off\n");
+        goto fail;
+    }
+
+    // Moves the memory into the memfd, at the same address
+    for (i = 0; i < FASTMEM_NUM_REGIONS; i++) {
+        mem = fastmem_regions[i]->pmemory;
+        pwrite(fastmem_fd, mem, (fastmem_regions[i]->highaddr + 1) - fastmem_regions[i]->lowaddr, fastmem_offsets[i]);
+        if (mmap(mem, x64_fastmemRegionSize(i), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED,
+                fastmem_fd, fastmem_offsets[i]) != mem) {
+            dprintf(0, "[DRC]: couldn't remap the V810 memory, fastmem is off\n");
+            goto fail;
+        }
+    }
+
+    x64_fastmem_base = mmap(NULL, X64_FASTMEM_SIZE, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (x64_fastmem_base == MAP_FAILED) {
+        dprintf(0, "[DRC]: couldn't reserve the fastmem view, fastmem is off\n");
+        x64_fastmem_base = NULL;
+        goto fail;
+    }
+    x64_fastmemMap(0, X64_FASTMEM_SIZE);
+
+    fastmem_code_start = code_start;
+    fastmem_code_end = code_end;
+    memset(&action, 0, sizeof(action));
+    action.sa_sigaction = x64_fastmemFault;
+    action.sa_flags = SA_SIGINFO;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGSEGV, &action, &fastmem_old_action);
+
+    dprintf(0, "[DRC]: fastmem view at %p\n", x64_fastmem_base);
+    return;
+
+fail:
+    // The memory that was already moved stays in the memfd, which is fine
+    if (fastmem_fd >= 0)
+        close(fastmem_fd);
+    fastmem_fd = -1;
+}
+
+void x64_fastmemExit() {
+    if (!x64_fastmem_base)
+        return;
+    sigaction(SIGSEGV, &fastmem_old_action, NULL);
+    munmap(x64_fastmem_base, X64_FASTMEM_SIZE);
+    close(fastmem_fd);
+    x64_fastmem_base = NULL;
+    fastmem_fd = -1;
+}
+
+void x64_fastmemProtectCode(WORD start, WORD end) {
+    WORD mask = V810_VB_RAM.highaddr - V810_VB_RAM.lowaddr;
+
+    if (!x64_fastmem_base)
+        return;
+    start = V810_VB_RAM.lowaddr + (start & mask & ~MEM_PAGE_MASK);
+    end = V810_VB_RAM.lowaddr + (((end - 1) & mask) | MEM_PAGE_MASK) + 1;
+    // Blocks that wrap around the end of VB RAM
+    if (end <= start) {
+        start = V810_VB_RAM.lowaddr;
+        end = V810_VB_RAM.highaddr + 1;
+    }
+    mprotect(x64_fastmem_base + start, end - start, PROT_READ);
+}
+
+void x64_fastmemUnprotectCode() {
+    if (!x64_fastmem_base)
+        return;
+    mprotect(x64_fastmem_base + V810_VB_RAM.lowaddr, (V810_VB_RAM.highaddr + 1) - V810_VB_RAM.lowaddr,
+             PROT_READ | PROT_WRITE);
+}
@@ -0,0 +1,100 @@
+/*
+ * Checks for the host independent DRC passes in drc_scan.c, run with
+ * "make -f Makefile.linux test".
+ *
+ * This file is distributed under the MIT License, see drc_core.c.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "drc_core.h"
+#include "v810_opt.h"
+#include "vb_types.h"
+
+#define CHECK(cond) { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: %s failed\n", __FILE__, __LINE__, #cond); \
+        failures++; \
+    } \
+}
+
+// Read by vb_dsp.c, main.c isn't linked in
+int arm_keys;
+
+static v810_instruction insts[MAX_INST];
+static unsigned int num_inst;
+static int failures;
+
+static void addInst(BYTE opcode, BYTE reg1, BYTE reg2, WORD imm, int branch_offset) {
+    v810_instruction* inst = &insts[num_inst];
+
+    memset(inst, 0, sizeof(*inst));
+    inst->PC = 0x07000000 + num_inst*4;
+    inst->opcode = opcode;
+    inst->reg1 = reg1;
+    inst->reg2 = reg2;
+    inst->imm = imm;
+    inst->branch_offset = branch_offset;
+    num_inst++;
+}
+
+static void analyze() {
+    drc_findLiveFlags(insts, num_inst);
+    drc_propagateConstants(insts, num_inst, insts[0].PC);
+}
+
+// movhi 0x8000, r0, r10
+// shl 1, r10
+// bc 1f
+// mov 1, r11
+// 1: cmp r0, r0
+// jmp [r31]
+static void testShiftCarry() {
+    num_inst = 0;
+    addInst(V810_OP_MOVHI, 0, 10, 0x8000, 0);
+    addInst(V810_OP_SHL_I, 0xFF, 10, 1, 0);
+    addInst(V810_OP_BL, 0xFF, 0xFF, 0, 8);
+    addInst(V810_OP_MOV_I, 0xFF, 11, 1, 0);
+    addInst(V810_OP_CMP, 0, 0, 0, 0);
+    addInst(V810_OP_JMP, 31, 0xFF, 0, 0);
+    analyze();
+
+    CHECK(insts[0].const_info & DRC_CONST_RESULT);
+    // Only the carry of the shift is read, by the branch
+    CHECK(insts[1].live_flags == DRC_FLAG_C);
+    CHECK(insts[1].live_flags & drc_getFlagsWritten(&insts[1]) & DRC_FLAG_C);
+    CHECK(!(insts[1].const_info & DRC_CONST_RESULT));
+    // Nothing before the shift gets to keep a carry for the branch
+    CHECK(!(insts[0].live_flags & DRC_FLAG_C));
+}
+
+// movhi 0x8000, r0, r10
+// shl 1, r10
+// add r10, r11
+// jmp [r31]
+static void testShiftFold() {
+    num_inst = 0;
+    addInst(V810_OP_MOVHI, 0, 10, 0x8000, 0);
+    addInst(V810_OP_SHL_I, 0xFF, 10, 1, 0);
+    addInst(V810_OP_ADD, 10, 11, 0, 0);
+    addInst(V810_OP_JMP, 31, 0xFF, 0, 0);
+    analyze();
+
+    // The add overwrites every flag of the shift, so it can be folded
+    CHECK(insts[1].live_flags == 0);
+    CHECK(insts[1].const_info & DRC_CONST_RESULT);
+    CHECK(insts[1].const_result == 0);
+}
+
+int main() {
+    testShiftCarry();
+    testShiftFold();
+
+    if (failures) {
+        fprintf(stderr, "%d check(s) failed\n", failures);
+        return 1;
+    }
+    printf("All checks passed\n");
+    return 0;
+}
@@ -0,0 +1,92 @@
+/*
+ * Checks for the x86-64 dynarec backend, run with "make -f Makefile.linux
+ * test" on x86-64 hosts.
+ *
+ * This file is distributed under the MIT License, see drc_core.c.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "drc_core.h"
+#include "drc_x64.h"
+#include "v810_cpu.h"
+#include "v810_mem.h"
+#include "vb_set.h"
+#include "vb_types.h"
+
+#define CHECK(cond) { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: %s failed\n", __FILE__, __LINE__, #cond); \
+        failures++; \
+    } \
+}
+
+#define ROM_SIZE 0x1000
+
+// Read by vb_dsp.c, main.c isn't linked in
+int arm_keys;
+
+static int failures;
+
+// 0x07000000: add -1, r10
+// 0x07000002: add 1, r11
+// 0x07000004: bne 0x07000000
+// 0x07000006: jmp [r31]
+static const HWORD rom_code[] = {0x455F, 0x4561, 0x95FC, 0x181F};
+
+// Loads a ROM with the given code at 0x07000000
+static int loadRom(const HWORD* code, int num_hwords) {
+    char rom_name[] = "/tmp/r3dtestXXXXXX";
+    HWORD rom[ROM_SIZE/2];
+    FILE* f;
+    int fd, ret;
+
+    memset(rom, 0, sizeof(rom));
+    memcpy(rom, code, num_hwords*sizeof(HWORD));
+    if ((fd = mkstemp(rom_name)) < 0 || !(f = fdopen(fd, "wb")))
+        return 0;
+    fwrite(rom, 1, sizeof(rom), f);
+    fclose(f);
+
+    ret = v810_init(rom_name);
+    unlink(rom_name);
+    return ret;
+}
+
+static void testEntryInLoop() {
+    BYTE** slot;
+
+    // Entering at the second instruction moves the start of the block back to
+    // the branch target, with the cycles of the add still pending
+    CHECK(!x64_translateBlock(0x07000002));
+    slot = x64_getEntrySlot(0x07000002);
+    CHECK(slot && *slot);
+    slot = x64_getEntrySlot(0x07000000);
+    CHECK(slot && *slot);
+}
+
+int main() {
+    setDefaults();
+    tVBOpt.DYNAREC = 1;
+    tVBOpt.DRCTHREAD = 0;
+    if (!loadRom(rom_code, sizeof(rom_code)/sizeof(rom_code[0]))) {
+        fprintf(stderr, "Couldn't write the test ROM\n");
+        return 1;
+    }
+    v810_reset();
+    drc_init();
+
+    testEntryInLoop();
+
+    drc_exit();
+    v810_exit();
+    if (failures) {
+        fprintf(stderr, "%d check(s) failed\n", failures);
+        return 1;
+    }
+    printf("All checks passed\n");
+    return 0;
+}